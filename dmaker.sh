@@ -1,7 +1,7 @@
 #!/bin/bash
 
 gcc src/$1.c -o bin/$1 -ggdb \
-	-Iinclude \
+	-Iinclude -D_GNU_SOURCE -pthread \
 	-Wall -Wextra -Wno-attributes -Wno-unused-function -Wno-unused-variable \
 	-Wno-unused-label -Wno-unused-parameter -Wno-unused-but-set-variable \
 	-Wno-switch \
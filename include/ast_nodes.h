@@ -1,3 +1,5 @@
+#pragma once
+
 #include "utils.h"
 
 
@@ -19,7 +21,7 @@
 	X(Assert, 0, 0, 1, 1), \
 \
 /* DIRECTIVES */ \
-	X(Import, 0, 0, 1, 1), \
+	X(Import, 0, 0, 1, 2), \
 \
 /* POSTFIX OPERATORS */ \
 	X(Dereference,    140, 255, 1, 1), \
@@ -145,7 +147,8 @@
 	X(Nop,         255, 255, 1, 1), \
 	X(Error,       255, 255, 0, 1), \
 	X(Value,       255, 255, 0, 1), \
-	X(ReturnClass, 255, 255, 0, 1)
+	X(ReturnClass, 255, 255, 0, 1), \
+	X(Bool,        255, 255, 0, 2)
 
 
 
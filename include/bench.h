@@ -0,0 +1,344 @@
+#pragma once
+
+#include "utils.h"
+#include "classes.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
+
+
+// TIMING
+static uint64_t bench_now_ns(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec*1000000000u + (uint64_t)t.tv_nsec;
+}
+
+static int bench_compare_u64(const void *a, const void *b){
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+// samples are sorted in place
+static uint64_t bench_percentile(uint64_t *samples, size_t count, size_t percent){
+	assert(count != 0 && percent <= 100);
+	qsort(samples, count, sizeof(uint64_t), bench_compare_u64);
+	return samples[((count-1)*percent + 50)/100];
+}
+
+
+
+// REPORTS
+enum BenchFormat{
+	BenchFormat_Text,
+	BenchFormat_Csv,
+	BenchFormat_Json
+};
+
+typedef struct{
+	FILE *out;
+	enum BenchFormat format;
+	size_t rows;
+} BenchReport;
+
+static BenchReport bench_report_begin(FILE *out, enum BenchFormat format){
+	BenchReport r = { .out = out, .format = format };
+	switch (format){
+	case BenchFormat_Csv:
+		fprintf(out, "benchmark,bytes,runs,median_ns,p99_ns,mb_per_s\n");
+		break;
+	case BenchFormat_Json:
+		fprintf(out, "[");
+		break;
+	default: break;
+	}
+	return r;
+}
+
+// bytes can be zero for benchmarks that do not process text
+static void bench_report_row(
+	BenchReport *r, const char *name, size_t bytes, uint64_t *samples, size_t count
+){
+	uint64_t median = bench_percentile(samples, count, 50);
+	uint64_t p99 = bench_percentile(samples, count, 99);
+	double mb_per_s = median != 0 ? (double)bytes*1e3 / (double)median : 0.0;
+
+	switch (r->format){
+	case BenchFormat_Text:
+		fprintf(r->out,
+			"%-24s median:%14.6lf [ms]   p99:%14.6lf [ms]",
+			name, (double)median*1e-6, (double)p99*1e-6
+		);
+		if (bytes != 0) fprintf(r->out, "  %11.2lf [MB/s]", mb_per_s);
+		fputc('\n', r->out);
+		break;
+	case BenchFormat_Csv:
+		fprintf(r->out,
+			"%s,%zu,%zu,%lu,%lu,%.2lf\n", name, bytes, count, median, p99, mb_per_s
+		);
+		break;
+	case BenchFormat_Json:
+		fprintf(r->out,
+			"%s\n  {\"benchmark\": \"%s\", \"bytes\": %zu, \"runs\": %zu, "
+			"\"median_ns\": %lu, \"p99_ns\": %lu, \"mb_per_s\": %.2lf}",
+			r->rows == 0 ? "" : ",", name, bytes, count, median, p99, mb_per_s
+		);
+		break;
+	}
+	r->rows += 1;
+}
+
+static void bench_report_end(BenchReport *r){
+	if (r->format == BenchFormat_Json) fprintf(r->out, "\n]\n");
+}
+
+static bool bench_parse_format(const char *name, enum BenchFormat *format){
+	if (strcmp(name, "text") == 0){ *format = BenchFormat_Text; return true; }
+	if (strcmp(name, "csv")  == 0){ *format = BenchFormat_Csv;  return true; }
+	if (strcmp(name, "json") == 0){ *format = BenchFormat_Json; return true; }
+	return false;
+}
+
+// options of every benchmark, -n <runs>, -r <seed> and -f <format>. returns
+// 1 when the option at i is one of them and i is moved to its argument, 0
+// when it isn't and -1 when the format is unknown
+static int bench_parse_common(
+	int argc, char **argv, int *i, size_t *runs, uint64_t *seed, enum BenchFormat *format
+){
+	const char *opt = argv[*i];
+	if (*i+1 == argc || opt[0] != '-' || opt[1] == '\0' || opt[2] != '\0') return 0;
+	const char *value = argv[*i+1];
+	switch (opt[1]){
+	case 'n': *runs = strtoul(value, NULL, 10); break;
+	case 'r': *seed = strtoull(value, NULL, 10); break;
+	case 'f':
+		if (!bench_parse_format(value, format)){
+			fprintf(stderr, "unknown format: %s\n", value);
+			return -1;
+		}
+		break;
+	default: return 0;
+	}
+	*i += 1;
+	return 1;
+}
+
+// accepts sizes like 4096, 64k, 10M, 1G
+static size_t bench_parse_size(const char *text){
+	char *end;
+	size_t size = strtoull(text, &end, 10);
+	switch (*end){
+	case 'k': case 'K': size <<= 10; break;
+	case 'm': case 'M': size <<= 20; break;
+	case 'g': case 'G': size <<= 30; break;
+	default: break;
+	}
+	return size;
+}
+
+
+
+// RANDOM NUMBERS
+// xorshift64*, so generated sources are the same on every machine
+typedef struct{
+	uint64_t state;
+} BenchRandom;
+
+static uint64_t bench_random(BenchRandom *r){
+	uint64_t x = r->state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	r->state = x;
+	return x * 0x2545f4914f6cdd1du;
+}
+
+static uint32_t bench_random_below(BenchRandom *r, uint32_t bound){
+	return (uint32_t)((bench_random(r) >> 32) * bound >> 32);
+}
+
+
+
+// SOURCE GENERATOR
+// writes syntactically valid yack code until at least target_size bytes are
+// written, the output depends only on the seed
+static const char *const BenchWords[] = {
+	"count", "index", "value", "size", "data", "result", "node", "item", "left",
+	"right", "offset", "length", "buffer", "state", "flags", "total", "width",
+	"height", "key", "entry", "next", "prev", "head", "tail", "mask", "scale"
+};
+
+// names of fields and elements, n / SIZE(BenchWords) tells apart the ones
+// with the same word
+static NameId bench_name_id(CompilerContext *ctx, size_t n){
+	char buf[32];
+	int length = snprintf(
+		buf, sizeof(buf), "%s_%zu", BenchWords[n % SIZE(BenchWords)], n / SIZE(BenchWords)
+	);
+	return get_name_id(ctx, buf, length);
+}
+
+typedef struct{
+	FILE *out;
+	BenchRandom rng;
+	size_t written;
+	size_t proc_count;
+	size_t const_count;
+} BenchGenerator;
+
+static void gen_write(BenchGenerator *g, const char *text){
+	g->written += fputs(text, g->out) >= 0 ? strlen(text) : 0;
+}
+
+static void gen_printf(BenchGenerator *g, const char *fmt, ...){
+	va_list args;
+	va_start(args, fmt);
+	int res = vfprintf(g->out, fmt, args);
+	va_end(args);
+	if (res > 0) g->written += res;
+}
+
+static void gen_name(BenchGenerator *g){
+	const char *word = BenchWords[bench_random_below(&g->rng, SIZE(BenchWords))];
+	uint32_t suffix = bench_random_below(&g->rng, 4);
+	if (suffix == 0){
+		gen_write(g, word);
+	} else{
+		gen_printf(g, "%s_%u", word, bench_random_below(&g->rng, 64));
+	}
+}
+
+static void gen_literal(BenchGenerator *g){
+	switch (bench_random_below(&g->rng, 8)){
+	case 0: gen_printf(g, "0x%x", bench_random_below(&g->rng, 1u << 24)); break;
+	case 1: gen_printf(g, "0b%u%u%u1", bench_random_below(&g->rng, 2),
+		bench_random_below(&g->rng, 2), bench_random_below(&g->rng, 2)); break;
+	case 2: gen_printf(g, "%u.%u", bench_random_below(&g->rng, 1000),
+		bench_random_below(&g->rng, 1000)); break;
+	case 3: gen_printf(g, "%u.%uf", bench_random_below(&g->rng, 100),
+		bench_random_below(&g->rng, 100)); break;
+	case 4: gen_printf(g, "'%c'", 'a' + bench_random_below(&g->rng, 26)); break;
+	default: gen_printf(g, "%u", bench_random_below(&g->rng, 100000)); break;
+	}
+}
+
+static void gen_expression(BenchGenerator *g, size_t depth){
+	static const char *const Opers[] = {
+		" + ", " - ", " * ", " / ", " % ", " << ", " >> ", " | ", " & ", " ^ ",
+		" == ", " != ", " < ", " >= ", " && ", " || "
+	};
+	uint32_t kind = bench_random_below(&g->rng, depth == 0 ? 3 : 8);
+	switch (kind){
+	case 0: gen_literal(g); break;
+	case 1: case 2: gen_name(g); break;
+	case 3:
+		gen_write(g, "(");
+		gen_expression(g, depth-1);
+		gen_write(g, Opers[bench_random_below(&g->rng, SIZE(Opers))]);
+		gen_expression(g, depth-1);
+		gen_write(g, ")");
+		break;
+	case 4:{
+		if (g->proc_count == 0){ gen_name(g); break; }
+		gen_printf(g, "proc_%u(", bench_random_below(&g->rng, g->proc_count));
+		uint32_t arg_count = bench_random_below(&g->rng, 4);
+		for (uint32_t i=0; i!=arg_count; i+=1){
+			if (i != 0) gen_write(g, ", ");
+			gen_expression(g, depth-1);
+		}
+		gen_write(g, ")");
+		break;
+	}
+	case 5:
+		gen_name(g);
+		gen_write(g, ".");
+		gen_name(g);
+		break;
+	case 6:
+		gen_name(g);
+		gen_write(g, "[");
+		gen_expression(g, depth-1);
+		gen_write(g, "]");
+		break;
+	default:
+		gen_expression(g, depth-1);
+		gen_write(g, Opers[bench_random_below(&g->rng, 10)]);
+		gen_expression(g, depth-1);
+		break;
+	}
+}
+
+// the parser allows definitions only in procedure bodies, so value blocks
+// nested in them contain only expressions
+static void gen_block(BenchGenerator *g, size_t depth, size_t indent, bool is_body){
+	static const char Spaces[] = "\t\t\t\t\t\t\t\t";
+	uint32_t stmt_count = 1 + bench_random_below(&g->rng, 6);
+	gen_write(g, "{\n");
+	for (uint32_t i=0; i!=stmt_count; i+=1){
+		gen_write(g, Spaces + SIZE(Spaces)-1 - util_min_usize(indent+1, SIZE(Spaces)-1));
+		uint32_t kind = bench_random_below(&g->rng, 10);
+		if (i+1 == stmt_count){
+			gen_expression(g, 3);
+		} else if (!is_body){
+			gen_expression(g, 2);
+			gen_write(g, ";");
+		} else if (kind == 0 && depth != 0){
+			gen_name(g);
+			gen_write(g, " := ");
+			gen_block(g, depth-1, indent+1, false);
+			gen_write(g, ";");
+		} else if (kind == 1 && depth != 0){
+			gen_name(g);
+			gen_write(g, " :: (x, y) => ");
+			gen_block(g, depth-1, indent+1, true);
+			gen_write(g, ";");
+		} else if (kind == 2){
+			gen_name(g);
+			gen_printf(g, " := \"%s %u\\n\";", BenchWords[i % SIZE(BenchWords)], i);
+		} else if (kind == 3){
+			gen_name(g);
+			gen_write(g, " := (x) => x + ");
+			gen_literal(g);
+			gen_write(g, ";");
+		} else{
+			gen_name(g);
+			gen_write(g, bench_random_below(&g->rng, 4) == 0 ? " :: " : " := ");
+			gen_expression(g, 3);
+			gen_write(g, ";");
+		}
+		if (bench_random_below(&g->rng, 8) == 0){
+			gen_write(g, " /* note */");
+		}
+		gen_write(g, "\n");
+	}
+	gen_write(g, Spaces + SIZE(Spaces)-1 - util_min_usize(indent, SIZE(Spaces)-1));
+	gen_write(g, "}");
+}
+
+static size_t gen_source(FILE *out, size_t target_size, uint64_t seed){
+	BenchGenerator g = { .out = out, .rng = { seed | 1u } };
+	while (g.written < target_size){
+		uint32_t kind = bench_random_below(&g.rng, 8);
+		if (kind == 0){
+			gen_printf(&g, "CONST_%zu :: ", g.const_count);
+			gen_expression(&g, 2);
+			gen_write(&g, " // constant\n");
+			g.const_count += 1;
+		} else{
+			gen_printf(&g, "proc_%zu :: (", g.proc_count);
+			uint32_t param_count = bench_random_below(&g.rng, 5);
+			for (uint32_t i=0; i!=param_count; i+=1){
+				if (i != 0) gen_write(&g, ", ");
+				gen_printf(&g, "p%u", i);
+			}
+			gen_write(&g, ") => ");
+			gen_block(&g, 2, 0, true);
+			gen_write(&g, "\n\n");
+			g.proc_count += 1;
+		}
+	}
+	return g.written;
+}
@@ -5,32 +5,240 @@ _Static_assert(sizeof(BcNode) == 8, "must be true");
 
 
 
-static uint32_t static_data_alloc(void *data, size_t data_size, uint8_t alignment){
-	uint32_t index = global_bc_size;
-	DataHeader *top = (DataHeader *)(global_bc + index);
+static uint32_t static_data_alloc(
+	CompilerContext *ctx, void *data, size_t data_size, uint8_t alignment
+){
+	uint32_t index = ctx->bc_size;
+	DataHeader *top = (DataHeader *)(ctx->bc + index);
 	*top = (DataHeader){ .bytesize = data_size, .alignment = alignment };
 	memcpy(top+1, data, data_size);
-	global_bc_size = index + 1 + (data_size + sizeof(BcNode) - 1)/sizeof(BcNode);
+	ctx->bc_size = index + 1 + (data_size + sizeof(BcNode) - 1)/sizeof(BcNode);
+	memory_track(MemTag_Bytecode, (ctx->bc_size - index)*sizeof(BcNode));
 	return index;
 }
 
 
 static uint32_t alloc_data_alloc_pb(
-	void *data, size_t data_size, uint8_t alignment,
+	CompilerContext *ctx, void *data, size_t data_size, uint8_t alignment,
 	uint16_t *ptr_bitset // this is reversed
 ){
 	size_t ptr_count = data_size / PTR_SIZE;
 	size_t ptr_bufs = (ptr_count + 15) / 16;
 	size_t ptrbuf_node_count = (ptr_bufs-1 + 3) / 4;
-	uint32_t index = global_bc_size + ptrbuf_node_count;
-	DataHeader *top = (DataHeader *)(global_bc + index);
+	uint32_t index = ctx->bc_size + ptrbuf_node_count;
+	DataHeader *top = (DataHeader *)(ctx->bc + index);
 	*top = (DataHeader){
 		.bytesize = data_size, .alignment = alignment, .flags = DataFlag_Pointered
 	};
 	memcpy(top+1, data, data_size);
-	global_bc_size = index + 1 + (data_size + sizeof(BcNode) - 1)/sizeof(BcNode);
+	size_t old_bc_size = ctx->bc_size;
+	ctx->bc_size = index + 1 + (data_size + sizeof(BcNode) - 1)/sizeof(BcNode);
+	memory_track(MemTag_Bytecode, (ctx->bc_size - old_bc_size)*sizeof(BcNode));
 	for (size_t i=0; i!=ptr_bufs; i+=1){
 		top->ptr_bitset[-(int)i] = ptr_bitset[-(int)i];
 	}	
 	return index;
 }
+
+
+
+// PROCEDURE BUILDER
+// a procedure is its header node followed by the first instruction, the
+// instructions are chained through inext. nodes after an instruction hold its
+// operands, a class first for operations that need one
+static const uint8_t BcOperandCounts[BC_Return+1] = {
+	[BC_Push]               = 2,
+	[BC_Alloc]              = 1,
+	[BC_MemLoad]            = 1,
+	[BC_MemStore]           = 1,
+	[BC_LoadField]          = 2,
+	[BC_LoadIndex]          = 1,
+	[BC_StoreField]         = 2,
+	[BC_StoreIndex]         = 1,
+	[BC_ConvertFloat]       = 2,
+	[BC_ZeroExtendVariable] = 1,
+	[BC_SignExtendVariable] = 1,
+	[BC_Jump]               = 1,
+	[BC_JumpIfZero]         = 1,
+	[BC_JumpIfNotZero]      = 1,
+	[BC_Call]               = 1,
+};
+
+typedef struct{
+	uint32_t proc; // index of the header
+	uint32_t last; // last instruction, 0 before the first one
+} BcBuilder;
+
+static BcProcHeader *bc_proc_header(const CompilerContext *ctx, uint32_t proc){
+	return (BcProcHeader *)(ctx->bc + proc);
+}
+
+static BcBuilder bc_begin_proc(CompilerContext *ctx, uint8_t arg_count, bool is_const){
+	uint32_t index = ctx->bc_size;
+	assert(index + 1 < BC_BUFFER_CAPACITY && "bytecode buffer overflow");
+	*bc_proc_header(ctx, index) = (BcProcHeader){ .arg_count = arg_count, .is_const = is_const };
+	ctx->bc_size = index + 1;
+	memory_track(MemTag_Bytecode, sizeof(BcNode));
+	return (BcBuilder){ .proc = index };
+}
+
+static uint32_t bc_emit(CompilerContext *ctx, BcBuilder *b, enum BcType type, uint16_t count){
+	size_t operand_count = BcOperandCounts[type];
+	uint32_t index = ctx->bc_size;
+	assert(index + 1 + operand_count < BC_BUFFER_CAPACITY && "bytecode buffer overflow");
+	assert((b->last != 0 || index == b->proc+1) && "first instruction must follow the header");
+	ctx->bc[index] = (BcNode){ .type = type, .count = count };
+	memset(ctx->bc + index + 1, 0, operand_count*sizeof(BcNode));
+	if (b->last != 0) ctx->bc[b->last].inext = index;
+	b->last = index;
+	ctx->bc_size = index + 1 + operand_count;
+	bc_proc_header(ctx, b->proc)->body_size += 1 + operand_count;
+	memory_track(MemTag_Bytecode, (1 + operand_count)*sizeof(BcNode));
+	return index;
+}
+
+static uint32_t bc_emit_class(
+	CompilerContext *ctx, BcBuilder *b, enum BcType type, uint16_t count, Class cl
+){
+	uint32_t index = bc_emit(ctx, b, type, count);
+	ctx->bc[index+1].clas = cl;
+	return index;
+}
+
+static uint32_t bc_emit_push(CompilerContext *ctx, BcBuilder *b, Class cl, Data data){
+	uint32_t index = bc_emit(ctx, b, BC_Push, 0);
+	ctx->bc[index+1].clas = cl;
+	ctx->bc[index+2].data = data;
+	return index;
+}
+
+// the target is set later for jumps forward
+static uint32_t bc_emit_jump(CompilerContext *ctx, BcBuilder *b, enum BcType type){
+	return bc_emit(ctx, b, type, 0);
+}
+
+static void bc_set_target(CompilerContext *ctx, uint32_t jump, uint32_t target){
+	ctx->bc[jump+1].data.u64 = target;
+	ctx->bc[target].flags |= BCF_Labeled;
+}
+
+static uint32_t bc_emit_call(CompilerContext *ctx, BcBuilder *b, uint32_t proc){
+	uint32_t index = bc_emit(ctx, b, BC_Call, bc_proc_header(ctx, proc)->arg_count);
+	ctx->bc[index+1].data.u64 = proc;
+	return index;
+}
+
+// for passes that add instructions to a complete procedure, like implicit
+// conversions, the instruction goes to the end of the buffer and is linked
+// after the instruction at
+static uint32_t bc_insert_after(
+	CompilerContext *ctx, uint32_t proc, uint32_t at, enum BcType type, uint16_t count
+){
+	assert(!bc_proc_header(ctx, proc)->is_linear && "instruction inserted to a linear body");
+	size_t operand_count = BcOperandCounts[type];
+	uint32_t index = ctx->bc_size;
+	assert(index + 1 + operand_count < BC_BUFFER_CAPACITY && "bytecode buffer overflow");
+	ctx->bc[index] = (BcNode){ .type = type, .count = count, .inext = ctx->bc[at].inext };
+	memset(ctx->bc + index + 1, 0, operand_count*sizeof(BcNode));
+	ctx->bc[at].inext = index;
+	ctx->bc_size = index + 1 + operand_count;
+	bc_proc_header(ctx, proc)->body_size += 1 + operand_count;
+	memory_track(MemTag_Bytecode, (1 + operand_count)*sizeof(BcNode));
+	return index;
+}
+
+
+
+// LINEAR LAYOUT
+// complete procedures are copied to the end of the buffer with instructions
+// in the order of the list, so the next instruction follows the operands of
+// the previous one and walking a body reads consecutive nodes. jump targets
+// become offsets from the jump and inext of an instruction is the offset of
+// the next one. nodes of the old bodies are left unused
+typedef struct{
+	uint32_t from;
+	uint32_t to;
+} BcRelocation;
+
+static const BcNode *bc_linear_next(const BcNode *ip){
+	return ip + ip->inext;
+}
+
+static int bc_relocation_cmp(const void *a, const void *b){
+	uint32_t x = ((const BcRelocation *)a)->from;
+	uint32_t y = ((const BcRelocation *)b)->from;
+	return (x > y) - (x < y);
+}
+
+// returns 0 when the index was not moved
+static uint32_t bc_relocate(const BcRelocation *relocs, size_t count, uint32_t from){
+	size_t lo = 0, hi = count;
+	while (lo != hi){
+		size_t mid = lo + (hi - lo)/2;
+		if (relocs[mid].from < from) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo != count && relocs[lo].from == from ? relocs[lo].to : 0;
+}
+
+static bool bc_is_jump(enum BcType type){
+	return type == BC_Jump || type == BC_JumpIfZero || type == BC_JumpIfNotZero;
+}
+
+// indexes of the procedures are replaced by indexes of their copies, calls
+// between the given procedures go to the copies
+static void bc_linearize(CompilerContext *ctx, uint32_t *procs, size_t proc_count){
+	uint32_t max_size = 0;
+	for (size_t p=0; p!=proc_count; p+=1){
+		max_size = util_max_u64(max_size, bc_proc_header(ctx, procs[p])->body_size);
+	}
+	BcRelocation *relocs = malloc(max_size*sizeof(BcRelocation) + 1);
+	BcRelocation *proc_relocs = malloc(proc_count*sizeof(BcRelocation) + 1);
+	assert(relocs != NULL && proc_relocs != NULL && "allocation failrule");
+
+	for (size_t p=0; p!=proc_count; p+=1){
+		BcProcHeader header = *bc_proc_header(ctx, procs[p]);
+		assert(!header.is_linear && "procedure is already linear");
+		uint32_t index = ctx->bc_size;
+		assert(index + 1 + header.body_size < BC_BUFFER_CAPACITY && "bytecode buffer overflow");
+		header.is_linear = true;
+		*bc_proc_header(ctx, index) = header;
+
+		size_t count = 0;
+		uint32_t dst = index + 1;
+		for (uint32_t i=procs[p]+1; header.body_size != 0 && i != 0; i=ctx->bc[i].inext){
+			uint32_t size = 1 + BcOperandCounts[ctx->bc[i].type];
+			memcpy(ctx->bc + dst, ctx->bc + i, size*sizeof(BcNode));
+			ctx->bc[dst].inext = size;
+			relocs[count] = (BcRelocation){ .from = i, .to = dst };
+			count += 1;
+			dst += size;
+		}
+		assert(dst == index + 1 + header.body_size && "procedure body is broken");
+
+		qsort(relocs, count, sizeof(BcRelocation), bc_relocation_cmp);
+		for (size_t i=0; i!=count; i+=1){
+			BcNode *node = ctx->bc + relocs[i].to;
+			if (!bc_is_jump(node->type)) continue;
+			uint32_t target = bc_relocate(relocs, count, node[1].data.u64);
+			assert(target != 0 && "jump target is outside of the procedure");
+			node[1].data.i64 = (int64_t)target - relocs[i].to;
+		}
+		ctx->bc_size = dst;
+		memory_track(MemTag_Bytecode, (dst - index)*sizeof(BcNode));
+		proc_relocs[p] = (BcRelocation){ .from = procs[p], .to = index };
+		procs[p] = index;
+	}
+
+	qsort(proc_relocs, proc_count, sizeof(BcRelocation), bc_relocation_cmp);
+	for (size_t p=0; p!=proc_count; p+=1){
+		const BcNode *end = ctx->bc + procs[p] + 1 + bc_proc_header(ctx, procs[p])->body_size;
+		for (BcNode *node=ctx->bc+procs[p]+1; node!=end; node=(BcNode *)bc_linear_next(node)){
+			if (node->type != BC_Call) continue;
+			uint32_t callee = bc_relocate(proc_relocs, proc_count, node[1].data.u64);
+			if (callee != 0) node[1].data.u64 = callee;
+		}
+	}
+	free(relocs);
+	free(proc_relocs);
+}
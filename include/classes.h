@@ -2,6 +2,12 @@
 
 #include "utils.h"
 #include "structs.h"
+#include "stats.h"
+#include "trace.h"
+#include "memtags.h"
+
+#include <stdlib.h>
+#include <sys/mman.h>
 
 
 _Static_assert(sizeof(Class) == sizeof(BcNode));
@@ -12,15 +18,11 @@ _Static_assert(sizeof(Class) == sizeof(BcNode));
 #define ARG_COUNT_MAX TUPLE_SIZE_MAX
 
 
-// GLOBAL BYTECODE BUFFER
+// BYTECODE BUFFER
 #define BC_BUFFER_CAPACITY (1 << 27)
-BcNode *global_bc;
-size_t global_bc_size = 0;
-
-// initialize bytecode linked list
-BcNode global_bc_head;
-BcNode *global_bc_last = &global_bc_head;
 
+// for now just make it big
+#define CLASS_INFO_CAPACITY (1 << 24)
 
 
 
@@ -54,29 +56,167 @@ struct GlobalNameData{
 };
 
 
-static struct GlobalNameSet  global_name_set;
-static struct GlobalNameData global_names;
 
-static size_t hash_colissions = 0; 
+// CLASS INFO DATA
+struct ClassInfoArray{
+	ClassInfoHeader *data;
+	size_t size     : 32;
+	size_t capacity : 32;
+	struct ClassInfoArray *next;
+};
+
+struct ArrayClassEntry{
+	uint64_t hash;
+	Class clas; // id = 0 means empty slot
+};
+
+struct ArrayClassSet{
+	struct ArrayClassEntry *data;
+	size_t size     : 32;
+	size_t capacity : 32;
+};
+
+struct TupleClassEntry{
+	uint64_t hash;
+	Class clas; // id = 0 means empty slot
+};
+
+struct TupleClassSet{
+	struct TupleClassEntry *data;
+	size_t size     : 32;
+	size_t capacity : 32;
+};
+
+struct InstanceEntry{
+	uint64_t hash;
+	InstanceInfo *instance; // NULL means empty slot
+};
+
+// records of hash sets are allocated from blocks that are never moved, so
+// pointers to them stay valid when the sets grow
+struct DataBlock{
+	struct DataBlock *next;
+	size_t size;
+	size_t capacity;
+	Data   data[];
+};
+
+struct InstanceSet{
+	struct InstanceEntry *data;
+	size_t size     : 32;
+	size_t capacity : 32;
+	struct DataBlock *blocks;
+};
+
+struct CallEntry{
+	uint64_t hash;
+	CallResolution *resolution; // NULL means empty slot
+};
+
+struct CallCache{
+	struct CallEntry *data;
+	size_t size     : 32;
+	size_t capacity : 32;
+	struct DataBlock *blocks;
+
+	size_t hits;
+	size_t misses;
+	size_t uncached; // calls with too many arguments or infers to be cached
+};
+
+struct EvalEntry{
+	uint64_t hash;
+	EvalRecord *record; // NULL means empty slot
+};
+
+struct EvalMemo{
+	struct EvalEntry *data;
+	size_t size     : 32;
+	size_t capacity : 32;
+	struct DataBlock *blocks;
+
+	size_t hits;
+	size_t misses;
+	size_t uncached; // evaluations that depend on too many infers or fail
+	bool   disabled; // every evaluation is done from scratch, for measuring
+};
+
+
+
+// COMPILER CONTEXT
+// holds all the state of a single compilation, contexts are independent
+// of each other, so each thread can run its own compilation
+typedef struct CompilerContext{
+	// bytecode buffer
+	BcNode *bc;
+	size_t  bc_size;
+
+	// bytecode linked list, bc_last points to bc_head when the list is empty,
+	// so the context must not be moved after initialization
+	BcNode  bc_head;
+	BcNode *bc_last;
+
+	struct ClassInfoArray classes;
 
-static NameId get_name_id(const char *str, uint8_t length){
-	assert(util_is_power2_u32(global_name_set.capacity));
+	struct GlobalNameSet  name_set;
+	struct GlobalNameData names;
+	struct ArrayClassSet  array_set;
+	struct TupleClassSet  tuple_set;
+	struct InstanceSet    instance_set;
+	struct CallCache      call_cache;
+	struct EvalMemo       eval_memo;
+
+	size_t hash_colissions;
+
+	// set when the context was loaded from a snapshot, tables that still point
+	// into the image are released together with it
+	struct{
+		uint8_t *data;
+		size_t   size;
+	} image;
+} CompilerContext;
+
+
+// tables loaded from a snapshot are accounted like allocated ones
+static void *context_alloc_table(enum MemTag tag, size_t bytes){
+	void *table = calloc(bytes, 1);
+	if (table != NULL) memory_track(tag, bytes);
+	return table;
+}
+
+static void context_free_table(
+	const CompilerContext *ctx, enum MemTag tag, void *table, size_t bytes
+){
+	memory_track(tag, -(int64_t)bytes);
+	uint8_t *ptr = table;
+	if (ctx->image.data <= ptr && ptr < ctx->image.data + ctx->image.size) return;
+	free(table);
+}
+
+
+
+static NameId get_name_id(CompilerContext *ctx, const char *str, uint8_t length){
+	assert(util_is_power2_u32(ctx->name_set.capacity));
 	assert(length != 0 && length <= 255);
 
-	struct GlobalNameSet  name_set = global_name_set;
-	struct GlobalNameData names    = global_names;
+	struct GlobalNameSet  name_set = ctx->name_set;
+	struct GlobalNameData names    = ctx->names;
 
 	uint64_t hash = name_hash(str, length);
 	size_t index_mask = name_set.capacity - 1;
 	size_t index = hash & index_mask;
 	for (size_t i=0;; i+=1){
 		struct NameEntry entry = name_set.data[index];
-		if (entry.length == 0) break; // name not found
+		if (entry.length == 0){ // name not found
+			STATS_PROBE(StatsTable_Names, i+1);
+			break;
+		}
 		if (entry.hash == hash && entry.length == length){
 			if (memcmp(names.data + entry.name_id, str, length) == 0){
+				STATS_PROBE(StatsTable_Names, i+1);
 				return entry.name_id;
 			}
-			hash_colissions += 1;
+			ctx->hash_colissions += 1;
 		}
 		index = (index + i + 1) & index_mask;
 	}
@@ -85,18 +225,19 @@ static NameId get_name_id(const char *str, uint8_t length){
 	NameId result = names.size + 1;
 	size_t new_names_size = names.size + length + 1;
 	if (new_names_size > names.capacity){
+		STATS_NAME_DATA_RESIZE();
 		size_t   new_names_capacity = 2*names.capacity;
-		uint8_t *new_names_data = malloc(new_names_capacity);
+		uint8_t *new_names_data = context_alloc_table(MemTag_Names, new_names_capacity);
 		assert(new_names_data != NULL && "name allocation failrule");
 		memcpy(new_names_data, names.data, names.size);
-		free(names.data);
+		context_free_table(ctx, MemTag_Names, names.data, names.capacity);
 		names.data     = new_names_data;
 		names.capacity = new_names_capacity;
-		global_names = names;
+		ctx->names = names;
 	}
 	names.data[names.size] = length;
 	memcpy(names.data+names.size+1, str, length);
-	global_names.size = new_names_size;
+	ctx->names.size = new_names_size;
 	
 	// add new entry to set
 	name_set.data[index] = (struct NameEntry){
@@ -105,16 +246,19 @@ static NameId get_name_id(const char *str, uint8_t length){
 		.length  = length
 	};
 	name_set.size += 1;
-	global_name_set.size = name_set.size;
+	ctx->name_set.size = name_set.size;
 	
 	UNLIKELY if (4*name_set.size >= 3*name_set.capacity){
 		// resize hash table
+		TraceSpan resize_span = trace_begin("resize name_set");
+		STATS_RESIZE(StatsTable_Names);
 		size_t new_hs_capacity = 2*name_set.capacity;
-		struct NameEntry *new_hs_data = malloc(new_hs_capacity*sizeof(struct NameEntry));
+		struct NameEntry *new_hs_data = context_alloc_table(
+			MemTag_NameSet, new_hs_capacity*sizeof(struct NameEntry)
+		);
 		if (new_hs_data == NULL){
 			assert(false && "name allocation failrule");
 		}
-		memset(new_hs_data, 0, new_hs_capacity*sizeof(struct NameEntry));
 		// reindex old hash table
 		size_t elem_index_mask = new_hs_capacity - 1;
 		for (size_t i=0; i!=name_set.capacity; i+=1){
@@ -129,13 +273,32 @@ static NameId get_name_id(const char *str, uint8_t length){
 				new_hs_data[elem_index] = old_set_entry;
 			}
 		}
-		free(name_set.data);
-		global_name_set.data     = new_hs_data;
-		global_name_set.capacity = new_hs_capacity;
+		context_free_table(
+			ctx, MemTag_NameSet, name_set.data, name_set.capacity*sizeof(struct NameEntry)
+		);
+		ctx->name_set.data     = new_hs_data;
+		ctx->name_set.capacity = new_hs_capacity;
+		trace_end(resize_span);
 	}
 	return result;
 }
 
+// looks up a name without adding it, returns 0 if the context never saw it
+static NameId find_name_id(const CompilerContext *ctx, const char *str, uint8_t length){
+	uint64_t hash = name_hash(str, length);
+	size_t index_mask = ctx->name_set.capacity - 1;
+	size_t index = hash & index_mask;
+	for (size_t i=0;; i+=1){
+		struct NameEntry entry = ctx->name_set.data[index];
+		if (entry.length == 0) return 0;
+		if (
+			entry.hash == hash && entry.length == length &&
+			memcmp(ctx->names.data + entry.name_id, str, length) == 0
+		) return entry.name_id;
+		index = (index + i + 1) & index_mask;
+	}
+}
+
 
 
 
@@ -167,90 +330,309 @@ static Class class_remove_prefix(Class cl){
 
 
 
-// CLASS INFO DATA
-struct ClassInfoArray{
-	ClassInfoHeader *data;
-	size_t size     : 32;
-	size_t capacity : 32;
-	struct ClassInfoArray *next;
-};
-
-struct ClassInfoArray global_classes;
-
-uint32_t global_classes_alloc(size_t size){
+// CLASS INFO ALLOCATION
+static uint32_t class_info_alloc(CompilerContext *ctx, size_t size){
 	size_t alloc_size = (size + sizeof(ClassInfoHeader) - 1) / sizeof(ClassInfoHeader);
-	size_t new_size = global_classes.size + alloc_size;
-	if (new_size > global_classes.capacity){
+	size_t new_size = ctx->classes.size + alloc_size;
+	if (new_size > ctx->classes.capacity){
 		assert(false && "class info array is out of memory");
 	}
-	size_t res = global_classes.size;
-	global_classes.size = new_size;
+	size_t res = ctx->classes.size;
+	ctx->classes.size = new_size;
+	memory_track(MemTag_Classes, alloc_size*sizeof(ClassInfoHeader));
 	return res;
 }
 
-static uint32_t get_bytesize(Class cl){
+static uint32_t get_bytesize(const CompilerContext *ctx, Class cl){
 	if (class_is_pointer(cl)) return PTR_SIZE;
 	if (class_is_span(cl)) return 2*PTR_SIZE;
 	if (cl.tag <= Class_Float) return cl.basic_size;
-	return global_classes.data[cl.idx].bytesize;
+	return ctx->classes.data[cl.idx].bytesize;
 }
 
-static uint8_t get_alignment(Class cl){
-	if (class_is_pointer(cl) | class_is_span(cl)) return PTR_SIZE;
+static uint8_t get_alignment(const CompilerContext *ctx, Class cl){
+	if (class_is_pointer(cl) | class_is_span(cl)) return PTR_ALIGNMENT;
 	if (cl.tag <= Class_Float) return cl.basic_alignment;
-	return global_classes.data[cl.idx].alignment;
+	return ctx->classes.data[cl.idx].alignment;
 }
 
 
 
-static StructClassInfo *struct_class_info(uint32_t index){
-	return (StructClassInfo *)(global_classes.data + index);
+static StructClassInfo *struct_class_info(const CompilerContext *ctx, uint32_t index){
+	return (StructClassInfo *)(ctx->classes.data + index);
+}
+
+// STRUCT FIELDS
+// classes of the fields are followed by their offsets, names and an index
+// from names to fields. the index is built once when the struct is completed,
+// it is an open addressing table of field index+1, kept at most half full.
+// small structs have no index, scanning their names is faster
+#define STRUCT_SCAN_MAX_FIELDS 8
+
+static uint32_t *struct_offsets(const StructClassInfo *info){
+	return (uint32_t *)(info->classes + info->field_count);
 }
 
-static EnumClassInfo *enum_class_info(uint32_t index){
-	return (EnumClassInfo *)(global_classes.data + index);
+static NameId *struct_field_names(const StructClassInfo *info){
+	return (NameId *)(struct_offsets(info) + info->field_count);
 }
 
+static uint16_t *struct_field_index(const StructClassInfo *info){
+	return (uint16_t *)(struct_field_names(info) + info->field_count);
+}
 
+static uint32_t struct_field_index_capacity(uint16_t field_count){
+	if (field_count <= STRUCT_SCAN_MAX_FIELDS) return 0;
+	return 1u << (32 - util_leading_zeros_u32(2u*field_count - 1u));
+}
 
+// size of the class info of a struct with the fields in bytes
+static size_t struct_class_info_size(uint16_t field_count){
+	return sizeof(StructClassInfo) + field_count*(sizeof(Class) + sizeof(uint32_t) + sizeof(NameId)) +
+		struct_field_index_capacity(field_count)*sizeof(uint16_t);
+}
 
+// sets offsets of the stored fields, which are the first ones, and the size
+// and alignment of the struct, returns how many bytes the layout saves
+// compared with the order of declaration. sizes are multiples of alignments,
+// so placing fields with bigger alignments first leaves padding only at the end
+static uint32_t layout_struct_class(const CompilerContext *ctx, StructClassInfo *info){
+	uint32_t *offsets = struct_offsets(info);
+	uint32_t declared_size = 0;
+	uint8_t max_alignment = 0;
+	for (uint32_t i=0; i!=info->stored_field_count; i+=1){
+		uint8_t alignment = get_alignment(ctx, info->classes[i]);
+		declared_size = util_alignsize(declared_size, 1<<alignment);
+		offsets[i] = declared_size;
+		declared_size += get_bytesize(ctx, info->classes[i]);
+		if (alignment > max_alignment) max_alignment = alignment;
+	}
+	declared_size = util_alignsize(declared_size, 1<<max_alignment);
+	info->bytesize = declared_size;
+	info->alignment = max_alignment;
+	if (info->layout != StructLayout_Compact) return 0;
+
+	// fields of the same alignment stay in the order of declaration
+	uint32_t bytesize = 0;
+	for (uint32_t a=max_alignment+1; a!=0; a-=1){
+		for (uint32_t i=0; i!=info->stored_field_count; i+=1){
+			if (get_alignment(ctx, info->classes[i]) != a-1) continue;
+			offsets[i] = bytesize;
+			bytesize += get_bytesize(ctx, info->classes[i]);
+		}
+	}
+	info->bytesize = util_alignsize(bytesize, 1<<max_alignment);
+	return declared_size - info->bytesize;
+}
 
-// ARRAY HASH TABLE
-static ArrayClassInfo *array_class_info(uint32_t index){
-	return (ArrayClassInfo *)(global_classes.data + index);
+// prints the size of the struct and the bytes its layout saves
+static void print_struct_layout(FILE *out, const StructClassInfo *info, uint32_t saved){
+	const char *name = info->name != NULL ? info->name : "<anonymous>";
+	int name_length = info->name != NULL ? info->name_length : 11;
+	uint32_t declared = info->bytesize + saved;
+	fprintf(out,
+		"%.*s: %u bytes, %u fields, %s layout, saved %u of %u bytes (%.1lf%%)\n",
+		name_length, name, (uint32_t)info->bytesize, info->stored_field_count,
+		info->layout == StructLayout_Compact ? "compact" : "declared", saved, declared,
+		declared != 0 ? 100.0*(double)saved/(double)declared : 0.0
+	);
 }
 
-static uint64_t array_class_hash(Class cl, uint32_t size){
-	return class_hash(cl) ^ (size * 9);
+// fibonacci hashing like in the scope index, name ids of the same length are
+// arithmetic sequences. used by indexes of struct fields and enum elements
+static uint32_t name_index_hash(NameId name_id, uint32_t capacity){
+	uint32_t shift = 64 - util_trailing_zeros_u32(capacity);
+	return (uint32_t)(((uint64_t)name_id * 0x9E3779B97F4A7C15ull) >> shift);
 }
 
-struct ArrayClassEntry{
-	uint64_t hash;
-	Class clas; // id = 0 means empty slot
-};
+// builds the index of field names, all the fields must be set
+static void complete_struct_class(StructClassInfo *info){
+	uint32_t capacity = struct_field_index_capacity(info->field_count);
+	if (capacity == 0) return;
+	const NameId *names = struct_field_names(info);
+	uint16_t *index = struct_field_index(info);
+	memset(index, 0, capacity*sizeof(uint16_t));
+	uint32_t mask = capacity - 1;
+	for (uint32_t i=0; i!=info->field_count; i+=1){
+		uint32_t slot = name_index_hash(names[i], capacity);
+		for (uint32_t j=0; index[slot] != 0; j+=1) slot = (slot + j + 1) & mask;
+		index[slot] = i + 1;
+	}
+}
 
-struct ArrayClassSet{
-	struct ArrayClassEntry *data;
-	size_t size     : 32;
-	size_t capacity : 32;
-};
+// returns index of the field with the name or -1
+static int32_t find_struct_field(const StructClassInfo *info, NameId name_id){
+	const NameId *names = struct_field_names(info);
+	uint32_t capacity = struct_field_index_capacity(info->field_count);
+	if (capacity == 0){
+		for (uint32_t i=0; i!=info->field_count; i+=1){
+			if (names[i] == name_id) return i;
+		}
+		return -1;
+	}
+	const uint16_t *index = struct_field_index(info);
+	uint32_t mask = capacity - 1;
+	uint32_t slot = name_index_hash(name_id, capacity);
+	for (uint32_t i=0;; i+=1){
+		uint32_t field = index[slot];
+		if (field == 0){
+			STATS_PROBE(StatsTable_Fields, i+1);
+			return -1;
+		}
+		if (names[field-1] == name_id){
+			STATS_PROBE(StatsTable_Fields, i+1);
+			return field - 1;
+		}
+		slot = (slot + i + 1) & mask;
+	}
+}
 
-struct ArrayClassSet global_array_set;
+static EnumClassInfo *enum_class_info(const CompilerContext *ctx, uint32_t index){
+	return (EnumClassInfo *)(ctx->classes.data + index);
+}
+
+// ENUM ELEMENTS
+// names and values of the elements are followed by an index from names to
+// elements like the one of struct fields and, when the values are dense, a
+// map from values to elements for printing them. both hold element index+1
+#define ENUM_SCAN_MAX_ELEMS 8
+#define ENUM_VALUE_MAP_SLACK 4 // at most this many map slots per element
+
+static uint8_t *enum_values(const EnumClassInfo *info){
+	return (uint8_t *)(info->names + info->elem_count);
+}
+
+static uint32_t enum_name_index_capacity(uint16_t elem_count){
+	if (elem_count <= ENUM_SCAN_MAX_ELEMS) return 0;
+	return 1u << (32 - util_leading_zeros_u32(2u*elem_count - 1u));
+}
+
+// values from 0 to max_value have slots if there are not too many of them
+static uint32_t enum_value_map_size(uint16_t elem_count, uint64_t max_value){
+	if (max_value >= ENUM_VALUE_MAP_SLACK*(uint64_t)elem_count + 16) return 0;
+	return max_value + 1;
+}
 
-static Class get_array_class(Class cl, uint32_t size){
-	assert(util_is_power2_u32(global_array_set.capacity));
+static uint16_t *enum_name_index(const EnumClassInfo *info){
+	size_t values_size = util_alignsize(info->elem_count*info->basic_size, sizeof(uint16_t));
+	return (uint16_t *)(enum_values(info) + values_size);
+}
+
+static uint16_t *enum_value_map(const EnumClassInfo *info){
+	return enum_name_index(info) + enum_name_index_capacity(info->elem_count);
+}
+
+// size of the class info of an enum in bytes
+static size_t enum_class_info_size(uint16_t elem_count, uint16_t basic_size, uint64_t max_value){
+	return sizeof(EnumClassInfo) + elem_count*sizeof(NameId) +
+		util_alignsize(elem_count*basic_size, sizeof(uint16_t)) + sizeof(uint16_t)*(
+			enum_name_index_capacity(elem_count) + enum_value_map_size(elem_count, max_value)
+		);
+}
 
-	struct ArrayClassSet array_set = global_array_set;
+static uint64_t enum_element_value(const EnumClassInfo *info, uint32_t elem){
+	uint64_t value = 0;
+	memcpy(&value, enum_values(info) + elem*info->basic_size, info->basic_size);
+	return value;
+}
+
+// builds the name index and the value map, all the elements must be set
+static void complete_enum_class(EnumClassInfo *info){
+	uint32_t capacity = enum_name_index_capacity(info->elem_count);
+	if (capacity != 0){
+		uint16_t *index = enum_name_index(info);
+		memset(index, 0, capacity*sizeof(uint16_t));
+		uint32_t mask = capacity - 1;
+		for (uint32_t i=0; i!=info->elem_count; i+=1){
+			uint32_t slot = name_index_hash(info->names[i], capacity);
+			for (uint32_t j=0; index[slot] != 0; j+=1) slot = (slot + j + 1) & mask;
+			index[slot] = i + 1;
+		}
+	}
+
+	uint32_t map_size = enum_value_map_size(info->elem_count, info->max_value);
+	if (map_size != 0){
+		uint16_t *map = enum_value_map(info);
+		memset(map, 0, map_size*sizeof(uint16_t));
+		for (uint32_t i=0; i!=info->elem_count; i+=1){
+			uint64_t value = enum_element_value(info, i);
+			// elements with the same value print as the first one
+			if (value < map_size && map[value] == 0) map[value] = i + 1;
+		}
+	}
+}
+
+// returns index of the element with the name or -1
+static int32_t find_enum_element(const EnumClassInfo *info, NameId name_id){
+	uint32_t capacity = enum_name_index_capacity(info->elem_count);
+	if (capacity == 0){
+		for (uint32_t i=0; i!=info->elem_count; i+=1){
+			if (info->names[i] == name_id) return i;
+		}
+		return -1;
+	}
+	const uint16_t *index = enum_name_index(info);
+	uint32_t mask = capacity - 1;
+	uint32_t slot = name_index_hash(name_id, capacity);
+	for (uint32_t i=0;; i+=1){
+		uint32_t elem = index[slot];
+		if (elem == 0){
+			STATS_PROBE(StatsTable_EnumNames, i+1);
+			return -1;
+		}
+		if (info->names[elem-1] == name_id){
+			STATS_PROBE(StatsTable_EnumNames, i+1);
+			return elem - 1;
+		}
+		slot = (slot + i + 1) & mask;
+	}
+}
+
+// returns name of the first element with the value or 0
+static NameId enum_value_name(const EnumClassInfo *info, uint64_t value){
+	uint32_t map_size = enum_value_map_size(info->elem_count, info->max_value);
+	if (map_size != 0){
+		if (value >= map_size) return 0;
+		uint32_t elem = enum_value_map(info)[value];
+		return elem == 0 ? 0 : info->names[elem-1];
+	}
+	for (uint32_t i=0; i!=info->elem_count; i+=1){
+		if (enum_element_value(info, i) == value) return info->names[i];
+	}
+	return 0;
+}
+
+
+
+
+
+// ARRAY HASH TABLE
+static ArrayClassInfo *array_class_info(const CompilerContext *ctx, uint32_t index){
+	return (ArrayClassInfo *)(ctx->classes.data + index);
+}
+
+static uint64_t array_class_hash(Class cl, uint32_t size){
+	return class_hash(cl) ^ (size * 9);
+}
+
+static Class get_array_class(CompilerContext *ctx, Class cl, uint32_t size){
+	assert(util_is_power2_u32(ctx->array_set.capacity));
+
+	struct ArrayClassSet array_set = ctx->array_set;
 
 	uint64_t hash = array_class_hash(cl, size);
 	size_t index_mask = array_set.capacity - 1;
 	size_t index = hash & index_mask;
 	for (size_t i=0;; i+=1){
 		struct ArrayClassEntry entry = array_set.data[index];
-		if (entry.clas.id == 0) break; // name not found
+		if (entry.clas.id == 0){ // name not found
+			STATS_PROBE(StatsTable_Arrays, i+1);
+			break;
+		}
 		if (entry.hash == hash){
-			const ArrayClassInfo *info = array_class_info(entry.clas.idx);
+			const ArrayClassInfo *info = array_class_info(ctx, entry.clas.idx);
 			if (size == info->size && cl.id == info->arg_class.id){
+				STATS_PROBE(StatsTable_Arrays, i+1);
 				return entry.clas;
 			}
 		}
@@ -258,38 +640,42 @@ static Class get_array_class(Class cl, uint32_t size){
 	}
 	
 	// add new entry's data
+	TraceSpan span = trace_begin("intern array class");
 	uint32_t stag = size & ARRAY_SIZE_TAG_MASK;
 	Class res = {
 		.tag = Class_Array,
 		.infered = cl.infered || stag==ARRAY_SIZE_TAG_INFERED,
 		.evaled  = cl.evaled || stag==ARRAY_SIZE_TAG_VARIABLE || stag==ARRAY_SIZE_TAG_EXPR,
-		.idx = global_classes_alloc(sizeof(ArrayClassInfo))
+		.idx = class_info_alloc(ctx, sizeof(ArrayClassInfo))
 	};
-	ArrayClassInfo *res_info = array_class_info(res.idx);
+	ArrayClassInfo *res_info = array_class_info(ctx, res.idx);
 	
 	*res_info = (ArrayClassInfo){
 		.size      = size,
 		.arg_class = cl
 	};
 	if (!res.infered && !res.evaled){
-		res_info->bytesize  = size * get_bytesize(cl);
-		res_info->alignment = get_alignment(cl);
+		res_info->bytesize  = size * get_bytesize(ctx, cl);
+		res_info->alignment = get_alignment(ctx, cl);
 	}
 
 	// add new entry to set
 	array_set.data[index] = (struct ArrayClassEntry){ .hash = hash, .clas = res };
 	array_set.size += 1;
-	global_array_set.size = array_set.size;
+	ctx->array_set.size = array_set.size;
+	trace_end(span);
 	
 	UNLIKELY if (4*array_set.size >= 3*array_set.capacity){
 		// resize hash table
+		TraceSpan resize_span = trace_begin("resize array_set");
+		STATS_RESIZE(StatsTable_Arrays);
 		size_t new_hs_capacity = 2*array_set.capacity;
-		size_t entry_bytesize = new_hs_capacity*sizeof(struct ArrayClassEntry);
-		struct ArrayClassEntry *new_hs_data = malloc(entry_bytesize);
+		struct ArrayClassEntry *new_hs_data = context_alloc_table(
+			MemTag_ArraySet, new_hs_capacity*sizeof(struct ArrayClassEntry)
+		);
 		if (new_hs_data == NULL){
 			assert(false && "name allocation failrule");
 		}
-		memset(new_hs_data, 0, entry_bytesize);
 		// reindex old hash table
 		size_t elem_index_mask = new_hs_capacity - 1;
 		for (size_t i=0; i!=array_set.capacity; i+=1){
@@ -304,9 +690,12 @@ static Class get_array_class(Class cl, uint32_t size){
 				new_hs_data[elem_index] = old_set_entry;
 			}
 		}
-		free(array_set.data);
-		global_array_set.data     = new_hs_data;
-		global_array_set.capacity = new_hs_capacity;
+		context_free_table(
+			ctx, MemTag_ArraySet, array_set.data, array_set.capacity*sizeof(struct ArrayClassEntry)
+		);
+		ctx->array_set.data     = new_hs_data;
+		ctx->array_set.capacity = new_hs_capacity;
+		trace_end(resize_span);
 	}
 	return res;
 }
@@ -316,8 +705,8 @@ static Class get_array_class(Class cl, uint32_t size){
 
 
 // TUPLE HASH TABLE
-static TupleClassInfo *tuple_class_info(uint32_t index){
-	return (TupleClassInfo *)(global_classes.data + index);
+static TupleClassInfo *tuple_class_info(const CompilerContext *ctx, uint32_t index){
+	return (TupleClassInfo *)(ctx->classes.data + index);
 }
 
 static uint64_t tuple_class_hash(const Class *cls, size_t cls_size){
@@ -328,50 +717,44 @@ static uint64_t tuple_class_hash(const Class *cls, size_t cls_size){
 static uint64_t tuple_class_equals(
 	const Class *cls, size_t cls_size, const TupleClassInfo *info
 ){
-	if (cls_size == info->size) return false;
+	if (cls_size != info->size) return false;
 	for (size_t i=0; i!=cls_size; i+=1){
 		if (cls[i].id != info->classes[i].id) return false;
 	}
 	return true;
 }
 
-struct TupleClassEntry{
-	uint64_t hash;
-	Class clas; // id = 0 means empty slot
-};
+static Class get_tuple_class(CompilerContext *ctx, const Class *cls, size_t cls_size){
+	assert(util_is_power2_u32(ctx->tuple_set.capacity));
 
-struct TupleClassSet{
-	struct TupleClassEntry *data;
-	size_t size     : 32;
-	size_t capacity : 32;
-};
-
-struct TupleClassSet global_tuple_set;
-
-static Class get_tuple_class(const Class *cls, size_t cls_size){
-	assert(util_is_power2_u32(global_tuple_set.capacity));
-
-	struct TupleClassSet tuple_set = global_tuple_set;
+	struct TupleClassSet tuple_set = ctx->tuple_set;
 
 	uint64_t hash = tuple_class_hash(cls, cls_size);
 	size_t index_mask = tuple_set.capacity - 1;
 	size_t index = hash & index_mask;
 	for (size_t i=0;; i+=1){
 		struct TupleClassEntry entry = tuple_set.data[index];
-		if (entry.clas.id == 0) break; // name not found
+		if (entry.clas.id == 0){ // name not found
+			STATS_PROBE(StatsTable_Tuples, i+1);
+			break;
+		}
 		if (entry.hash == hash){
-			const TupleClassInfo *info = tuple_class_info(entry.clas.idx);
-			if (tuple_class_equals(cls, cls_size, info)) return entry.clas;
+			const TupleClassInfo *info = tuple_class_info(ctx, entry.clas.idx);
+			if (tuple_class_equals(cls, cls_size, info)){
+				STATS_PROBE(StatsTable_Tuples, i+1);
+				return entry.clas;
+			}
 		}
 		index = (index + i + 1) & index_mask;
 	}
 	
 	// add new entry's data
+	TraceSpan span = trace_begin("intern tuple class");
 	Class res = {
 		.tag = Class_Tuple,
-		.idx = global_classes_alloc(sizeof(TupleClassInfo) + cls_size*sizeof(Class))
+		.idx = class_info_alloc(ctx, sizeof(TupleClassInfo) + cls_size*sizeof(Class))
 	};
-	TupleClassInfo *res_info = tuple_class_info(res.idx);
+	TupleClassInfo *res_info = tuple_class_info(ctx, res.idx);
 	
 	Class *res_classes = res_info->classes;
 	uint32_t *res_offsets = (uint32_t *)(res_info->classes + cls_size);
@@ -383,11 +766,11 @@ static Class get_tuple_class(const Class *cls, size_t cls_size){
 		res.infered |= cls[i].infered;
 		res.evaled  |= cls[i].evaled;
 		if (!res.infered && !res.evaled){
-			uint8_t arg_alignment = get_alignment(cls[i]);
+			uint8_t arg_alignment = get_alignment(ctx, cls[i]);
 			bytesize = util_alignsize(bytesize, 1<<arg_alignment);
 			res_offsets[i] = bytesize;
 			if (arg_alignment > max_alignment){ max_alignment = arg_alignment; }
-			bytesize += get_bytesize(cls[i]);
+			bytesize += get_bytesize(ctx, cls[i]);
 		}
 	}
 	*res_info = (TupleClassInfo){
@@ -399,17 +782,20 @@ static Class get_tuple_class(const Class *cls, size_t cls_size){
 	// add new entry to set
 	tuple_set.data[index] = (struct TupleClassEntry){ .hash = hash, .clas = res };
 	tuple_set.size += 1;
-	global_tuple_set.size = tuple_set.size;
+	ctx->tuple_set.size = tuple_set.size;
+	trace_end(span);
 	
 	UNLIKELY if (4*tuple_set.size >= 3*tuple_set.capacity){
 		// resize hash table
+		TraceSpan resize_span = trace_begin("resize tuple_set");
+		STATS_RESIZE(StatsTable_Tuples);
 		size_t new_hs_capacity = 2*tuple_set.capacity;
-		size_t entry_bytesize = new_hs_capacity*sizeof(struct TupleClassEntry);
-		struct TupleClassEntry *new_hs_data = malloc(entry_bytesize);
+		struct TupleClassEntry *new_hs_data = context_alloc_table(
+			MemTag_TupleSet, new_hs_capacity*sizeof(struct TupleClassEntry)
+		);
 		if (new_hs_data == NULL){
 			assert(false && "name allocation failrule");
 		}
-		memset(new_hs_data, 0, entry_bytesize);
 		// reindex old hash table
 		size_t elem_index_mask = new_hs_capacity - 1;
 		for (size_t i=0; i!=tuple_set.capacity; i+=1){
@@ -424,9 +810,12 @@ static Class get_tuple_class(const Class *cls, size_t cls_size){
 				new_hs_data[elem_index] = old_set_entry;
 			}
 		}
-		free(tuple_set.data);
-		global_tuple_set.data     = new_hs_data;
-		global_tuple_set.capacity = new_hs_capacity;
+		context_free_table(
+			ctx, MemTag_TupleSet, tuple_set.data, tuple_set.capacity*sizeof(struct TupleClassEntry)
+		);
+		ctx->tuple_set.data     = new_hs_data;
+		ctx->tuple_set.capacity = new_hs_capacity;
+		trace_end(resize_span);
 	}
 	return res;
 }
@@ -434,56 +823,731 @@ static Class get_tuple_class(const Class *cls, size_t cls_size){
 
 
 // PROCEDURE HALPER PROCEDURES
-static ProcedureClassInfo *procedure_class_info(uint32_t index){
-	return (ProcedureClassInfo *)(global_classes.data + index);
+static ProcedureClassInfo *procedure_class_info(const CompilerContext *ctx, uint32_t index){
+	return (ProcedureClassInfo *)(ctx->classes.data + index);
+}
+
+
+
+// KEYS OF DATA
+// hash sets keyed by arrays of Data keep their records in blocks
+#define DATA_BLOCK_CAPACITY 4096 // in Data units
+
+// keys are mostly small integers and class ids, that differ only in a few
+// bits, the splitmix64 finalizer spreads them over the low bits used as index
+static uint64_t data_hash(uint64_t seed, const Data *data, size_t data_size){
+	uint64_t hash = 0x9E3779B97F4A7C15ull * (seed + 1);
+	for (size_t i=0; i!=data_size; i+=1){
+		hash = (hash ^ data[i].u64) * 0x9E3779B97F4A7C15ull;
+		hash ^= hash >> 32;
+	}
+	hash ^= hash >> 30;
+	hash *= 0xBF58476D1CE4E5B9ull;
+	hash ^= hash >> 27;
+	hash *= 0x94D049BB133111EBull;
+	return hash ^ (hash >> 31);
+}
+
+static Data *data_block_alloc(struct DataBlock **blocks, enum MemTag tag, size_t size){
+	struct DataBlock *block = *blocks;
+	if (block == NULL || block->size + size > block->capacity){
+		size_t capacity = util_max_usize(DATA_BLOCK_CAPACITY, size);
+		block = malloc(sizeof(struct DataBlock) + capacity*sizeof(Data));
+		assert(block != NULL && "block allocation failrule");
+		memory_track(tag, sizeof(struct DataBlock) + capacity*sizeof(Data));
+		block->next = *blocks;
+		block->size = 0;
+		block->capacity = capacity;
+		*blocks = block;
+	}
+	Data *res = block->data + block->size;
+	block->size += size;
+	return res;
+}
+
+static void data_blocks_free(struct DataBlock *blocks, enum MemTag tag){
+	while (blocks != NULL){
+		struct DataBlock *next = blocks->next;
+		memory_track(tag, -(int64_t)(sizeof(struct DataBlock) + blocks->capacity*sizeof(Data)));
+		free(blocks);
+		blocks = next;
+	}
+}
+
+
+
+// INSTANCE HASH TABLE
+// generic procedures share one set, the full 64 bit hash is kept in every
+// entry, so keys are compared only when the hashes are equal
+
+// returns the instance of the procedure for the key, a new instance has
+// bc_index set to UINT32_MAX
+static InstanceInfo *get_instance(
+	CompilerContext *ctx, uint32_t proc_idx, const Data *data, uint16_t data_size, bool *created
+){
+	assert(util_is_power2_u32(ctx->instance_set.capacity));
+
+	struct InstanceSet instance_set = ctx->instance_set;
+
+	uint64_t hash = data_hash(proc_idx, data, data_size);
+	size_t index_mask = instance_set.capacity - 1;
+	size_t index = hash & index_mask;
+	for (size_t i=0;; i+=1){
+		struct InstanceEntry entry = instance_set.data[index];
+		if (entry.instance == NULL){
+			STATS_PROBE(StatsTable_Instances, i+1);
+			break;
+		}
+		if (entry.hash == hash){
+			const InstanceInfo *info = entry.instance;
+			if (
+				info->proc_idx == proc_idx && info->data_size == data_size &&
+				memcmp(info->data, data, data_size*sizeof(Data)) == 0
+			){
+				STATS_PROBE(StatsTable_Instances, i+1);
+				*created = false;
+				return entry.instance;
+			}
+			ctx->hash_colissions += 1;
+		}
+		index = (index + i + 1) & index_mask;
+	}
+
+	InstanceInfo *res = (InstanceInfo *)data_block_alloc(
+		&ctx->instance_set.blocks, MemTag_Instances,
+		(sizeof(InstanceInfo) + sizeof(Data) - 1)/sizeof(Data) + data_size
+	);
+	res->hash = hash;
+	res->proc_idx = proc_idx;
+	res->bc_index = UINT32_MAX;
+	res->data_size = data_size;
+	memcpy(res->data, data, data_size*sizeof(Data));
+	*created = true;
+
+	instance_set.data[index] = (struct InstanceEntry){ .hash = hash, .instance = res };
+	instance_set.size += 1;
+	ctx->instance_set.size = instance_set.size;
+
+	UNLIKELY if (4*instance_set.size >= 3*instance_set.capacity){
+		// resize hash table, only the entries move
+		TraceSpan resize_span = trace_begin("resize instance_set");
+		STATS_RESIZE(StatsTable_Instances);
+		size_t new_hs_capacity = 2*instance_set.capacity;
+		struct InstanceEntry *new_hs_data = context_alloc_table(
+			MemTag_Instances, new_hs_capacity*sizeof(struct InstanceEntry)
+		);
+		if (new_hs_data == NULL){
+			assert(false && "instance allocation failrule");
+		}
+		// reindex old hash table
+		size_t elem_index_mask = new_hs_capacity - 1;
+		for (size_t i=0; i!=instance_set.capacity; i+=1){
+			struct InstanceEntry old_set_entry = instance_set.data[i];
+			if (old_set_entry.instance != NULL){
+				size_t elem_index = old_set_entry.hash & elem_index_mask;
+				for (size_t i=0;; i+=1){
+					struct InstanceEntry entry = new_hs_data[elem_index];
+					if (entry.instance == NULL) break; // add elem to new table
+					elem_index = (elem_index + i + 1) & elem_index_mask;
+				}
+				new_hs_data[elem_index] = old_set_entry;
+			}
+		}
+		context_free_table(
+			ctx, MemTag_Instances, instance_set.data,
+			instance_set.capacity*sizeof(struct InstanceEntry)
+		);
+		ctx->instance_set.data     = new_hs_data;
+		ctx->instance_set.capacity = new_hs_capacity;
+		trace_end(resize_span);
+	}
+	return res;
+}
+
+// empty set, instances are not kept in snapshots
+static void init_instance_set(CompilerContext *ctx){
+	ctx->instance_set.capacity = 64;
+	ctx->instance_set.size = 0;
+	ctx->instance_set.blocks = NULL;
+	ctx->instance_set.data = context_alloc_table(
+		MemTag_Instances, ctx->instance_set.capacity*sizeof(struct InstanceEntry)
+	);
+	assert(ctx->instance_set.data != NULL);
+}
+
+static void free_instance_set(CompilerContext *ctx){
+	context_free_table(
+		ctx, MemTag_Instances, ctx->instance_set.data,
+		ctx->instance_set.capacity*sizeof(struct InstanceEntry)
+	);
+	data_blocks_free(ctx->instance_set.blocks, MemTag_Instances);
 }
 
 
 
-// INITIALIZING GLOBAL VARIABLES
-static void initialize_compiler_globals(void){
-	// global bytecode buffer
-	global_bc = malloc(BC_BUFFER_CAPACITY*sizeof(BcNode));
-	assert(global_bc != NULL);
+// CALL RESOLUTION CACHE
+// a call is resolved once for every procedure, classes of the arguments and
+// mask of compile time arguments, later calls with the same key get their
+// target classes, infered classes and conversions without matching
+#define CALL_CACHE_MAX_ARGS 64 // bits of the masks
+
+static Class *call_targets(CallResolution *r){
+	return r->classes + r->arg_count;
+}
+
+static Class *call_infers(CallResolution *r){
+	return r->classes + 2*r->arg_count;
+}
+
+static uint8_t *call_conversions(CallResolution *r){
+	return (uint8_t *)(r->classes + 2*r->arg_count + r->infer_count);
+}
+
+// key is the mask of compile time arguments followed by classes of the
+// arguments, returns NULL and the empty slot for the key if it is not cached
+static CallResolution *find_call_resolution(
+	const CompilerContext *ctx, uint64_t hash, uint32_t proc_idx,
+	const Data *key, size_t arg_count, size_t *slot
+){
+	assert(util_is_power2_u32(ctx->call_cache.capacity));
+
+	size_t index_mask = ctx->call_cache.capacity - 1;
+	size_t index = hash & index_mask;
+	for (size_t i=0;; i+=1){
+		struct CallEntry entry = ctx->call_cache.data[index];
+		if (entry.resolution == NULL){
+			STATS_PROBE(StatsTable_Calls, i+1);
+			*slot = index;
+			return NULL;
+		}
+		const CallResolution *r = entry.resolution;
+		if (
+			entry.hash == hash && r->proc_idx == proc_idx && r->arg_count == arg_count &&
+			r->const_mask == key[0].u64 &&
+			memcmp(r->classes, key+1, arg_count*sizeof(Class)) == 0
+		){
+			STATS_PROBE(StatsTable_Calls, i+1);
+			return entry.resolution;
+		}
+		index = (index + i + 1) & index_mask;
+	}
+}
+
+static CallResolution *add_call_resolution(
+	CompilerContext *ctx, size_t slot, uint64_t hash, uint32_t proc_idx,
+	const Data *key, size_t arg_count, size_t infer_count
+){
+	size_t size = sizeof(CallResolution)/sizeof(Data) +
+		2*arg_count + infer_count + (arg_count + sizeof(Data) - 1)/sizeof(Data);
+	CallResolution *res = (CallResolution *)data_block_alloc(
+		&ctx->call_cache.blocks, MemTag_Calls, size
+	);
+	*res = (CallResolution){
+		.hash = hash, .proc_idx = proc_idx, .arg_count = arg_count,
+		.infer_count = infer_count, .const_mask = key[0].u64
+	};
+	memcpy(res->classes, key+1, arg_count*sizeof(Class));
+
+	struct CallCache call_cache = ctx->call_cache;
+	call_cache.data[slot] = (struct CallEntry){ .hash = hash, .resolution = res };
+	call_cache.size += 1;
+	ctx->call_cache.size = call_cache.size;
+
+	UNLIKELY if (4*call_cache.size >= 3*call_cache.capacity){
+		// resize hash table, only the entries move
+		TraceSpan resize_span = trace_begin("resize call_cache");
+		STATS_RESIZE(StatsTable_Calls);
+		size_t new_hs_capacity = 2*call_cache.capacity;
+		struct CallEntry *new_hs_data = context_alloc_table(
+			MemTag_Calls, new_hs_capacity*sizeof(struct CallEntry)
+		);
+		if (new_hs_data == NULL){
+			assert(false && "call cache allocation failrule");
+		}
+		// reindex old hash table
+		size_t elem_index_mask = new_hs_capacity - 1;
+		for (size_t i=0; i!=call_cache.capacity; i+=1){
+			struct CallEntry old_set_entry = call_cache.data[i];
+			if (old_set_entry.resolution != NULL){
+				size_t elem_index = old_set_entry.hash & elem_index_mask;
+				for (size_t i=0;; i+=1){
+					struct CallEntry entry = new_hs_data[elem_index];
+					if (entry.resolution == NULL) break; // add elem to new table
+					elem_index = (elem_index + i + 1) & elem_index_mask;
+				}
+				new_hs_data[elem_index] = old_set_entry;
+			}
+		}
+		context_free_table(
+			ctx, MemTag_Calls, call_cache.data, call_cache.capacity*sizeof(struct CallEntry)
+		);
+		ctx->call_cache.data     = new_hs_data;
+		ctx->call_cache.capacity = new_hs_capacity;
+		trace_end(resize_span);
+	}
+	return res;
+}
+
+// empty cache, resolutions are not kept in snapshots
+static void init_call_cache(CompilerContext *ctx){
+	ctx->call_cache = (struct CallCache){ .capacity = 64 };
+	ctx->call_cache.data = context_alloc_table(
+		MemTag_Calls, ctx->call_cache.capacity*sizeof(struct CallEntry)
+	);
+	assert(ctx->call_cache.data != NULL);
+}
+
+static void free_call_cache(CompilerContext *ctx){
+	context_free_table(
+		ctx, MemTag_Calls, ctx->call_cache.data,
+		ctx->call_cache.capacity*sizeof(struct CallEntry)
+	);
+	data_blocks_free(ctx->call_cache.blocks, MemTag_Calls);
+}
+
+
+
+// MEMO OF EVALUATED CLASSES
+// classes never change once they are interned, so a class that depends on
+// infers always evaluates to the same class for the same values of the infers
+// it refers to. the first evaluation of a class records which infers those
+// are, later evaluations are keyed by the class and the values of just these
+// infers. nothing is ever invalidated, records live as long as the context
+#define EVAL_MEMO_MAX_DEPS 16
+#define EVAL_MEMO_UNCACHED UINT64_MAX // dependencies of classes that are not memoized
+
+// seeds of the two kinds of records
+enum EvalMemoKind{
+	EvalMemoKind_Deps,  // class -> infers it depends on
+	EvalMemoKind_Class, // class and values of its infers -> evaluated class
+};
+
+// an infer is the dependency kind in the top byte and its index
+enum EvalDep{
+	EvalDep_ArgClass, // class of an argument
+	EvalDep_Class,    // class stored in a named infer
+	EvalDep_Size,     // array size stored in a named infer, its class and value
+};
+
+static Data *eval_record_value(EvalRecord *r){
+	return r->data + r->key_size;
+}
+
+static EvalRecord *find_eval_record(
+	const CompilerContext *ctx, uint64_t hash, const Data *key, size_t key_size, size_t *slot
+){
+	assert(util_is_power2_u32(ctx->eval_memo.capacity));
+
+	size_t index_mask = ctx->eval_memo.capacity - 1;
+	size_t index = hash & index_mask;
+	for (size_t i=0;; i+=1){
+		struct EvalEntry entry = ctx->eval_memo.data[index];
+		if (entry.record == NULL){
+			STATS_PROBE(StatsTable_EvalMemo, i+1);
+			*slot = index;
+			return NULL;
+		}
+		const EvalRecord *r = entry.record;
+		if (
+			entry.hash == hash && r->key_size == key_size &&
+			memcmp(r->data, key, key_size*sizeof(Data)) == 0
+		){
+			STATS_PROBE(StatsTable_EvalMemo, i+1);
+			return entry.record;
+		}
+		index = (index + i + 1) & index_mask;
+	}
+}
+
+static EvalRecord *add_eval_record(
+	CompilerContext *ctx, size_t slot, uint64_t hash,
+	const Data *key, size_t key_size, const Data *value, size_t value_size
+){
+	EvalRecord *res = (EvalRecord *)data_block_alloc(
+		&ctx->eval_memo.blocks, MemTag_EvalMemo,
+		sizeof(EvalRecord)/sizeof(Data) + key_size + value_size
+	);
+	*res = (EvalRecord){ .hash = hash, .key_size = key_size, .value_size = value_size };
+	memcpy(res->data, key, key_size*sizeof(Data));
+	memcpy(res->data + key_size, value, value_size*sizeof(Data));
+
+	struct EvalMemo eval_memo = ctx->eval_memo;
+	eval_memo.data[slot] = (struct EvalEntry){ .hash = hash, .record = res };
+	eval_memo.size += 1;
+	ctx->eval_memo.size = eval_memo.size;
+
+	UNLIKELY if (4*eval_memo.size >= 3*eval_memo.capacity){
+		// resize hash table, only the entries move
+		TraceSpan resize_span = trace_begin("resize eval_memo");
+		STATS_RESIZE(StatsTable_EvalMemo);
+		size_t new_hs_capacity = 2*eval_memo.capacity;
+		struct EvalEntry *new_hs_data = context_alloc_table(
+			MemTag_EvalMemo, new_hs_capacity*sizeof(struct EvalEntry)
+		);
+		if (new_hs_data == NULL){
+			assert(false && "eval memo allocation failrule");
+		}
+		// reindex old hash table
+		size_t elem_index_mask = new_hs_capacity - 1;
+		for (size_t i=0; i!=eval_memo.capacity; i+=1){
+			struct EvalEntry old_set_entry = eval_memo.data[i];
+			if (old_set_entry.record != NULL){
+				size_t elem_index = old_set_entry.hash & elem_index_mask;
+				for (size_t i=0;; i+=1){
+					struct EvalEntry entry = new_hs_data[elem_index];
+					if (entry.record == NULL) break; // add elem to new table
+					elem_index = (elem_index + i + 1) & elem_index_mask;
+				}
+				new_hs_data[elem_index] = old_set_entry;
+			}
+		}
+		context_free_table(
+			ctx, MemTag_EvalMemo, eval_memo.data, eval_memo.capacity*sizeof(struct EvalEntry)
+		);
+		ctx->eval_memo.data     = new_hs_data;
+		ctx->eval_memo.capacity = new_hs_capacity;
+		trace_end(resize_span);
+	}
+	return res;
+}
+
+// collects infers the class refers to without duplicates, returns false if
+// the class cannot be memoized
+static bool collect_eval_deps(
+	const CompilerContext *ctx, Class cl, Data *restrict deps, size_t *restrict deps_size
+){
+	uint64_t dep;
+	switch (cl.tag){
+	case Class_Variable:
+		if (cl.param_id < 0){
+			dep = (uint64_t)EvalDep_ArgClass << 56 | (uint64_t)(-(1+cl.param_id));
+		} else{
+			dep = (uint64_t)EvalDep_Class << 56 | (uint64_t)cl.param_id;
+		}
+		break;
+	case Class_Array:{
+		const ArrayClassInfo *info = array_class_info(ctx, cl.idx);
+		uint32_t size_tag = info->size & ARRAY_SIZE_TAG_MASK;
+		if (size_tag == ARRAY_SIZE_TAG_EXPR) return false;
+		if (info->arg_class.evaled){
+			if (!collect_eval_deps(ctx, info->arg_class, deps, deps_size)) return false;
+		}
+		if (size_tag != ARRAY_SIZE_TAG_VARIABLE) return true;
+		int8_t var_index = (int8_t)(info->size & 0xff);
+		if (var_index < 0) return false;
+		dep = (uint64_t)EvalDep_Size << 56 | (uint64_t)var_index;
+		break;
+	}
+	case Class_Tuple:{
+		const TupleClassInfo *info = tuple_class_info(ctx, cl.idx);
+		for (size_t i=0; i!=info->size; i+=1){
+			if (!info->classes[i].evaled) continue;
+			if (!collect_eval_deps(ctx, info->classes[i], deps, deps_size)) return false;
+		}
+		return true;
+	}
+	default: return false;
+	}
+	for (size_t i=0; i!=*deps_size; i+=1){
+		if (deps[i].u64 == dep) return true;
+	}
+	if (*deps_size == EVAL_MEMO_MAX_DEPS) return false;
+	deps[*deps_size] = (Data){ .u64 = dep };
+	*deps_size += 1;
+	return true;
+}
+
+// returns the infers the class depends on, they are collected only once
+static const Data *get_eval_deps(CompilerContext *ctx, Class cl, size_t *deps_size){
+	Data key = { .clas = cl };
+	uint64_t hash = data_hash(EvalMemoKind_Deps, &key, 1);
+	size_t slot;
+	EvalRecord *r = find_eval_record(ctx, hash, &key, 1, &slot);
+	if (r == NULL){
+		Data deps[1 + EVAL_MEMO_MAX_DEPS];
+		size_t size = 0;
+		if (!collect_eval_deps(ctx, cl, deps+1, &size)) size = EVAL_MEMO_UNCACHED;
+		deps[0].u64 = size;
+		r = add_eval_record(
+			ctx, slot, hash, &key, 1, deps, size == EVAL_MEMO_UNCACHED ? 1 : 1 + size
+		);
+	}
+	const Data *value = eval_record_value(r);
+	*deps_size = value[0].u64;
+	return value + 1;
+}
+
+// empty memo, records are not kept in snapshots
+static void init_eval_memo(CompilerContext *ctx){
+	ctx->eval_memo = (struct EvalMemo){ .capacity = 64 };
+	ctx->eval_memo.data = context_alloc_table(
+		MemTag_EvalMemo, ctx->eval_memo.capacity*sizeof(struct EvalEntry)
+	);
+	assert(ctx->eval_memo.data != NULL);
+}
+
+static void free_eval_memo(CompilerContext *ctx){
+	context_free_table(
+		ctx, MemTag_EvalMemo, ctx->eval_memo.data,
+		ctx->eval_memo.capacity*sizeof(struct EvalEntry)
+	);
+	data_blocks_free(ctx->eval_memo.blocks, MemTag_EvalMemo);
+}
+
+
+
+// IMPLICIT CONVERSIONS OF BASIC CLASSES
+// the rules for unsigned and integer targets from opers.txt are compiled into
+// a matrix indexed by the source class, the target class and whether the
+// source is a compile time value, so matching them is a single load.
+// a class of the matrix is its tag and the log2 of its size, enums and bools
+// take only the first size
+#define CONVERSION_ERROR_LIST \
+	X(None,               NULL) \
+	X(Mismatch,           "class mismatch") \
+	X(BiggerUnsigned,     "assigning bigger unsigned integer to smaller one is not permitted") \
+	X(BiggerInteger,      "assigning bigger integer to smaller one is not permitted") \
+	X(ValueUnsigned,      "value cannot be represented by targeted unsigned integer") \
+	X(ValueInteger,       "value cannot be represented by targeted integer") \
+	X(EnumValueUnsigned,  "enum's value is too big to be represented by the targeted unsigned") \
+	X(EnumValueInteger,   "enum's value is too big to be represented by the targeted integer") \
+	X(EnumValuesUnsigned, "enum's values cannot be represented by the targeted unsigned") \
+	X(EnumValuesInteger,  "enum's values cannot be represented by the targeted integer")
+
+#define X(name, message) ConversionError_##name,
+enum ConversionError{ CONVERSION_ERROR_LIST ConversionError_Count };
+#undef X
+
+#define X(name, message) message,
+static const char *const ConversionErrorMessages[] = { CONVERSION_ERROR_LIST };
+#undef X
+
+// the extensions have the same values as in ArgConversion
+enum ConversionKind{
+	Conversion_None       = ArgConversion_None,
+	Conversion_ZeroExtend = ArgConversion_ZeroExtend,
+	Conversion_SignExtend = ArgConversion_SignExtend,
+	Conversion_CheckValue, // compile time value must fit in the target
+	Conversion_CheckEnum,  // all values of the enum must fit in the target
+	Conversion_Reject
+};
+
+typedef struct{
+	uint8_t kind;
+	uint8_t error;
+} Conversion;
+
+#define CONVERSION_SOURCES 16 // unsigned, integer, bool and enum
+#define CONVERSION_TARGETS 8  // unsigned and integer
+
+// slot+1 of every tag, 0 marks classes that are not in the matrix
+static const uint8_t ConversionSlots[64] = {
+	[Class_Unsigned] = 1, [Class_Integer] = 2, [Class_Bool] = 3, [Class_Enum] = 4,
+};
+
+static Conversion ConversionMatrix[2][CONVERSION_SOURCES][CONVERSION_TARGETS];
+
+static Conversion conversion_rule(
+	enum ClassTag source, uint32_t source_size, enum ClassTag target, uint32_t target_size,
+	bool is_const
+){
+	bool to_integer = target == Class_Integer;
+	Conversion res = { .kind = Conversion_Reject, .error = ConversionError_Mismatch };
+	if (is_const){
+		res.kind = Conversion_CheckValue;
+		res.error = to_integer ? ConversionError_ValueInteger : ConversionError_ValueUnsigned;
+		if (source == Class_Bool) res.kind = Conversion_None;
+		if (source == Class_Enum){
+			res.error = to_integer ?
+				ConversionError_EnumValueInteger : ConversionError_EnumValueUnsigned;
+		}
+		return res;
+	}
+	switch (source){
+	case Class_Bool:
+		res.kind = Conversion_ZeroExtend;
+		break;
+	case Class_Enum:
+		res.kind = Conversion_CheckEnum;
+		res.error = to_integer ?
+			ConversionError_EnumValuesInteger : ConversionError_EnumValuesUnsigned;
+		break;
+	case Class_Unsigned: // to bigger unsigned, bigger or equal integer
+		if (source_size > target_size){
+			res.error = ConversionError_BiggerUnsigned;
+			break;
+		}
+		res.kind = Conversion_ZeroExtend;
+		break;
+	case Class_Integer: // to bigger integer
+		if (!to_integer) break;
+		if (source_size > target_size){
+			res.error = ConversionError_BiggerInteger;
+			break;
+		}
+		res.kind = Conversion_SignExtend;
+		break;
+	default: break;
+	}
+	if (res.kind != Conversion_Reject && res.kind != Conversion_CheckEnum){
+		res.error = ConversionError_None;
+	}
+	return res;
+}
+
+static void init_conversion_matrix(void){
+	static const enum ClassTag source_tags[] = {
+		Class_Unsigned, Class_Integer, Class_Bool, Class_Enum
+	};
+	static const enum ClassTag target_tags[] = { Class_Unsigned, Class_Integer };
+	for (size_t c=0; c!=2; c+=1){
+		for (size_t s=0; s!=CONVERSION_SOURCES; s+=1){
+			for (size_t t=0; t!=CONVERSION_TARGETS; t+=1){
+				ConversionMatrix[c][s][t] = conversion_rule(
+					source_tags[s/4], 1u << s%4, target_tags[t/4], 1u << t%4, c
+				);
+			}
+		}
+	}
+}
+
+// returns NULL if the classes are not in the matrix
+static const Conversion *find_conversion(Class source, Class target, bool is_const){
+	uint32_t source_slot = ConversionSlots[source.tag] - 1;
+	uint32_t target_slot = ConversionSlots[target.tag] - 1;
+	if (source_slot >= 4 || target_slot >= 2) return NULL;
+	uint32_t source_size = source_slot < 2 ? util_trailing_zeros_u32(source.basic_size) : 0;
+	uint32_t target_size = util_trailing_zeros_u32(target.basic_size);
+	return &ConversionMatrix[is_const][4*source_slot + source_size][4*target_slot + target_size];
+}
+
+// checks if a compile time value of the source fits in the target, the value
+// is stored extended to 64 bits
+static bool convert_value(Data *value, Class source, Class target){
+	uint64_t v = value->u64;
+	bool negative = false;
+	if (source.tag == Class_Unsigned || source.tag == Class_Integer){
+		uint32_t bits = 8*source.basic_size;
+		if (bits < 64) v &= ((uint64_t)1 << bits) - 1;
+		if (source.tag == Class_Integer){
+			uint64_t signbit = (uint64_t)1 << (bits-1);
+			negative = v & signbit;
+			v |= -(v & signbit);
+		}
+	}
+	uint32_t bits = 8*target.basic_size;
+	if (target.tag == Class_Integer){
+		int64_t max = (int64_t)(UINT64_MAX >> (65 - bits));
+		if (negative ? (int64_t)v < -max-1 : v > (uint64_t)max) return false;
+	} else{
+		if (negative || v > (UINT64_MAX >> (64 - bits))) return false;
+	}
+	value->u64 = v;
+	return true;
+}
+
+
+
+// INITIALIZING COMPILER STATE
+// initializes read only data shared by all contexts,
+// must be called once before any context is used
+static void init_compiler_shared(void){
+	// keywords & directires
+	init_keyword_names();
+
+	// implicit conversions
+	init_conversion_matrix();
+}
+
+static void init_compiler_context(CompilerContext *ctx){
+	// bytecode buffer
+	ctx->bc = malloc(BC_BUFFER_CAPACITY*sizeof(BcNode));
+	assert(ctx->bc != NULL);
+	ctx->bc_size = 0;
+
+	// bytecode linked list
+	ctx->bc_head = (BcNode){};
+	ctx->bc_last = &ctx->bc_head;
 
 	// class info data
-	global_classes.capacity = (1 << 24); // for now just make it big
-	global_classes.size = 0;
-	global_classes.data = malloc(global_classes.capacity*sizeof(ClassInfoHeader));
-	assert(global_classes.data != NULL);
+	ctx->classes.capacity = CLASS_INFO_CAPACITY;
+	ctx->classes.size = 0;
+	ctx->classes.data = malloc(ctx->classes.capacity*sizeof(ClassInfoHeader));
+	assert(ctx->classes.data != NULL);
 
 	// name set
-	global_name_set.capacity = 256;
-	global_name_set.size = 0;
-	size_t name_set_bytes = global_name_set.capacity*sizeof(struct NameEntry);
-	global_name_set.data = malloc(name_set_bytes);
-	assert(global_name_set.data != NULL);
-	memset(global_name_set.data, 0, name_set_bytes);
+	ctx->name_set.capacity = 256;
+	ctx->name_set.size = 0;
+	ctx->name_set.data = context_alloc_table(
+		MemTag_NameSet, ctx->name_set.capacity*sizeof(struct NameEntry)
+	);
+	assert(ctx->name_set.data != NULL);
 	
 	// name data 
-	global_names.capacity = global_name_set.capacity*(1+8);
-	global_names.size = 0;
-	global_names.data = malloc(global_names.capacity);
-	assert(global_names.data != NULL);
+	ctx->names.capacity = ctx->name_set.capacity*(1+8);
+	ctx->names.size = 0;
+	ctx->names.data = context_alloc_table(MemTag_Names, ctx->names.capacity);
+	assert(ctx->names.data != NULL);
 
 	// array set
-	global_array_set.capacity = 64;
-	global_array_set.size = 0;
-	size_t array_set_bytes = global_array_set.capacity*sizeof(struct ArrayClassEntry);
-	global_array_set.data = malloc(array_set_bytes);
-	assert(global_array_set.data != NULL);
-	memset(global_array_set.data, 0, array_set_bytes);
+	ctx->array_set.capacity = 64;
+	ctx->array_set.size = 0;
+	ctx->array_set.data = context_alloc_table(
+		MemTag_ArraySet, ctx->array_set.capacity*sizeof(struct ArrayClassEntry)
+	);
+	assert(ctx->array_set.data != NULL);
 
 	// tuple set
-	global_tuple_set.capacity = 64;
-	global_tuple_set.size = 0;
-	size_t tuple_set_bytes = global_tuple_set.capacity*sizeof(struct TupleClassEntry);
-	global_tuple_set.data = malloc(tuple_set_bytes);
-	assert(global_tuple_set.data != NULL);
-	memset(global_tuple_set.data, 0, tuple_set_bytes);
+	ctx->tuple_set.capacity = 64;
+	ctx->tuple_set.size = 0;
+	ctx->tuple_set.data = context_alloc_table(
+		MemTag_TupleSet, ctx->tuple_set.capacity*sizeof(struct TupleClassEntry)
+	);
+	assert(ctx->tuple_set.data != NULL);
 
-	// keywords & directires
-	init_keyword_names();
+	// instance set
+	init_instance_set(ctx);
+
+	// call cache
+	init_call_cache(ctx);
+
+	// memo of evaluated classes
+	init_eval_memo(ctx);
+
+	ctx->hash_colissions = 0;
+	ctx->image.data = NULL;
+	ctx->image.size = 0;
+}
+
+static void free_compiler_context(CompilerContext *ctx){
+	if (ctx->image.data != NULL){
+		// buffers of a loaded snapshot are separate mappings
+		munmap(ctx->bc, BC_BUFFER_CAPACITY*sizeof(BcNode));
+		munmap(ctx->classes.data, ctx->classes.capacity*sizeof(ClassInfoHeader));
+	} else{
+		free(ctx->bc);
+		free(ctx->classes.data);
+	}
+	memory_track(MemTag_Bytecode, -(int64_t)(ctx->bc_size*sizeof(BcNode)));
+	memory_track(MemTag_Classes, -(int64_t)(ctx->classes.size*sizeof(ClassInfoHeader)));
+	context_free_table(
+		ctx, MemTag_NameSet, ctx->name_set.data,
+		ctx->name_set.capacity*sizeof(struct NameEntry)
+	);
+	context_free_table(ctx, MemTag_Names, ctx->names.data, ctx->names.capacity);
+	context_free_table(
+		ctx, MemTag_ArraySet, ctx->array_set.data,
+		ctx->array_set.capacity*sizeof(struct ArrayClassEntry)
+	);
+	context_free_table(
+		ctx, MemTag_TupleSet, ctx->tuple_set.data,
+		ctx->tuple_set.capacity*sizeof(struct TupleClassEntry)
+	);
+	free_instance_set(ctx);
+	free_call_cache(ctx);
+	free_eval_memo(ctx);
+	if (ctx->image.data != NULL) munmap(ctx->image.data, ctx->image.size);
+	*ctx = (CompilerContext){};
 }
 
 
@@ -491,7 +1555,7 @@ static void initialize_compiler_globals(void){
 
 
 static const char *match_classes(
-	Class source, Class *restrict target_ptr, ValueInfo *restrict infers
+	CompilerContext *ctx, Class source, Class *restrict target_ptr, ValueInfo *restrict infers
 ){
 	Class target = *target_ptr;
 	assert(!target.evaled);
@@ -541,19 +1605,19 @@ static const char *match_classes(
 		if (source.tag != Class_Array) break;
 		if (source.prefixes != 0)
 			return "class prefix mismatch";
-		const ArrayClassInfo *target_info = array_class_info(target.idx);
-		const ArrayClassInfo *source_info = array_class_info(target.idx);
+		const ArrayClassInfo *target_info = array_class_info(ctx, target.idx);
+		const ArrayClassInfo *source_info = array_class_info(ctx, source.idx);
 	
 		uint32_t target_size = target_info->size;
 		Class target_arg = target_info->arg_class;
-		const char *err = match_classes(source_info->arg_class, &target_arg, infers);	
+		const char *err = match_classes(ctx, source_info->arg_class, &target_arg, infers);	
 		if (err != NULL) return err;
 		if (target_size & ARRAY_SIZE_TAG_INFERED){
 			target_size = source_info->size;
 		} else if (target_size != source_info->size)
 			return "array size mismatch";
 		if (target_size != source_info->size || target_arg.id != source_info->arg_class.id){
-			source = get_array_class(target_arg, target_size);
+			source = get_array_class(ctx, target_arg, target_size);
 		}
 		source.prefixes = target.prefixes;
 		*target_ptr = source;
@@ -563,31 +1627,31 @@ static const char *match_classes(
 		if (source.tag != Class_Tuple) break;
 		if (source.prefixes != 0)
 			return "class prefix mismatch";
-		const TupleClassInfo *target_info = tuple_class_info(target.idx);
-		const TupleClassInfo *source_info = tuple_class_info(target.idx);
+		const TupleClassInfo *target_info = tuple_class_info(ctx, target.idx);
+		const TupleClassInfo *source_info = tuple_class_info(ctx, source.idx);
 		uint32_t size = target_info->size;
 		if (size == UINT32_MAX) goto ReturnTuple;
 		Class *args = NULL;
-		size_t saved_bc_size = global_bc_size;
+		size_t saved_bc_size = ctx->bc_size;
 		for (size_t i=0; i!=size; i+=1){
-			Class arg = target_info->classes[i];
-			const char *err = match_classes(source_info->classes[i], &arg, infers);	
+			Class elem = target_info->classes[i];
+			const char *err = match_classes(ctx, source_info->classes[i], &elem, infers);	
 			if (err != NULL){
-				if (args != NULL){ global_bc_size = saved_bc_size; }
+				if (args != NULL){ ctx->bc_size = saved_bc_size; }
 				return err;	
 			}
-			if (arg.id != source_info->classes[i].id){
+			if (elem.id != source_info->classes[i].id){
 				if (args == NULL){
-					Class *args = (Class *)(global_bc + saved_bc_size);
-					global_bc_size = saved_bc_size + size;
+					args = (Class *)(ctx->bc + saved_bc_size);
+					ctx->bc_size = saved_bc_size + size;
 					memcpy(args, source_info->classes, size*sizeof(Class));
 				}
-				args[i] = arg;
+				args[i] = elem;
 			}
 		}
 		if (args != NULL){
-			source = get_tuple_class(args, size);
-			global_bc_size = saved_bc_size;
+			source = get_tuple_class(ctx, args, size);
+			ctx->bc_size = saved_bc_size;
 		}
 	ReturnTuple:
 		source.prefixes = target.prefixes;
@@ -602,7 +1666,12 @@ static const char *match_classes(
 
 
 
-static const char *eval_class(Class *restrict target_ptr, ValueInfo *restrict infers){
+static const char *eval_class(
+	CompilerContext *ctx, Class *restrict target_ptr, ValueInfo *restrict infers
+);
+
+static const char *eval_class_uncached(
+	CompilerContext *ctx, Class *restrict target_ptr, ValueInfo *restrict infers){
 	Class target = *target_ptr;
 	assert(target.evaled);
 	
@@ -624,7 +1693,7 @@ static const char *eval_class(Class *restrict target_ptr, ValueInfo *restrict in
 		goto RestorePrefixes;
 	}
 	case Class_Array:{
-		const ArrayClassInfo *info = array_class_info(target.idx);
+		const ArrayClassInfo *info = array_class_info(ctx, target.idx);
 		uint32_t size_value = info->size;
 		uint32_t size_tag = size_value & ARRAY_SIZE_TAG_MASK;
 		if ((size_tag == ARRAY_SIZE_TAG_VARIABLE) || (size_tag == ARRAY_SIZE_TAG_EXPR)){
@@ -654,24 +1723,25 @@ static const char *eval_class(Class *restrict target_ptr, ValueInfo *restrict in
 		}
 		Class arg_class = info->arg_class;	
 		if (arg_class.evaled){
-			const char *err = eval_class(&arg_class, infers);
+			const char *err = eval_class(ctx, &arg_class, infers);
 			if (err != NULL) return err;
 		}
-		target = get_array_class(arg_class, size_value);	
+		target = get_array_class(ctx, arg_class, size_value);	
 		goto Return;
 	}
 	case Class_Tuple:{
-		const TupleClassInfo *info = tuple_class_info(target.idx);
-		size_t saved_bc_size = global_bc_size;
-		Class *arg_classes = (Class *)(global_bc + saved_bc_size);
-		global_bc_size = saved_bc_size + info->size;
+		const TupleClassInfo *info = tuple_class_info(ctx, target.idx);
+		size_t saved_bc_size = ctx->bc_size;
+		Class *arg_classes = (Class *)(ctx->bc + saved_bc_size);
+		ctx->bc_size = saved_bc_size + info->size;
 		memcpy(arg_classes, info->classes, info->size*sizeof(Class));
 		for (size_t i=0; i!=info->size; i+=1){
-			const char *err = eval_class(arg_classes+i, infers);
-			if (err != NULL){ global_bc_size = saved_bc_size; return err; }
+			if (!arg_classes[i].evaled) continue;
+			const char *err = eval_class(ctx, arg_classes+i, infers);
+			if (err != NULL){ ctx->bc_size = saved_bc_size; return err; }
 		}
-		target = get_tuple_class(arg_classes, info->size);	
-		global_bc_size = saved_bc_size;
+		target = get_tuple_class(ctx, arg_classes, info->size);	
+		ctx->bc_size = saved_bc_size;
 		goto Return;
 	}
 	default: *(int *)0 = 0;
@@ -681,7 +1751,7 @@ static const char *eval_class(Class *restrict target_ptr, ValueInfo *restrict in
 		size_t prefixes_size = 0;
 		while ((prefixes >> prefixes_size) != 0){ prefixes_size += PREFIX_SIZE; }
 		prefixes |= (uint64_t)target.prefixes << prefixes_size;
-		if (prefixes & ((1u << MAX_PREFIXES_SIZE)-1u))
+		if ((prefixes >> MAX_PREFIXES_SIZE) != 0)
 			return "substituted class has too many prefixes";
 	}
 
@@ -692,22 +1762,86 @@ Return:
 	return NULL;
 }
 
+// evaluates the class from values of the infers, results are memoized by the
+// class and values of the infers it depends on, failed evaluations are not
+static const char *eval_class(
+	CompilerContext *ctx, Class *restrict target_ptr, ValueInfo *restrict infers
+){
+	Class target = *target_ptr;
+	assert(target.evaled);
+	// a variable is substituted with a single load, a lookup would cost more
+	if (ctx->eval_memo.disabled || target.tag == Class_Variable){
+		return eval_class_uncached(ctx, target_ptr, infers);
+	}
+
+	size_t deps_size;
+	const Data *deps = get_eval_deps(ctx, target, &deps_size);
+	if (deps_size == EVAL_MEMO_UNCACHED) goto Uncached;
+
+	Data key[1 + 2*EVAL_MEMO_MAX_DEPS];
+	size_t key_size = 0;
+	key[key_size++] = (Data){ .clas = target };
+	for (size_t i=0; i!=deps_size; i+=1){
+		const ValueInfo *value = infers + (deps[i].u64 & 0xff);
+		switch ((enum EvalDep)(deps[i].u64 >> 56)){
+		case EvalDep_ArgClass:
+			key[key_size++] = (Data){ .clas = value->clas };
+			break;
+		case EvalDep_Class:
+			if (value->clas.id != CLASS_CLASS.id) goto Uncached; // reported by evaluation
+			key[key_size++] = value->data;
+			break;
+		case EvalDep_Size:
+			key[key_size++] = (Data){ .clas = value->clas };
+			key[key_size++] = value->data;
+			break;
+		}
+	}
+
+	uint64_t hash = data_hash(EvalMemoKind_Class, key, key_size);
+	size_t slot;
+	EvalRecord *r = find_eval_record(ctx, hash, key, key_size, &slot);
+	if (r != NULL){
+		ctx->eval_memo.hits += 1;
+		*target_ptr = eval_record_value(r)->clas;
+		return NULL;
+	}
+	const char *err = eval_class_uncached(ctx, target_ptr, infers);
+	if (err != NULL) return err;
+	ctx->eval_memo.misses += 1;
+	// evaluation may have added records, so the slot is searched again
+	find_eval_record(ctx, hash, key, key_size, &slot);
+	add_eval_record(ctx, slot, hash, key, key_size, &(Data){ .clas = *target_ptr }, 1);
+	return NULL;
+
+Uncached:
+	ctx->eval_memo.uncached += 1;
+	return eval_class_uncached(ctx, target_ptr, infers);
+}
+
 
+// conversion gets what has to be inserted to convert the argument, matching
+// of compile time arguments that depends on their values is marked as
+// ArgConversion_Value
 static const char *match_argument(
-	ValueInfo *restrict arg, Class target, ValueInfo *restrict infers
+	CompilerContext *ctx, ValueInfo *restrict arg, Class target, ValueInfo *restrict infers,
+	uint8_t *restrict conversion
 ){
 	Class source = arg->clas;
+	*conversion = ArgConversion_None;
 	
 	if (target.evaled){
-		const char *err = eval_class(&target, infers);
+		const char *err = eval_class(ctx, &target, infers);
 		if (err != NULL) return err;
 		arg->clas = target;
 	}
 
 	if (source.id == target.id) return NULL;
+	if (arg->flags & VF_Const) *conversion = ArgConversion_Value;
 
 	if (source.id == CLASS_EMPTY_INITLIST.id && !target.infered){
-		size_t bytesize = get_bytesize(target);
+		*conversion = ArgConversion_Value;
+		size_t bytesize = get_bytesize(ctx, target);
 		if (bytesize <= sizeof(Data)){
 			arg->data.u64 = 0;
 		} else{
@@ -760,130 +1894,51 @@ static const char *match_argument(
 		break;
 	}
 
-	case Class_Unsigned:{
-		if (source.prefixes != 0)
-			return "class prefix mismatch";
-		if (source.tag == Class_Unsigned){
-			if (arg->flags & VF_Const){
-				if (source.basic_size > target.basic_size){
-					assert(target.basic_size < 8);
-					uint64_t max_unsigned_target = (1ul << target.basic_size*8ul) - 1ul;
-					if (arg->data.u64 > max_unsigned_target)
-						return "value cannot be represented by smaller unsigned integer";
-				}
-			} else{
-				if (source.basic_size > target.basic_size)
-					return "assigning bigger unsigned integer to smaller one is not permitted";
-				// TODO: insert zero extend node
-			}
-			return NULL;
-		}
-		if (source.tag == Class_Integer && (arg->flags & VF_Const)){
-			uint64_t max_signed_target = (1ul << (target.basic_size*8ul-1ul)) - 1ul;
-			if (arg->data.u64 > max_signed_target)
-				return "value cannot be represented by targeted unsigned integer";
-			return NULL;
-		}
-		if (source.tag == Class_Bool){
-			if (!(arg->flags & VF_Const)){
-				// TODO: insert zero extend node
-			}
-			return NULL;
-		}
-		if (source.tag == Class_Enum){
-			uint64_t max_unsigned_target = UINT64_MAX >> (64u - target.basic_size*8u);
-			if (arg->flags & VF_Const){
-				if (arg->data.u64 > max_unsigned_target)
-					return "enum's value is too big to be represented by the targeted unsigned";
-			} else{
-				const EnumClassInfo *source_info = enum_class_info(source.idx);
-				if (source_info->max_value > max_unsigned_target)
-					return "enum's values cannot be represented by the targeted unsigned";
-				// TODO: insert zero extend node
-			}
-			return NULL;
-		}
-		break;
-	}
-
+	case Class_Unsigned:
 	case Class_Integer:{
 		if (source.prefixes != 0)
 			return "class prefix mismatch";
-		if (source.tag == Class_Integer){
-			if (arg->flags & VF_Const){
-				uint64_t source_signbit = 1ul << (source.basic_size*8ul-1ul);
-				if (source.basic_size > target.basic_size){
-					uint64_t max_target = (1ul << (target.basic_size*8ul-1ul)) - 1ul;
-					uint64_t value = arg->data.u64;
-					bool neg = value & source_signbit;
-					if ((neg ? (~value & (source_signbit-1ul)) : value) > max_target)
-						return "value cannot be represented by smaller integer";
-				} else{
-					arg->data.u64 |= -(arg->data.u64 & source_signbit);
-				}
-			} else{
-				if (source.basic_size > target.basic_size)
-					return "assigning bigger unsigned integer to smaller one is not permitted";
-				// TODO: insert sign extend node
-			}
+		bool is_const = arg->flags & VF_Const;
+		const Conversion *conv = find_conversion(source, target, is_const);
+		if (conv == NULL) break;
+		switch (conv->kind){
+		case Conversion_None: return NULL;
+		case Conversion_ZeroExtend:
+		case Conversion_SignExtend:
+			*conversion = conv->kind;
 			return NULL;
-		}
-		if (source.tag == Class_Unsigned){
-			if (arg->flags & VF_Const){
-				uint64_t max_signed_target = (1ul << (target.basic_size*8ul-1ul)) - 1ul;
-				if (arg->data.u64 > max_signed_target)
-					return "value cannot be represented by targeted integer";
-			} else{
-				if (source.basic_size > target.basic_size)
-					return "assigning bigger unsigned integer to smaller one is not permitted";
-				// TODO: insert zero extend node
-			}
+		case Conversion_CheckValue:
+			if (!convert_value(&arg->data, source, target))
+				return ConversionErrorMessages[conv->error];
 			return NULL;
-		}
-		if (source.tag == Class_Bool){
-			if (!(arg->flags & VF_Const)){
-				// TODO: insert zero extend node
-			}
+		case Conversion_CheckEnum:{
+			uint32_t bits = 8*target.basic_size - (target.tag == Class_Integer);
+			const EnumClassInfo *source_info = enum_class_info(ctx, source.idx);
+			if (source_info->max_value > (UINT64_MAX >> (64 - bits)))
+				return ConversionErrorMessages[conv->error];
+			*conversion = ArgConversion_ZeroExtend;
 			return NULL;
 		}
-		if (source.tag == Class_Enum){
-			uint64_t max_signed_target = (1ul << (target.basic_size*8ul-1ul)) - 1ul;
-			if (arg->flags & VF_Const){
-				if (arg->data.u64 > max_signed_target)
-					return "enum's value is too big to be represented by the targeted integer";
-			} else{
-				const EnumClassInfo *source_info = enum_class_info(source.idx);
-				if (source_info->max_value > max_signed_target)
-					return "enum's values cannot be represented by the targeted integer";
-				// TODO: insert zero extend node
-			}
-			return NULL;
+		default: return ConversionErrorMessages[conv->error];
 		}
-		break;
 	}
 
 	case Class_Enum:{
 		if (source.prefixes != 0)
 			return "class prefix mismatch";
-		if (target.tag != Class_EnumLiteral) break;
-		const EnumClassInfo *target_info = enum_class_info(target.idx);
-		size_t elem_count = target_info->elem_count;
-		size_t bytesize = target_info->basic_size;
-		assert(bytesize <= 8);
-		for (size_t i=0; i!=elem_count; i+=1){
-			if (target_info->names[i] == source.name_id){
-				arg->data.u64 = 0;
-				const uint8_t *values = (const uint8_t *)(target_info->names + elem_count);
-				memcpy(&arg->data.u64, values + i*bytesize, bytesize);
-				return NULL;
-			}
-		}
-		return "enum literal cannot represent any of targeted enum's values";
+		if (source.tag != Class_EnumLiteral) break;
+		const EnumClassInfo *target_info = enum_class_info(ctx, target.idx);
+		assert(target_info->basic_size <= 8);
+		int32_t elem = find_enum_element(target_info, source.name_id);
+		if (elem < 0) return "enum literal cannot represent any of targeted enum's values";
+		*conversion = ArgConversion_Value;
+		arg->data.u64 = enum_element_value(target_info, elem);
+		return NULL;
 	}
 
 	case Class_Array:{
-		const ArrayClassInfo *target_info = array_class_info(target.idx);
-		uint32_t target_size;
+		const ArrayClassInfo *target_info = array_class_info(ctx, target.idx);
+		uint32_t target_size = target_info->size;
 		Class target_arg = target_info->arg_class;
 		Class source_arg;
 		uint32_t source_size;
@@ -894,24 +1949,23 @@ static const char *match_argument(
 				return "non compile time span cannot be assigned to array";
 			source_arg = source;
 			CtSpan64 span_data;
-			memcpy(&span_data, global_bc + arg->data_idx, sizeof(CtSpan64));
+			memcpy(&span_data, ctx->bc + arg->data_idx, sizeof(CtSpan64));
 			source_size = span_data.size;
 			if (source_size > ARRAY_MAX_SIZE)
 				return "span's size is too bit to be represented by array class";
 			// comptime data case: just refer to data indexed by span
 			// runtime data case: comptime would refer to static data, so insert
 			//   load static variable node
-		}
-		if (source.tag == Class_Array){
-			const ArrayClassInfo *source_info = array_class_info(target.idx);
+		} else if (source.tag == Class_Array){
+			const ArrayClassInfo *source_info = array_class_info(ctx, source.idx);
 			source_arg  = source_info->arg_class;
 			source_size = source_info->size;
-		}
-		if (source.tag == Class_Initlist){
-			
+		} else if (source.tag == Class_Initlist){
+			return "initlist arguments are not supported";
+		} else{
 			break;
 		}
-		const char *err = match_classes(source_arg, &target_arg, infers);	
+		const char *err = match_classes(ctx, source_arg, &target_arg, infers);	
 		if (err != NULL) return err;
 		if (target_size & ARRAY_SIZE_TAG_INFERED){
 			target_size = source_size;
@@ -919,7 +1973,7 @@ static const char *match_argument(
 			return "array size mismatch";
 		}
 		if (source.tag != Class_Array || target_arg.id != source_arg.id){
-			source = get_array_class(target_arg, target_size);
+			source = get_array_class(ctx, target_arg, target_size);
 		}
 		source.prefixes = target.prefixes;
 		arg->clas = source;
@@ -930,35 +1984,35 @@ static const char *match_argument(
 		if (source.tag != Class_Tuple) break;
 		if (source.prefixes != 0)
 			return "class prefix mismatch";
-		const TupleClassInfo *target_info = tuple_class_info(target.idx);
-		const TupleClassInfo *source_info = tuple_class_info(target.idx);
+		const TupleClassInfo *target_info = tuple_class_info(ctx, target.idx);
+		const TupleClassInfo *source_info = tuple_class_info(ctx, source.idx);
 		uint32_t size = target_info->size;
 		if (size == UINT32_MAX) goto ReturnTuple;
 		Class *args = NULL;
-		size_t saved_bc_size = global_bc_size;
+		size_t saved_bc_size = ctx->bc_size;
 		for (size_t i=0; i!=size; i+=1){
-			Class arg = target_info->classes[i];
-			const char *err = match_classes(source_info->classes[i], &arg, infers);	
+			Class elem = target_info->classes[i];
+			const char *err = match_classes(ctx, source_info->classes[i], &elem, infers);	
 			if (err != NULL){
-				if (args != NULL){ global_bc_size = saved_bc_size; }
+				if (args != NULL){ ctx->bc_size = saved_bc_size; }
 				return err;	
 			}
-			if (arg.id != source_info->classes[i].id){
+			if (elem.id != source_info->classes[i].id){
 				if (args == NULL){
-					Class *args = (Class *)(global_bc + saved_bc_size);
-					global_bc_size = saved_bc_size + size;
+					args = (Class *)(ctx->bc + saved_bc_size);
+					ctx->bc_size = saved_bc_size + size;
 					memcpy(args, source_info->classes, size*sizeof(Class));
 				}
-				args[i] = arg;
+				args[i] = elem;
 			}
 		}
 		if (args != NULL){
-			source = get_tuple_class(args, size);
-			global_bc_size = saved_bc_size;
+			source = get_tuple_class(ctx, args, size);
+			ctx->bc_size = saved_bc_size;
 		}
 	ReturnTuple:
 		source.prefixes = target.prefixes;
-		//*target_ptr = source;
+		arg->clas = source;
 		return NULL;
 	}
 
@@ -970,4 +2024,154 @@ static const char *match_argument(
 
 
 
+static const char *match_call_args(
+	CompilerContext *ctx, const ProcedureClassInfo *info, ValueInfo *restrict args,
+	size_t arg_count, ValueInfo *restrict infers, uint8_t *restrict conversions
+){
+	for (size_t i=0; i!=arg_count; i+=1){
+		const char *err = match_argument(ctx, args+i, info->classes[i], infers, conversions+i);
+		if (err != NULL) return err;
+	}
+	return NULL;
+}
+
+// matches arguments of a call with parameters of the procedure, classes of
+// the arguments are replaced with the matched ones, named infers are set
+// from index 1 and conversions gets what has to be inserted for every
+// argument. compile time arguments that are matched by their values are
+// matched again on every call. calls whose parameters are evaluated from
+// infers depend on more than the key, so they are not cached
+static const char *match_call(
+	CompilerContext *ctx, uint32_t proc_idx, ValueInfo *restrict args, size_t arg_count,
+	ValueInfo *restrict infers, uint8_t *restrict conversions
+){
+	const ProcedureClassInfo *info = procedure_class_info(ctx, proc_idx);
+	assert(arg_count <= info->param_count);
+	size_t infer_count = info->named_infers_count;
+	bool cacheable = arg_count <= CALL_CACHE_MAX_ARGS && infer_count <= CALL_CACHE_MAX_ARGS;
+	for (size_t i=0; cacheable && i!=arg_count; i+=1) cacheable = !info->classes[i].evaled;
+	if (!cacheable){
+		ctx->call_cache.uncached += 1;
+		return match_call_args(ctx, info, args, arg_count, infers, conversions);
+	}
+
+	Data key[1 + CALL_CACHE_MAX_ARGS];
+	key[0].u64 = 0;
+	for (size_t i=0; i!=arg_count; i+=1){
+		key[0].u64 |= (uint64_t)((args[i].flags & VF_Const) != 0) << i;
+		key[1+i].clas = args[i].clas;
+	}
+	uint64_t hash = data_hash(proc_idx, key, 1 + arg_count);
+	size_t slot;
+	CallResolution *r = find_call_resolution(ctx, hash, proc_idx, key, arg_count, &slot);
+	if (r != NULL){
+		ctx->call_cache.hits += 1;
+		const Class *infered = call_infers(r);
+		for (size_t i=0; i!=infer_count; i+=1){
+			if (!((r->infer_mask >> i) & 1)) continue;
+			infers[1+i] = (ValueInfo){
+				.clas = CLASS_CLASS, .flags = VF_Const, .data.clas = infered[i]
+			};
+		}
+		const Class *targets = call_targets(r);
+		const uint8_t *cached = call_conversions(r);
+		for (size_t i=0; i!=arg_count; i+=1){
+			conversions[i] = cached[i];
+			if (cached[i] == ArgConversion_Value){
+				const char *err = match_argument(
+					ctx, args+i, info->classes[i], infers, conversions+i
+				);
+				if (err != NULL) return err;
+			} else{
+				args[i].clas = targets[i];
+			}
+		}
+		return NULL;
+	}
+
+	ctx->call_cache.misses += 1;
+	ValueInfo saved_infers[CALL_CACHE_MAX_ARGS];
+	memcpy(saved_infers, infers+1, infer_count*sizeof(ValueInfo));
+	const char *err = match_call_args(ctx, info, args, arg_count, infers, conversions);
+	if (err != NULL) return err; // errors end the compilation, so they are not cached
+
+	r = add_call_resolution(ctx, slot, hash, proc_idx, key, arg_count, infer_count);
+	Class *targets = call_targets(r);
+	Class *infered = call_infers(r);
+	for (size_t i=0; i!=arg_count; i+=1) targets[i] = args[i].clas;
+	for (size_t i=0; i!=infer_count; i+=1){
+		infered[i] = infers[1+i].data.clas;
+		if (memcmp(saved_infers+i, infers+1+i, sizeof(ValueInfo)) != 0){
+			r->infer_mask |= (uint64_t)1 << i;
+		}
+	}
+	memcpy(call_conversions(r), conversions, arg_count);
+	return NULL;
+}
+
+
+
+
+
+
+
+// INSTRUMENTATION REPORT
+#ifdef YACK_STATS
+#include <stdio.h>
 
+// prints counters of the current thread and sizes of the context as json
+static void print_compiler_stats(FILE *out, const CompilerContext *ctx){
+	const CompilerStats *s = &compiler_stats;
+	// scope stacks and indexes of class infos don't belong to the context, only
+	// their counters are printed
+	size_t table_sizes[StatsTable_Count] = {
+		ctx->name_set.size, ctx->array_set.size, ctx->tuple_set.size,
+		[StatsTable_Instances] = ctx->instance_set.size,
+		[StatsTable_Calls] = ctx->call_cache.size,
+		[StatsTable_EvalMemo] = ctx->eval_memo.size
+	};
+	size_t table_capacities[StatsTable_Count] = {
+		ctx->name_set.capacity, ctx->array_set.capacity, ctx->tuple_set.capacity,
+		[StatsTable_Instances] = ctx->instance_set.capacity,
+		[StatsTable_Calls] = ctx->call_cache.capacity,
+		[StatsTable_EvalMemo] = ctx->eval_memo.capacity
+	};
+
+	fprintf(out, "{\n  \"tables\": {");
+	for (size_t t=0; t!=StatsTable_Count; t+=1){
+		fprintf(out,
+			"%s\n    \"%s\": {\"size\": %zu, \"capacity\": %zu, \"resizes\": %lu, \"probes\": [",
+			t == 0 ? "" : ",", StatsTableNames[t], table_sizes[t], table_capacities[t],
+			s->resizes[t]
+		);
+		for (size_t i=0; i!=STATS_PROBE_BUCKETS; i+=1){
+			fprintf(out, i == 0 ? "%lu" : ", %lu", s->probes[t][i]);
+		}
+		fprintf(out, "]}");
+	}
+	fprintf(out, "\n  },\n");
+
+	fprintf(out,
+		"  \"names\": {\"bytes\": %zu, \"capacity\": %zu, \"resizes\": %lu, \"hash_colissions\": %zu},\n",
+		(size_t)ctx->names.size, (size_t)ctx->names.capacity, s->name_data_resizes,
+		ctx->hash_colissions
+	);
+	fprintf(out,
+		"  \"ast_grows\": {\"count\": %lu, \"bytes\": %lu},\n",
+		s->ast_grows, s->ast_grow_bytes
+	);
+	fprintf(out, "  \"bc_bytes\": %zu,\n", ctx->bc_size*sizeof(BcNode));
+	fprintf(out,
+		"  \"classes_bytes\": %zu,\n", (size_t)ctx->classes.size*sizeof(ClassInfoHeader)
+	);
+
+	fprintf(out, "  \"tokens\": {");
+	bool first = true;
+	for (size_t i=0; i!=SIZE(s->token_counts); i+=1){
+		if (s->token_counts[i] == 0) continue;
+		fprintf(out, "%s\n    \"%s\": %lu", first ? "" : ",", AstTypeNames[i], s->token_counts[i]);
+		first = false;
+	}
+	fprintf(out, "\n  }\n}\n");
+}
+#endif
@@ -0,0 +1,574 @@
+#pragma once
+
+#include "utils.h"
+#include "bytecode.h"
+
+
+// COMPILE TIME EXECUTION
+// procedures are executed on a stack of 64 bit words, floats are kept as the
+// bits of f64 and narrower values are zero extended. values in memory have
+// their class, loads sign extend signed integers and widen f32, stores narrow
+// f64 back to f32. arguments are the first
+// locals of a frame and values pushed after them are the next locals, so a
+// local is its index in the frame. memory is addressed with CtPointer64, the
+// base 0 is the value stack and other bases are blocks of the compile time
+// heap, so pointers stay valid when the heap grows and every access is
+// checked against the size of its block
+#define CT_STACK_CAPACITY (1 << 20) // words
+#define CT_FRAME_CAPACITY (1 << 16)
+#define CT_STEP_LIMIT     500000000 // default step limit, a second or two of jumps
+
+typedef struct{
+	const BcNode *ret; // call instruction of the caller
+	uint32_t base;
+} CtFrame;
+
+typedef struct{
+	uint64_t offset;
+	uint64_t size;
+} CtBlock;
+
+typedef struct{
+	CompilerContext *ctx;
+
+	uint64_t *stack;
+	CtFrame  *frames;
+
+	uint8_t *heap;
+	uint64_t heap_size;
+	uint64_t heap_capacity;
+	CtBlock *blocks;
+	uint32_t block_count;
+	uint32_t block_capacity;
+
+	uint64_t step_limit; // jumps and calls of one run before it is stopped
+	const BcNode *error_ip; // instruction that failed
+} CtMachine;
+
+
+static void init_ct_machine(CtMachine *m, CompilerContext *ctx){
+	*m = (CtMachine){ .ctx = ctx, .step_limit = CT_STEP_LIMIT };
+	m->stack = malloc(CT_STACK_CAPACITY*sizeof(uint64_t));
+	m->frames = malloc(CT_FRAME_CAPACITY*sizeof(CtFrame));
+	assert(m->stack != NULL && m->frames != NULL && "compile time allocation failrule");
+	memory_track(MemTag_Comptime, CT_STACK_CAPACITY*sizeof(uint64_t));
+	memory_track(MemTag_Comptime, CT_FRAME_CAPACITY*sizeof(CtFrame));
+}
+
+static void free_ct_machine(CtMachine *m){
+	memory_track(MemTag_Comptime, -(int64_t)(CT_STACK_CAPACITY*sizeof(uint64_t)));
+	memory_track(MemTag_Comptime, -(int64_t)(CT_FRAME_CAPACITY*sizeof(CtFrame)));
+	memory_track(MemTag_Comptime, -(int64_t)(m->heap_capacity + m->block_capacity*sizeof(CtBlock)));
+	free(m->stack);
+	free(m->frames);
+	free(m->heap);
+	free(m->blocks);
+}
+
+// blocks are zeroed and live until the machine is freed or the heap is reset
+static uint64_t ct_heap_alloc(CtMachine *m, uint64_t size){
+	uint64_t offset = util_alignsize(m->heap_size, 8);
+	if (offset + size > m->heap_capacity){
+		uint64_t new_capacity = util_max_u64(2*m->heap_capacity, 4096);
+		while (new_capacity < offset + size) new_capacity *= 2;
+		m->heap = realloc(m->heap, new_capacity);
+		assert(m->heap != NULL && "compile time heap allocation failrule");
+		memory_track(MemTag_Comptime, new_capacity - m->heap_capacity);
+		m->heap_capacity = new_capacity;
+	}
+	if (m->block_count == m->block_capacity){
+		uint32_t new_capacity = m->block_capacity == 0 ? 64 : 2*m->block_capacity;
+		m->blocks = realloc(m->blocks, new_capacity*sizeof(CtBlock));
+		assert(m->blocks != NULL && "compile time heap allocation failrule");
+		memory_track(MemTag_Comptime, (new_capacity - m->block_capacity)*sizeof(CtBlock));
+		m->block_capacity = new_capacity;
+	}
+	memset(m->heap + offset, 0, size);
+	m->heap_size = offset + size;
+	m->blocks[m->block_count] = (CtBlock){ .offset = offset, .size = size };
+	m->block_count += 1;
+	CtPointer64 ptr = { .ibase = m->block_count, .idata = 0 };
+	uint64_t word;
+	memcpy(&word, &ptr, sizeof(word));
+	return word;
+}
+
+// pointers to earlier blocks become invalid
+static void ct_reset_heap(CtMachine *m){
+	m->heap_size = 0;
+	m->block_count = 0;
+}
+
+// returns NULL when the bytes at the offset from the pointer are outside of
+// the block, the offset is added in 64 bits so it can't wrap around
+static uint8_t *ct_resolve(
+	const CtMachine *m, uint64_t word, uint64_t offset, uint64_t size, const uint64_t *sp
+){
+	CtPointer64 ptr;
+	memcpy(&ptr, &word, sizeof(ptr));
+	if (offset > UINT32_MAX) return NULL;
+	uint64_t end = (uint64_t)ptr.idata + offset + size;
+	if (ptr.ibase == 0){
+		if (end > (uint64_t)(sp - m->stack)*sizeof(uint64_t)) return NULL;
+		return (uint8_t *)m->stack + ptr.idata + offset;
+	}
+	if (ptr.ibase > m->block_count) return NULL;
+	CtBlock block = m->blocks[ptr.ibase-1];
+	if (end > block.size) return NULL;
+	return m->heap + block.offset + ptr.idata + offset;
+}
+
+static bool ct_is_basic(Class cl){
+	return cl.tag <= Class_Float && cl.basic_size != 0;
+}
+
+static uint64_t ct_sign_extend(uint64_t word, uint64_t size){
+	uint32_t shift = 64 - 8*size;
+	return (uint64_t)((int64_t)(word << shift) >> shift);
+}
+
+static uint64_t ct_zero_extend(uint64_t word, uint64_t size){
+	return size >= 8 ? word : word & ((1ull << 8*size) - 1);
+}
+
+static double ct_f64(uint64_t word){
+	double res;
+	memcpy(&res, &word, sizeof(res));
+	return res;
+}
+
+static uint64_t ct_word_f64(double value){
+	uint64_t res;
+	memcpy(&res, &value, sizeof(res));
+	return res;
+}
+
+static uint64_t ct_load(const uint8_t *data, Class cl){
+	if (cl.tag == Class_Float && cl.basic_size == 4){
+		float f;
+		memcpy(&f, data, sizeof(f));
+		return ct_word_f64(f);
+	}
+	uint64_t res = 0;
+	memcpy(&res, data, cl.basic_size);
+	return cl.tag == Class_Integer ? ct_sign_extend(res, cl.basic_size) : res;
+}
+
+static void ct_store(uint8_t *data, uint64_t word, Class cl){
+	if (cl.tag == Class_Float && cl.basic_size == 4){
+		float f = ct_f64(word);
+		memcpy(data, &f, sizeof(f));
+		return;
+	}
+	memcpy(data, &word, cl.basic_size);
+}
+
+static uint64_t ct_convert(uint64_t word, Class target, Class source){
+	double f;
+	switch (source.tag){
+	case Class_Unsigned: f = (double)word; break;
+	case Class_Integer:  f = (double)(int64_t)word; break;
+	case Class_Float:    f = ct_f64(word); break;
+	default: return word;
+	}
+	switch (target.tag){
+	case Class_Unsigned:
+		if (source.tag != Class_Float) return word;
+		return f <= 0.0 ? 0 : (f >= 0x1p64 ? UINT64_MAX : (uint64_t)f);
+	case Class_Integer:
+		if (source.tag != Class_Float) return word;
+		if (f <= -0x1p63) return (uint64_t)INT64_MIN;
+		return f >= 0x1p63 ? (uint64_t)INT64_MAX : (uint64_t)(int64_t)f;
+	case Class_Float:
+		if (target.basic_size == 4) f = (float)f;
+		return ct_word_f64(f);
+	default:
+		return word;
+	}
+}
+
+
+
+// INTERPRETER
+// operations are dispatched with computed gotos, every operation jumps to the
+// next one by itself. operands of the operations:
+//   Push                  class, constant
+//   Alloc                 class of elements, pops the element count, pushes a pointer
+//   MemLoad               class, pops a pointer
+//   MemStore              class, pops the value and the pointer
+//   MemCopy               count bytes, pops the source and the destination
+//   MemSet                count bytes, pops the byte and the destination
+//   MemComp               count bytes, pops two pointers, pushes -1, 0 or 1
+//   Load, Store           count is the local
+//   LoadField, StoreField class, offset
+//   LoadIndex, StoreIndex class of elements, pops the index under the value
+//   Reassign              stores the top to the local, the top stays
+//   Pop                   count values
+//   Address               pushes a pointer to the local
+//   ZeroExtend            count bytes of the top
+//   SignExtend            count bytes of the top
+//   ConvertFloat          class of the result and class of the value
+//   *ExtendVariable       count is the local, bytes are in the next node
+//   Jump*                 instruction in the next node, an offset from the jump in
+//                         linear bodies
+//   Call                  count arguments, header of the procedure in the next node
+//   Return                count of returned words, 0 or 1
+// procedures run only when they are marked as const. linear bodies step over
+// the operands to the next instruction, bodies that were not linearized
+// follow inext, calls must go to procedures of the same layout. the result is
+// the returned word, 0 for procedures that return nothing
+static const char *ct_run(
+	CtMachine *m, uint32_t proc, const uint64_t *args, uint64_t *result
+){
+	const BcNode *bc = m->ctx->bc;
+	const BcProcHeader *header = bc_proc_header(m->ctx, proc);
+	if (!header->is_const) return "procedure cannot run at compile time";
+	const bool linear = header->is_linear;
+
+	uint64_t *sp = m->stack;
+	uint64_t *const stack_end = m->stack + CT_STACK_CAPACITY;
+	uint64_t *base = sp;
+	uint32_t frame_count = 0;
+	uint64_t steps_left = m->step_limit;
+	const char *error = NULL;
+	const BcNode *ip = bc + proc + 1;
+	memcpy(sp, args, header->arg_count*sizeof(uint64_t));
+	sp += header->arg_count;
+
+	static const void *const dispatch[] = {
+		[BC_Data]      = &&Op_Unsupported,
+		[BC_Static]    = &&Op_Unsupported,
+		[BC_GhostData] = &&Op_Unsupported,
+		[BC_RawData]   = &&Op_Unsupported,
+		[BC_Zeros]     = &&Op_Unsupported,
+		[BC_Pack]      = &&Op_Unsupported,
+		[BC_Merge]     = &&Op_Unsupported,
+
+		[BC_Push]       = &&Op_Push,
+		[BC_Alloc]      = &&Op_Alloc,
+		[BC_MemLoad]    = &&Op_MemLoad,
+		[BC_MemStore]   = &&Op_MemStore,
+		[BC_MemCopy]    = &&Op_MemCopy,
+		[BC_MemSet]     = &&Op_MemSet,
+		[BC_MemComp]    = &&Op_MemComp,
+		[BC_Load]       = &&Op_Load,
+		[BC_LoadField]  = &&Op_LoadField,
+		[BC_LoadIndex]  = &&Op_LoadIndex,
+		[BC_Store]      = &&Op_Store,
+		[BC_StoreField] = &&Op_StoreField,
+		[BC_StoreIndex] = &&Op_StoreIndex,
+		[BC_Reassign]   = &&Op_Reassign,
+		[BC_Pop]        = &&Op_Pop,
+		[BC_Address]    = &&Op_Address,
+
+		[BC_Bitcast]             = &&Op_Bitcast,
+		[BC_ZeroExtend]          = &&Op_ZeroExtend,
+		[BC_SignExtend]          = &&Op_SignExtend,
+		[BC_ConvertFloat]        = &&Op_ConvertFloat,
+		[BC_ZeroExtendVariable]  = &&Op_ZeroExtendVariable,
+		[BC_SignExtendVariable]  = &&Op_SignExtendVariable,
+
+		[BC_Add]              = &&Op_Add,
+		[BC_Subtract]         = &&Op_Subtract,
+		[BC_Multiply]         = &&Op_Multiply,
+		[BC_Divide]           = &&Op_Divide,
+		[BC_DivideSigned]     = &&Op_DivideSigned,
+		[BC_Modulo]           = &&Op_Modulo,
+		[BC_ModuloSigned]     = &&Op_ModuloSigned,
+		[BC_Negate]           = &&Op_Negate,
+		[BC_BitAnd]           = &&Op_BitAnd,
+		[BC_BitOr]            = &&Op_BitOr,
+		[BC_BitXor]           = &&Op_BitXor,
+		[BC_BitNot]           = &&Op_BitNot,
+		[BC_ShiftLeft]        = &&Op_ShiftLeft,
+		[BC_ShiftRight]       = &&Op_ShiftRight,
+		[BC_ShiftRightSigned] = &&Op_ShiftRightSigned,
+
+		[BC_AddFloat]      = &&Op_AddFloat,
+		[BC_SubtractFloat] = &&Op_SubtractFloat,
+		[BC_MultiplyFloat] = &&Op_MultiplyFloat,
+		[BC_DivideFloat]   = &&Op_DivideFloat,
+
+		[BC_Equal]            = &&Op_Equal,
+		[BC_NotEqual]         = &&Op_NotEqual,
+		[BC_Less]             = &&Op_Less,
+		[BC_LessSigned]       = &&Op_LessSigned,
+		[BC_LessEqual]        = &&Op_LessEqual,
+		[BC_LessEqualSigned]  = &&Op_LessEqualSigned,
+		[BC_LessFloat]        = &&Op_LessFloat,
+		[BC_LessEqualFloat]   = &&Op_LessEqualFloat,
+
+		[BC_Jump]          = &&Op_Jump,
+		[BC_JumpIfZero]    = &&Op_JumpIfZero,
+		[BC_JumpIfNotZero] = &&Op_JumpIfNotZero,
+		[BC_Call]          = &&Op_Call,
+		[BC_Return]        = &&Op_Return,
+	};
+	_Static_assert(SIZE(dispatch) == BC_Return+1, "every operation needs a label");
+
+#define DISPATCH()  goto *dispatch[ip->type]
+#define NEXT(operand_count) { ip = linear ? ip + 1 + (operand_count) : bc + ip->inext; DISPATCH(); }
+#define JUMP()      { ip = linear ? ip + ip[1].data.i64 : bc + ip[1].data.u64; DISPATCH(); }
+#define FAIL(msg)   { error = msg; goto Fail; }
+#define PUSH(value) { if (sp == stack_end) FAIL("compile time stack overflow"); *sp = (value); sp += 1; }
+#define BINARY(expr) { uint64_t a = sp[-2], b = sp[-1]; (void)a; (void)b; sp[-2] = (expr); sp -= 1; NEXT(0); }
+#define TAKE_STEP() if (steps_left-- == 0) FAIL("compile time execution takes too long")
+
+	DISPATCH();
+
+Op_Unsupported:
+	FAIL("operation cannot run at compile time");
+
+Op_Push:
+	PUSH(ip[2].data.u64);
+	NEXT(2);
+
+Op_Alloc:{
+	uint64_t elem_size = get_bytesize(m->ctx, ip[1].clas);
+	uint64_t count = sp[-1];
+	if (elem_size != 0 && count > UINT32_MAX/elem_size) FAIL("compile time allocation is too big");
+	sp[-1] = ct_heap_alloc(m, count*elem_size);
+	NEXT(1);
+}
+
+Op_MemLoad:{
+	Class cl = ip[1].clas;
+	if (!ct_is_basic(cl)) FAIL("only basic values are loaded at compile time");
+	const uint8_t *data = ct_resolve(m, sp[-1], 0, cl.basic_size, sp);
+	if (data == NULL) FAIL("compile time load is out of bounds");
+	sp[-1] = ct_load(data, cl);
+	NEXT(1);
+}
+
+Op_MemStore:{
+	Class cl = ip[1].clas;
+	if (!ct_is_basic(cl)) FAIL("only basic values are stored at compile time");
+	uint8_t *data = ct_resolve(m, sp[-2], 0, cl.basic_size, sp);
+	if (data == NULL) FAIL("compile time store is out of bounds");
+	ct_store(data, sp[-1], cl);
+	sp -= 2;
+	NEXT(1);
+}
+
+Op_MemCopy:{
+	const uint8_t *src = ct_resolve(m, sp[-1], 0, ip->count, sp);
+	uint8_t *dst = ct_resolve(m, sp[-2], 0, ip->count, sp);
+	if (src == NULL || dst == NULL) FAIL("compile time copy is out of bounds");
+	memmove(dst, src, ip->count);
+	sp -= 2;
+	NEXT(0);
+}
+
+Op_MemSet:{
+	uint8_t *dst = ct_resolve(m, sp[-2], 0, ip->count, sp);
+	if (dst == NULL) FAIL("compile time memset is out of bounds");
+	memset(dst, (uint8_t)sp[-1], ip->count);
+	sp -= 2;
+	NEXT(0);
+}
+
+Op_MemComp:{
+	const uint8_t *a = ct_resolve(m, sp[-2], 0, ip->count, sp);
+	const uint8_t *b = ct_resolve(m, sp[-1], 0, ip->count, sp);
+	if (a == NULL || b == NULL) FAIL("compile time comparison is out of bounds");
+	int cmp = memcmp(a, b, ip->count);
+	sp[-2] = (uint64_t)(int64_t)((cmp > 0) - (cmp < 0));
+	sp -= 1;
+	NEXT(0);
+}
+
+Op_Load:
+	PUSH(base[ip->count]);
+	NEXT(0);
+
+Op_LoadField:{
+	Class cl = ip[1].clas;
+	if (!ct_is_basic(cl)) FAIL("only basic values are loaded at compile time");
+	const uint8_t *data = ct_resolve(m, sp[-1], ip[2].data.u64, cl.basic_size, sp);
+	if (data == NULL) FAIL("compile time load is out of bounds");
+	sp[-1] = ct_load(data, cl);
+	NEXT(2);
+}
+
+Op_LoadIndex:{
+	Class cl = ip[1].clas;
+	if (!ct_is_basic(cl)) FAIL("only basic values are loaded at compile time");
+	uint64_t index = sp[-1];
+	if (index > UINT32_MAX) FAIL("compile time index is out of bounds");
+	const uint8_t *data = ct_resolve(m, sp[-2], index*cl.basic_size, cl.basic_size, sp);
+	if (data == NULL) FAIL("compile time index is out of bounds");
+	sp[-2] = ct_load(data, cl);
+	sp -= 1;
+	NEXT(1);
+}
+
+Op_Store:
+	base[ip->count] = sp[-1];
+	sp -= 1;
+	NEXT(0);
+
+Op_StoreField:{
+	Class cl = ip[1].clas;
+	if (!ct_is_basic(cl)) FAIL("only basic values are stored at compile time");
+	uint8_t *data = ct_resolve(m, sp[-2], ip[2].data.u64, cl.basic_size, sp);
+	if (data == NULL) FAIL("compile time store is out of bounds");
+	ct_store(data, sp[-1], cl);
+	sp -= 2;
+	NEXT(2);
+}
+
+Op_StoreIndex:{
+	Class cl = ip[1].clas;
+	if (!ct_is_basic(cl)) FAIL("only basic values are stored at compile time");
+	uint64_t index = sp[-2];
+	if (index > UINT32_MAX) FAIL("compile time index is out of bounds");
+	uint8_t *data = ct_resolve(m, sp[-3], index*cl.basic_size, cl.basic_size, sp);
+	if (data == NULL) FAIL("compile time index is out of bounds");
+	ct_store(data, sp[-1], cl);
+	sp -= 3;
+	NEXT(1);
+}
+
+Op_Reassign:
+	base[ip->count] = sp[-1];
+	NEXT(0);
+
+Op_Pop:
+	sp -= ip->count;
+	NEXT(0);
+
+Op_Address:{
+	CtPointer64 ptr = { .ibase = 0, .idata = (base - m->stack + ip->count)*sizeof(uint64_t) };
+	uint64_t word;
+	memcpy(&word, &ptr, sizeof(word));
+	PUSH(word);
+	NEXT(0);
+}
+
+Op_Bitcast:
+	NEXT(0);
+
+Op_ZeroExtend:
+	sp[-1] = ct_zero_extend(sp[-1], ip->count);
+	NEXT(0);
+
+Op_SignExtend:
+	sp[-1] = ct_sign_extend(sp[-1], ip->count);
+	NEXT(0);
+
+Op_ConvertFloat:
+	sp[-1] = ct_convert(sp[-1], ip[1].clas, ip[2].clas);
+	NEXT(2);
+
+Op_ZeroExtendVariable:
+	base[ip->count] = ct_zero_extend(base[ip->count], ip[1].data.u64);
+	NEXT(1);
+
+Op_SignExtendVariable:
+	base[ip->count] = ct_sign_extend(base[ip->count], ip[1].data.u64);
+	NEXT(1);
+
+Op_Add:      BINARY(a + b);
+Op_Subtract: BINARY(a - b);
+Op_Multiply: BINARY(a * b);
+Op_Divide:
+	if (sp[-1] == 0) FAIL("division by zero at compile time");
+	BINARY(a / b);
+Op_DivideSigned:
+	if (sp[-1] == 0) FAIL("division by zero at compile time");
+	if ((int64_t)sp[-1] == -1) BINARY(-a);
+	BINARY((uint64_t)((int64_t)a / (int64_t)b));
+Op_Modulo:
+	if (sp[-1] == 0) FAIL("division by zero at compile time");
+	BINARY(a % b);
+Op_ModuloSigned:
+	if (sp[-1] == 0) FAIL("division by zero at compile time");
+	if ((int64_t)sp[-1] == -1) BINARY(0);
+	BINARY((uint64_t)((int64_t)a % (int64_t)b));
+Op_Negate:
+	sp[-1] = -sp[-1];
+	NEXT(0);
+Op_BitAnd: BINARY(a & b);
+Op_BitOr:  BINARY(a | b);
+Op_BitXor: BINARY(a ^ b);
+Op_BitNot:
+	sp[-1] = ~sp[-1];
+	NEXT(0);
+Op_ShiftLeft:        BINARY(b < 64 ? a << b : 0);
+Op_ShiftRight:       BINARY(b < 64 ? a >> b : 0);
+Op_ShiftRightSigned: BINARY((uint64_t)((int64_t)a >> (b < 64 ? b : 63)));
+
+Op_AddFloat:      BINARY(ct_word_f64(ct_f64(a) + ct_f64(b)));
+Op_SubtractFloat: BINARY(ct_word_f64(ct_f64(a) - ct_f64(b)));
+Op_MultiplyFloat: BINARY(ct_word_f64(ct_f64(a) * ct_f64(b)));
+Op_DivideFloat:   BINARY(ct_word_f64(ct_f64(a) / ct_f64(b)));
+
+Op_Equal:           BINARY(a == b);
+Op_NotEqual:        BINARY(a != b);
+Op_Less:            BINARY(a < b);
+Op_LessSigned:      BINARY((int64_t)a < (int64_t)b);
+Op_LessEqual:       BINARY(a <= b);
+Op_LessEqualSigned: BINARY((int64_t)a <= (int64_t)b);
+Op_LessFloat:       BINARY(ct_f64(a) < ct_f64(b));
+Op_LessEqualFloat:  BINARY(ct_f64(a) <= ct_f64(b));
+
+Op_Jump:
+	TAKE_STEP();
+	JUMP();
+
+Op_JumpIfZero:
+	sp -= 1;
+	if (*sp != 0) NEXT(1);
+	TAKE_STEP();
+	JUMP();
+
+Op_JumpIfNotZero:
+	sp -= 1;
+	if (*sp == 0) NEXT(1);
+	TAKE_STEP();
+	JUMP();
+
+Op_Call:{
+	TAKE_STEP();
+	uint32_t callee = ip[1].data.u64;
+	const BcProcHeader *callee_header = bc_proc_header(m->ctx, callee);
+	if (!callee_header->is_const) FAIL("procedure cannot run at compile time");
+	if (callee_header->is_linear != linear) FAIL("called procedure has another layout");
+	if (frame_count == CT_FRAME_CAPACITY) FAIL("compile time calls are nested too deep");
+	m->frames[frame_count] = (CtFrame){ .ret = ip, .base = base - m->stack };
+	frame_count += 1;
+	base = sp - ip->count;
+	ip = bc + callee + 1;
+	DISPATCH();
+}
+
+Op_Return:{
+	// the caller gets the returned word in place of the arguments
+	uint32_t returned = ip->count != 0;
+	uint64_t value = returned ? sp[-1] : 0;
+	sp = base;
+	if (frame_count == 0){
+		*result = value;
+		return NULL;
+	}
+	frame_count -= 1;
+	CtFrame frame = m->frames[frame_count];
+	base = m->stack + frame.base;
+	ip = frame.ret;
+	*sp = value;
+	sp += returned;
+	NEXT(1);
+}
+
+Fail:
+	m->error_ip = ip;
+	return error;
+
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+#undef FAIL
+#undef PUSH
+#undef BINARY
+#undef TAKE_STEP
+}
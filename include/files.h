@@ -1,16 +1,25 @@
 #pragma once
 
 #include "utils.h"
+#include "memtags.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 
+#include <errno.h>
+#include <unistd.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/fcntl.h>
 
-#ifndef FILES_EXPECTED_LENGTH
-	#define FILES_EXPECTED_LENGTH 64
+// zero bytes placed after the text
+#ifndef FILES_PADDING
+	#define FILES_PADDING 64
+#endif
+
+// minimal size of a single read
+#ifndef FILES_CHUNK_SIZE
+	#define FILES_CHUNK_SIZE (1 << 20)
 #endif
 
 
@@ -20,6 +29,13 @@ typedef struct{
 } StringView;
 
 
+static size_t files_map_size(size_t size){
+	return util_alignsize(size + FILES_PADDING + 1, sysconf(_SC_PAGESIZE));
+}
+
+// maps the file followed by at least FILES_PADDING zero bytes, the padding is
+// an anonymous mapping placed right after the file pages, so nothing is copied.
+// the result must be released with unmap_file
 StringView mmap_file(const char *path){
 	StringView res = {};
 	int fd = open(path, O_RDONLY);
@@ -27,39 +43,107 @@ StringView mmap_file(const char *path){
 
 	struct stat s;
 	int status = fstat(fd, &s);
-	if (status != 0 || !S_ISREG(s.st_mode)) return res;
-	
-	res.data = (char *)mmap(0, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (status != 0 || !S_ISREG(s.st_mode)){
+		close(fd);
+		return res;
+	}
+
+	size_t map_size = files_map_size(s.st_size);
+	char *data = mmap(0, map_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (data == MAP_FAILED){
+		close(fd);
+		return res;
+	}
+	if (s.st_size != 0){
+		// the kernel fills the rest of the last file page with zeros
+		void *file_data = mmap(
+			data, s.st_size, PROT_READ, MAP_PRIVATE | MAP_FIXED | MAP_POPULATE, fd, 0
+		);
+		if (file_data == MAP_FAILED){
+			munmap(data, map_size);
+			close(fd);
+			return res;
+		}
+		madvise(data, s.st_size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+	memory_track(MemTag_Source, map_size);
+
+	res.data = data;
 	res.size = s.st_size;
 	return res;
 }
 
+void unmap_file(StringView text){
+	if (text.data == NULL) return;
+	size_t map_size = files_map_size(text.size);
+	munmap(text.data, map_size);
+	memory_track(MemTag_Source, -(int64_t)map_size);
+}
+
 
 
+// reads the whole stream, the text is followed by FILES_PADDING zero bytes, so
+// the lexer can rely on the null terminator and read a bit past the end.
+// the stream must not have been read through stdio before, since this reads
+// its descriptor directly to avoid copying through the stdio buffer,
+// the result must be released with free_file
 StringView read_file(FILE *input){
-	size_t capacity = FILES_EXPECTED_LENGTH;
+	int fd = fileno(input);
+	size_t capacity = FILES_CHUNK_SIZE;
+
+	struct stat s;
+	if (fstat(fd, &s) == 0){
+		if (S_ISREG(s.st_mode)){
+			// one read is enough for regular files, with a spare byte the read
+			// that sees the end has room and the buffer doesn't grow
+			off_t offset = lseek(fd, 0, SEEK_CUR);
+			if (offset != -1 && s.st_size > offset){
+				capacity = (size_t)(s.st_size - offset) + FILES_PADDING + 2;
+			}
+		} else if (S_ISFIFO(s.st_mode)){
+			// bigger pipe means fewer wakeups, it is fine if this fails
+			fcntl(fd, F_SETPIPE_SZ, FILES_CHUNK_SIZE);
+		}
+	}
+
 	StringView res = {malloc(capacity), 0};
 	if (res.data == NULL) return res;
-	
-	for (;;){
-		int c = getc(input);
-		UNLIKELY if (c == EOF) break;
 
-		if (res.size == capacity-1){
-			char *new_data = realloc(res.data, res.size*2);
+	for (;;){
+		if (capacity - res.size == FILES_PADDING + 1){
+			size_t new_capacity = 2*capacity;
+			char *new_data = realloc(res.data, new_capacity);
 			if (new_data == NULL){
 				free(res.data);
-				res.data = new_data;
-				break;
+				res.data = NULL;
+				return res;
 			}
 			res.data = new_data;
-			capacity = res.size*2;
+			capacity = new_capacity;
 		}
 
-		res.data[res.size] = (char)c;
-		res.size += 1;
+		ssize_t received = read(fd, res.data+res.size, capacity-res.size-FILES_PADDING-1);
+		if (received == 0) break;
+		UNLIKELY if (received < 0){
+			if (errno == EINTR) continue;
+			free(res.data);
+			res.data = NULL;
+			return res;
+		}
+		res.size += received;
 	}
 
-	res.data[res.size] = '\0';
+	memset(res.data+res.size, 0, FILES_PADDING + 1);
+	// give back the unused part, so the accounted size is known when freeing
+	char *fitted = realloc(res.data, res.size + FILES_PADDING + 1);
+	if (fitted != NULL) res.data = fitted;
+	memory_track(MemTag_Source, res.size + FILES_PADDING + 1);
 	return res;
 }
+
+void free_file(StringView text){
+	if (text.data == NULL) return;
+	memory_track(MemTag_Source, -(int64_t)(text.size + FILES_PADDING + 1));
+	free(text.data);
+}
@@ -0,0 +1,324 @@
+#pragma once
+
+#include "utils.h"
+
+#include <stdlib.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+
+
+// JOB SCHEDULER
+// every worker owns a chase-lev deque, it pushes and pops jobs at the bottom
+// and idle workers steal the oldest jobs from the top of other deques, so big
+// pieces of work are split by the thieves while the owner works depth first.
+// the thread that starts the scheduler is worker 0 and runs jobs only while
+// it waits for them.
+// a job is finished when its procedure returned and all its children are
+// finished, then its continuation is submitted and its parent is notified.
+// jobs are not allocated by the scheduler, they must stay alive until they
+// finish
+#define JOB_WORKER_MAX     64
+#define JOB_DEQUE_CAPACITY 4096 // must be a power of 2
+#define JOB_SPIN_ROUNDS    64   // failed steal rounds before a worker sleeps
+
+typedef struct Job Job;
+typedef void (*JobProc)(Job *job, uint32_t worker);
+
+struct Job{
+	JobProc proc;
+	void *data;
+	Job *parent;
+	Job *continuation;
+	_Atomic uint32_t unfinished; // 1 for the job itself and 1 for every child
+};
+
+typedef struct{
+	alignas(64) _Atomic int64_t top;
+	alignas(64) _Atomic int64_t bottom;
+	_Atomic(Job *) jobs[JOB_DEQUE_CAPACITY];
+
+	uint64_t random; // victim selection, used only by the owner
+	size_t executed;
+	size_t stolen;
+} JobDeque;
+
+typedef struct JobScheduler JobScheduler;
+
+typedef struct{
+	JobScheduler *scheduler;
+	uint32_t index;
+} JobWorker;
+
+struct JobScheduler{
+	JobDeque *deques;
+	uint32_t worker_count;
+
+	// sleeping workers are woken up when jobs are submitted
+	_Atomic uint32_t sleeping;
+	_Atomic bool stop;
+	pthread_mutex_t lock;
+	pthread_cond_t wake_cond;
+
+	pthread_t threads[JOB_WORKER_MAX];
+	JobWorker workers[JOB_WORKER_MAX];
+
+	// summed over the workers when the scheduler is freed
+	size_t executed;
+	size_t stolen;
+};
+
+static _Thread_local uint32_t job_worker_index = UINT32_MAX;
+
+
+
+// DEQUE
+// follows the c11 version of the deque by Le, Pop, Cohen and Zappa Nardelli,
+// push publishes with a release store instead of a fence
+
+static bool job_deque_push(JobDeque *d, Job *job){
+	int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+	int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+	if (b - t >= JOB_DEQUE_CAPACITY) return false;
+	atomic_store_explicit(d->jobs + (b & (JOB_DEQUE_CAPACITY-1)), job, memory_order_relaxed);
+	atomic_store_explicit(&d->bottom, b+1, memory_order_release);
+	return true;
+}
+
+static Job *job_deque_pop(JobDeque *d){
+	int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+	atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	int64_t t = atomic_load_explicit(&d->top, memory_order_relaxed);
+	if (t > b){
+		atomic_store_explicit(&d->bottom, b+1, memory_order_relaxed);
+		return NULL;
+	}
+	Job *job = atomic_load_explicit(d->jobs + (b & (JOB_DEQUE_CAPACITY-1)), memory_order_relaxed);
+	if (t == b){
+		// the last job, race with the thieves
+		if (!atomic_compare_exchange_strong_explicit(
+			&d->top, &t, t+1, memory_order_seq_cst, memory_order_relaxed
+		)) job = NULL;
+		atomic_store_explicit(&d->bottom, b+1, memory_order_relaxed);
+	}
+	return job;
+}
+
+static Job *job_deque_steal(JobDeque *d){
+	int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	int64_t b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+	if (t >= b) return NULL;
+	Job *job = atomic_load_explicit(d->jobs + (t & (JOB_DEQUE_CAPACITY-1)), memory_order_relaxed);
+	if (!atomic_compare_exchange_strong_explicit(
+		&d->top, &t, t+1, memory_order_seq_cst, memory_order_relaxed
+	)) return NULL;
+	return job;
+}
+
+static bool job_deque_is_empty(JobDeque *d){
+	int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+	int64_t b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+	return t >= b;
+}
+
+
+
+// SCHEDULING
+
+static void job_execute(JobScheduler *s, Job *job, uint32_t worker);
+
+static void job_init(Job *job, JobProc proc, void *data, Job *parent){
+	*job = (Job){ .proc = proc, .data = data, .parent = parent, .unfinished = 1 };
+	if (parent != NULL){
+		atomic_fetch_add_explicit(&parent->unfinished, 1, memory_order_relaxed);
+	}
+}
+
+// the continuation is submitted when the job and its children are finished,
+// it must be set before the job is submitted. a parent that should wait for
+// the continuation must be given to its job_init
+static void job_then(Job *job, Job *continuation){
+	job->continuation = continuation;
+}
+
+// can be called only from workers, that is from procedures of jobs and from
+// the thread that started the scheduler
+static void job_submit(JobScheduler *s, Job *job){
+	uint32_t worker = job_worker_index;
+	assert(worker < s->worker_count && "jobs can be submitted only by workers");
+	if (!job_deque_push(s->deques + worker, job)){
+		// the deque is full, there is enough work for everyone
+		job_execute(s, job, worker);
+		return;
+	}
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(&s->sleeping, memory_order_relaxed) != 0){
+		pthread_mutex_lock(&s->lock);
+		pthread_cond_signal(&s->wake_cond);
+		pthread_mutex_unlock(&s->lock);
+	}
+}
+
+static void job_finish(JobScheduler *s, Job *job){
+	for (;;){
+		// the job can be released by a waiting thread right after the decrement
+		Job *parent = job->parent;
+		Job *continuation = job->continuation;
+		if (atomic_fetch_sub_explicit(&job->unfinished, 1, memory_order_acq_rel) != 1) return;
+		if (continuation != NULL) job_submit(s, continuation);
+		if (parent == NULL) return;
+		job = parent;
+	}
+}
+
+static void job_execute(JobScheduler *s, Job *job, uint32_t worker){
+	job->proc(job, worker);
+	s->deques[worker].executed += 1;
+	job_finish(s, job);
+}
+
+static uint64_t job_random(JobDeque *d){
+	d->random ^= d->random >> 12;
+	d->random ^= d->random << 25;
+	d->random ^= d->random >> 27;
+	return d->random * 0x2545F4914F6CDD1Dull;
+}
+
+// own jobs first, then one pass over the other workers from a random victim
+static Job *job_find(JobScheduler *s, uint32_t worker){
+	JobDeque *own = s->deques + worker;
+	Job *job = job_deque_pop(own);
+	if (job != NULL) return job;
+	uint32_t count = s->worker_count;
+	uint32_t first = job_random(own) % count;
+	for (uint32_t i=0; i!=count; i+=1){
+		uint32_t victim = (first + i) % count;
+		if (victim == worker) continue;
+		job = job_deque_steal(s->deques + victim);
+		if (job != NULL){
+			own->stolen += 1;
+			return job;
+		}
+	}
+	return NULL;
+}
+
+static bool job_any_work(JobScheduler *s){
+	for (uint32_t i=0; i!=s->worker_count; i+=1){
+		if (!job_deque_is_empty(s->deques + i)) return true;
+	}
+	return false;
+}
+
+static void *job_worker(void *arg){
+	JobWorker *w = arg;
+	JobScheduler *s = w->scheduler;
+	job_worker_index = w->index;
+
+	uint32_t failed = 0;
+	while (!atomic_load_explicit(&s->stop, memory_order_acquire)){
+		Job *job = job_find(s, w->index);
+		if (job != NULL){
+			job_execute(s, job, w->index);
+			failed = 0;
+			continue;
+		}
+		failed += 1;
+		if (failed < JOB_SPIN_ROUNDS){
+			sched_yield();
+			continue;
+		}
+		// announce the sleep before the last check, submitters check the
+		// counter after pushing, so either side sees the other
+		pthread_mutex_lock(&s->lock);
+		atomic_fetch_add_explicit(&s->sleeping, 1, memory_order_seq_cst);
+		while (!atomic_load_explicit(&s->stop, memory_order_acquire) && !job_any_work(s)){
+			pthread_cond_wait(&s->wake_cond, &s->lock);
+		}
+		atomic_fetch_sub_explicit(&s->sleeping, 1, memory_order_relaxed);
+		pthread_mutex_unlock(&s->lock);
+		failed = 0;
+	}
+	return NULL;
+}
+
+// runs jobs until the counter drops to the limit
+static void job_help_until(JobScheduler *s, Job *job, uint32_t limit){
+	uint32_t worker = job_worker_index;
+	assert(worker < s->worker_count && "jobs can be awaited only by workers");
+	while (atomic_load_explicit(&job->unfinished, memory_order_acquire) > limit){
+		Job *other = job_find(s, worker);
+		if (other != NULL){
+			job_execute(s, other, worker);
+		} else{
+			sched_yield();
+		}
+	}
+}
+
+// waits until a submitted job is finished, other jobs are run meanwhile
+static void job_wait(JobScheduler *s, Job *job){
+	job_help_until(s, job, 0);
+}
+
+// called from the procedure of a job, waits until all children submitted so
+// far are finished
+static void job_wait_children(JobScheduler *s, Job *job){
+	job_help_until(s, job, 1);
+}
+
+
+
+// all submitted jobs must be finished
+static void job_scheduler_free(JobScheduler *s){
+	pthread_mutex_lock(&s->lock);
+	atomic_store_explicit(&s->stop, true, memory_order_release);
+	pthread_cond_broadcast(&s->wake_cond);
+	pthread_mutex_unlock(&s->lock);
+	for (uint32_t i=1; i!=s->worker_count; i+=1){
+		pthread_join(s->threads[i], NULL);
+	}
+	for (uint32_t i=0; i!=s->worker_count; i+=1){
+		s->executed += s->deques[i].executed;
+		s->stolen += s->deques[i].stolen;
+	}
+	pthread_mutex_destroy(&s->lock);
+	pthread_cond_destroy(&s->wake_cond);
+	free(s->deques);
+	job_worker_index = UINT32_MAX;
+}
+
+// starts worker_count-1 threads, the calling thread becomes worker 0.
+// the scheduler must not be moved after initialization
+static bool job_scheduler_init(JobScheduler *s, size_t worker_count){
+	worker_count = util_clamp_usize(worker_count, 1, JOB_WORKER_MAX);
+	*s = (JobScheduler){0};
+	s->deques = aligned_alloc(alignof(JobDeque), worker_count*sizeof(JobDeque));
+	if (s->deques == NULL) return false;
+	for (size_t i=0; i!=worker_count; i+=1){
+		JobDeque *d = s->deques + i;
+		atomic_init(&d->top, 0);
+		atomic_init(&d->bottom, 0);
+		d->random = 0x9E3779B97F4A7C15ull * (i + 1);
+		d->executed = 0;
+		d->stolen = 0;
+	}
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->wake_cond, NULL);
+
+	// workers read the count, so it is set before they start
+	s->worker_count = worker_count;
+	job_worker_index = 0;
+	for (size_t i=1; i!=worker_count; i+=1){
+		s->workers[i] = (JobWorker){ .scheduler = s, .index = i };
+		if (pthread_create(s->threads + i, NULL, job_worker, s->workers + i) != 0){
+			s->worker_count = i;
+			job_scheduler_free(s);
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,456 @@
+#pragma once
+
+#include "utils.h"
+#include "files.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+
+// BATCH FILE LOADER
+// loads a list of files and hands back buffers in order of completion, so the
+// caller can lex a file while the rest are still being read. with io_uring the
+// open, statx, read and close of every file are submitted asynchronously from
+// the calling thread, without it a pool of threads reads files with pread.
+// buffers are followed by FILES_PADDING zero bytes, like in read_file, and
+// are released with free_file
+#define LOADER_QUEUE_DEPTH 256 // io_uring entries, half of them are used for opens
+
+enum LoaderFlags{
+	LoaderFlag_NoUring = 1 << 0, // always use the thread pool
+};
+
+typedef struct{
+	uint32_t index; // position in the path list
+	int      error; // errno value, 0 on success
+	StringView text;
+} LoadedFile;
+
+enum LoaderOp{
+	LoaderOp_Open,
+	LoaderOp_Statx,
+	LoaderOp_Read,
+	LoaderOp_Close
+};
+
+typedef struct{
+	int fd;
+	int error;
+	uint8_t pending; // operations in flight
+	size_t done;     // bytes read
+	StringView text;
+	struct statx stx;
+} LoaderFile;
+
+typedef struct{
+	int fd;
+	uint32_t *sq_head;
+	uint32_t *sq_tail;
+	uint32_t *sq_mask;
+	uint32_t *sq_array;
+	uint32_t  sq_entries;
+	uint32_t  to_submit;
+	struct io_uring_sqe *sqes;
+
+	uint32_t *cq_head;
+	uint32_t *cq_tail;
+	uint32_t *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	void  *sq_ring;
+	size_t sq_ring_size;
+	void  *cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+} LoaderRing;
+
+typedef struct{
+	const char *const *paths;
+	uint32_t count;
+	bool use_uring;
+
+	// files that are ready to be handed back
+	LoadedFile *ready;
+	uint32_t ready_head;
+	uint32_t ready_tail;
+	uint32_t delivered;
+
+	// io_uring state
+	LoaderRing ring;
+	LoaderFile *files;
+	uint32_t next_to_open;
+	uint32_t open_files;
+
+	// thread pool state
+	_Atomic uint32_t next_to_read;
+	pthread_mutex_t lock;
+	pthread_cond_t ready_cond;
+	size_t thread_count;
+	pthread_t threads[64];
+} FileLoader;
+
+
+
+// IO_URING
+static bool loader_ring_init(LoaderRing *r){
+	struct io_uring_params p = {};
+	int fd = syscall(__NR_io_uring_setup, LOADER_QUEUE_DEPTH, &p);
+	if (fd < 0) return false;
+
+	// opcodes used by the loader were added in 5.6, the probe tells if they exist
+	size_t probe_size = sizeof(struct io_uring_probe) + 256*sizeof(struct io_uring_probe_op);
+	struct io_uring_probe *probe = calloc(1, probe_size);
+	bool supported = probe != NULL &&
+		syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+		probe->last_op >= IORING_OP_STATX && probe->last_op >= IORING_OP_READ;
+	if (supported){
+		static const uint8_t Ops[] = {
+			IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE
+		};
+		for (size_t i=0; i!=SIZE(Ops); i+=1){
+			supported &= (probe->ops[Ops[i]].flags & IO_URING_OP_SUPPORTED) != 0;
+		}
+	}
+	free(probe);
+	if (!supported || !(p.features & IORING_FEAT_SINGLE_MMAP)){
+		close(fd);
+		return false;
+	}
+
+	*r = (LoaderRing){ .fd = fd, .sq_entries = p.sq_entries };
+	r->sq_ring_size = p.sq_off.array + p.sq_entries*sizeof(uint32_t);
+	r->cq_ring_size = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+	if (r->cq_ring_size > r->sq_ring_size) r->sq_ring_size = r->cq_ring_size;
+	r->cq_ring_size = r->sq_ring_size;
+
+	uint8_t *ring = mmap(
+		NULL, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		fd, IORING_OFF_SQ_RING
+	);
+	if (ring == MAP_FAILED){
+		close(fd);
+		return false;
+	}
+	r->sqes_size = p.sq_entries*sizeof(struct io_uring_sqe);
+	r->sqes = mmap(
+		NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		fd, IORING_OFF_SQES
+	);
+	if (r->sqes == MAP_FAILED){
+		munmap(ring, r->sq_ring_size);
+		close(fd);
+		return false;
+	}
+	r->sq_ring = ring;
+	r->cq_ring = ring;
+	r->sq_head  = (uint32_t *)(ring + p.sq_off.head);
+	r->sq_tail  = (uint32_t *)(ring + p.sq_off.tail);
+	r->sq_mask  = (uint32_t *)(ring + p.sq_off.ring_mask);
+	r->sq_array = (uint32_t *)(ring + p.sq_off.array);
+	r->cq_head  = (uint32_t *)(ring + p.cq_off.head);
+	r->cq_tail  = (uint32_t *)(ring + p.cq_off.tail);
+	r->cq_mask  = (uint32_t *)(ring + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+	return true;
+}
+
+static void loader_ring_free(LoaderRing *r){
+	munmap(r->sqes, r->sqes_size);
+	munmap(r->sq_ring, r->sq_ring_size);
+	close(r->fd);
+}
+
+// submits queued entries and waits for at least min_complete completions
+static int loader_ring_enter(LoaderRing *r, uint32_t min_complete){
+	int res;
+	do{
+		res = syscall(
+			__NR_io_uring_enter, r->fd, r->to_submit, min_complete,
+			min_complete != 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0
+		);
+	} while (res < 0 && errno == EINTR);
+	if (res > 0) r->to_submit -= util_min_u32(res, r->to_submit);
+	return res;
+}
+
+static struct io_uring_sqe *loader_ring_sqe(LoaderRing *r){
+	uint32_t tail = *r->sq_tail;
+	while (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) == r->sq_entries){
+		// the queue is full, so hand the entries to the kernel
+		loader_ring_enter(r, 0);
+	}
+	uint32_t index = tail & *r->sq_mask;
+	struct io_uring_sqe *sqe = r->sqes + index;
+	*sqe = (struct io_uring_sqe){};
+	r->sq_array[index] = index;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	r->to_submit += 1;
+	return sqe;
+}
+
+static void loader_submit(
+	FileLoader *l, uint32_t index, enum LoaderOp op, uint8_t opcode
+){
+	LoaderFile *f = l->files + index;
+	struct io_uring_sqe *sqe = loader_ring_sqe(&l->ring);
+	sqe->opcode = opcode;
+	sqe->user_data = (uint64_t)index << 2 | op;
+	switch (op){
+	case LoaderOp_Open:
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uint64_t)l->paths[index];
+		sqe->open_flags = O_RDONLY | O_CLOEXEC;
+		break;
+	case LoaderOp_Statx:
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uint64_t)l->paths[index];
+		sqe->len = STATX_SIZE;
+		sqe->off = (uint64_t)&f->stx;
+		sqe->statx_flags = AT_STATX_SYNC_AS_STAT;
+		break;
+	case LoaderOp_Read:
+		sqe->fd = f->fd;
+		sqe->addr = (uint64_t)(f->text.data + f->done);
+		sqe->len = f->text.size - f->done;
+		sqe->off = f->done;
+		break;
+	case LoaderOp_Close:
+		sqe->fd = f->fd;
+		break;
+	}
+	if (op != LoaderOp_Close) f->pending += 1;
+}
+
+static void loader_finish(FileLoader *l, uint32_t index){
+	LoaderFile *f = l->files + index;
+	if (f->fd >= 0){
+		loader_submit(l, index, LoaderOp_Close, IORING_OP_CLOSE);
+		f->fd = -1;
+	}
+	if (f->error != 0){
+		free(f->text.data);
+		f->text = (StringView){};
+	} else{
+		f->text.size = f->done;
+		memset(f->text.data + f->text.size, 0, FILES_PADDING + 1);
+		memory_track(MemTag_Source, f->text.size + FILES_PADDING + 1);
+	}
+	l->ready[l->ready_tail] = (LoadedFile){
+		.index = index, .error = f->error, .text = f->text
+	};
+	l->ready_tail += 1;
+	l->open_files -= 1;
+}
+
+static void loader_complete(FileLoader *l, const struct io_uring_cqe *cqe){
+	uint32_t index = cqe->user_data >> 2;
+	enum LoaderOp op = cqe->user_data & 3;
+	LoaderFile *f = l->files + index;
+	if (op == LoaderOp_Close) return;
+	f->pending -= 1;
+
+	switch (op){
+	case LoaderOp_Open:
+		if (cqe->res < 0){ f->error = -cqe->res; } else{ f->fd = cqe->res; }
+		break;
+	case LoaderOp_Statx:
+		if (cqe->res < 0) f->error = -cqe->res;
+		break;
+	case LoaderOp_Read:
+		if (cqe->res < 0){
+			if (cqe->res == -EINTR || cqe->res == -EAGAIN){
+				loader_submit(l, index, LoaderOp_Read, IORING_OP_READ);
+				return;
+			}
+			f->error = -cqe->res;
+		} else if (cqe->res == 0){
+			// the file got shorter, keep what was read
+			f->text.size = f->done;
+		} else{
+			f->done += cqe->res;
+			if (f->done != f->text.size){
+				loader_submit(l, index, LoaderOp_Read, IORING_OP_READ);
+				return;
+			}
+		}
+		loader_finish(l, index);
+		return;
+	default: return;
+	}
+
+	// both open and statx are done
+	if (f->pending != 0) return;
+	if (f->error != 0){
+		loader_finish(l, index);
+		return;
+	}
+	size_t size = f->stx.stx_size;
+	f->text.data = malloc(size + FILES_PADDING + 1);
+	if (f->text.data == NULL){
+		f->error = ENOMEM;
+		loader_finish(l, index);
+		return;
+	}
+	f->text.size = size;
+	if (size == 0){
+		loader_finish(l, index);
+		return;
+	}
+	loader_submit(l, index, LoaderOp_Read, IORING_OP_READ);
+}
+
+static bool loader_uring_next(FileLoader *l){
+	while (l->ready_head == l->ready_tail){
+		// every file in flight can need two entries at once
+		while (l->next_to_open != l->count && l->open_files < LOADER_QUEUE_DEPTH/4){
+			uint32_t index = l->next_to_open;
+			l->files[index] = (LoaderFile){ .fd = -1 };
+			loader_submit(l, index, LoaderOp_Open, IORING_OP_OPENAT);
+			loader_submit(l, index, LoaderOp_Statx, IORING_OP_STATX);
+			l->next_to_open += 1;
+			l->open_files += 1;
+		}
+		if (loader_ring_enter(&l->ring, 1) < 0) return false;
+
+		LoaderRing *r = &l->ring;
+		uint32_t head = *r->cq_head;
+		uint32_t tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+		for (; head!=tail; head+=1){
+			loader_complete(l, r->cqes + (head & *r->cq_mask));
+		}
+		__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+	}
+	return true;
+}
+
+
+
+// THREAD POOL
+static int loader_read_file(const char *path, StringView *res){
+	*res = (StringView){};
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return errno;
+	struct stat s;
+	if (fstat(fd, &s) != 0){
+		int error = errno;
+		close(fd);
+		return error;
+	}
+	char *data = malloc(s.st_size + FILES_PADDING + 1);
+	if (data == NULL){
+		close(fd);
+		return ENOMEM;
+	}
+	size_t done = 0;
+	while (done != (size_t)s.st_size){
+		ssize_t received = pread(fd, data + done, s.st_size - done, done);
+		if (received == 0) break; // the file got shorter
+		if (received < 0){
+			if (errno == EINTR) continue;
+			int error = errno;
+			free(data);
+			close(fd);
+			return error;
+		}
+		done += received;
+	}
+	close(fd);
+	memset(data + done, 0, FILES_PADDING + 1);
+	memory_track(MemTag_Source, done + FILES_PADDING + 1);
+	*res = (StringView){ data, done };
+	return 0;
+}
+
+static void *loader_thread(void *arg){
+	FileLoader *l = arg;
+	for (;;){
+		uint32_t index = atomic_fetch_add(&l->next_to_read, 1);
+		if (index >= l->count) break;
+		LoadedFile file = { .index = index };
+		file.error = loader_read_file(l->paths[index], &file.text);
+
+		pthread_mutex_lock(&l->lock);
+		l->ready[l->ready_tail] = file;
+		l->ready_tail += 1;
+		pthread_cond_signal(&l->ready_cond);
+		pthread_mutex_unlock(&l->lock);
+	}
+	return NULL;
+}
+
+
+
+// LOADER INTERFACE
+// paths must stay valid until file_loader_free, thread_count is used only
+// by the thread pool
+static bool file_loader_init(
+	FileLoader *l, const char *const *paths, uint32_t count,
+	size_t thread_count, uint32_t flags
+){
+	*l = (FileLoader){ .paths = paths, .count = count };
+	l->ready = malloc(count*sizeof(LoadedFile) + 1);
+	if (l->ready == NULL) return false;
+
+	if (!(flags & LoaderFlag_NoUring) && loader_ring_init(&l->ring)){
+		l->files = malloc(count*sizeof(LoaderFile) + 1);
+		if (l->files != NULL){
+			l->use_uring = true;
+			return true;
+		}
+		loader_ring_free(&l->ring);
+	}
+
+	pthread_mutex_init(&l->lock, NULL);
+	pthread_cond_init(&l->ready_cond, NULL);
+	thread_count = util_clamp_usize(thread_count, 1, SIZE(l->threads));
+	for (size_t i=0; i!=thread_count; i+=1){
+		if (pthread_create(l->threads + i, NULL, loader_thread, l) != 0) break;
+		l->thread_count += 1;
+	}
+	if (l->thread_count == 0){
+		free(l->ready);
+		return false;
+	}
+	return true;
+}
+
+// waits for the next loaded file, returns false when all files were handed back
+static bool file_loader_next(FileLoader *l, LoadedFile *res){
+	if (l->delivered == l->count) return false;
+	if (l->use_uring){
+		if (!loader_uring_next(l)) return false;
+	} else{
+		pthread_mutex_lock(&l->lock);
+		while (l->ready_head == l->ready_tail){
+			pthread_cond_wait(&l->ready_cond, &l->lock);
+		}
+		pthread_mutex_unlock(&l->lock);
+	}
+	*res = l->ready[l->ready_head];
+	l->ready_head += 1;
+	l->delivered += 1;
+	return true;
+}
+
+// buffers that were handed back are owned by the caller
+static void file_loader_free(FileLoader *l){
+	if (l->use_uring){
+		// drain files in flight, so the kernel doesn't write into freed memory
+		LoadedFile file;
+		while (file_loader_next(l, &file)) free_file(file.text);
+		loader_ring_enter(&l->ring, 0); // flush pending closes
+		loader_ring_free(&l->ring);
+		free(l->files);
+	} else{
+		for (size_t i=0; i!=l->thread_count; i+=1) pthread_join(l->threads[i], NULL);
+		for (uint32_t i=l->ready_head; i!=l->ready_tail; i+=1) free_file(l->ready[i].text);
+		pthread_mutex_destroy(&l->lock);
+		pthread_cond_destroy(&l->ready_cond);
+	}
+	free(l->ready);
+}
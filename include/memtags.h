@@ -0,0 +1,89 @@
+#pragma once
+
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include <sys/resource.h>
+
+
+// MEMORY ACCOUNTING
+// long lived buffers of the compiler are tagged, current and peak bytes are
+// counted per tag for all threads together. buffers that are reserved up
+// front (bytecode, class info) count only the used part, since untouched
+// pages of a reservation are never backed by memory
+#define MEMORY_TAG_LIST \
+	X(Source)    \
+	X(Ast)       \
+	X(Names)     \
+	X(NameSet)   \
+	X(ArraySet)  \
+	X(TupleSet)  \
+	X(Bytecode)  \
+	X(Classes)   \
+	X(Instances) \
+	X(Calls)     \
+	X(EvalMemo)  \
+	X(Comptime)  \
+	X(Scopes)
+
+#define X(name) MemTag_##name,
+enum MemTag{ MEMORY_TAG_LIST MemTag_Count };
+#undef X
+
+#define X(name) #name,
+static const char *const MemTagNames[] = { MEMORY_TAG_LIST };
+#undef X
+
+static struct{
+	_Atomic int64_t current[MemTag_Count];
+	_Atomic int64_t peak[MemTag_Count];
+	_Atomic int64_t total;
+	_Atomic int64_t total_peak;
+} memory_stats;
+
+
+static void memory_update_peak(_Atomic int64_t *peak, int64_t value){
+	int64_t old = atomic_load_explicit(peak, memory_order_relaxed);
+	while (value > old && !atomic_compare_exchange_weak_explicit(
+		peak, &old, value, memory_order_relaxed, memory_order_relaxed
+	));
+}
+
+// bytes are positive for allocations and negative for releases
+static void memory_track(enum MemTag tag, int64_t bytes){
+	int64_t current = atomic_fetch_add_explicit(
+		&memory_stats.current[tag], bytes, memory_order_relaxed
+	) + bytes;
+	int64_t total = atomic_fetch_add_explicit(
+		&memory_stats.total, bytes, memory_order_relaxed
+	) + bytes;
+	if (bytes > 0){
+		memory_update_peak(&memory_stats.peak[tag], current);
+		memory_update_peak(&memory_stats.total_peak, total);
+	}
+}
+
+// peak resident set size of the process in bytes
+static size_t memory_peak_rss(void){
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+	return (size_t)usage.ru_maxrss * 1024;
+}
+
+static void print_memory_report(FILE *out){
+	fprintf(out, "memory usage          current [KB]     peak [KB]\n");
+	for (size_t i=0; i!=MemTag_Count; i+=1){
+		fprintf(out, "  %-16s%16.1lf%14.1lf\n",
+			MemTagNames[i],
+			(double)atomic_load(&memory_stats.current[i]) / 1024.0,
+			(double)atomic_load(&memory_stats.peak[i]) / 1024.0
+		);
+	}
+	fprintf(out, "  %-16s%16.1lf%14.1lf\n",
+		"total",
+		(double)atomic_load(&memory_stats.total) / 1024.0,
+		(double)atomic_load(&memory_stats.total_peak) / 1024.0
+	);
+	fprintf(out, "  %-16s%30.1lf\n", "peak rss", (double)memory_peak_rss() / 1024.0);
+}
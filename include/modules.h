@@ -0,0 +1,385 @@
+#pragma once
+
+#include "utils.h"
+#include "parser.h"
+#include "files.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+
+// MODULE LOADING
+// modules are lexed and parsed on a pool of workers. a worker collects the
+// imports of a module right after lexing, so imported modules are loaded by
+// other workers while the importer is still being parsed. every module is
+// identified by its canonical path and is loaded exactly once.
+// compiler contexts are not shared between threads, so every worker has its
+// own and names and string data of a module belong to the context of the
+// worker that parsed it
+#define MODULE_COUNT_MAX  UINT16_MAX // module ids are 16 bit, 0 means the current module
+#define MODULE_WORKER_MAX 64
+
+enum ModuleState{
+	ModuleState_Queued,
+	ModuleState_Loading,
+	ModuleState_Parsed,
+	ModuleState_Failed
+};
+
+typedef struct{
+	char *path; // canonical
+	uint64_t path_hash;
+
+	StringView text;
+	AstArray ast;
+	const CompilerContext *ctx;
+
+	uint16_t *imports; // ids of directly imported modules
+	uint32_t import_count;
+
+	// the module that imported this one first, used for reporting unreadable files
+	uint16_t importer;
+	uint32_t import_pos;
+
+	const char *error;
+	uint32_t error_pos;
+
+	uint64_t load_time_ns;
+	_Atomic uint32_t state;
+} Module;
+
+typedef struct ModuleGraph{
+	Module *modules; // module with id i is at index i-1
+	uint32_t size;
+	uint32_t next_to_load; // modules are loaded in order of their ids
+	uint32_t pending;      // queued or loading modules
+
+	// canonical path set, contains indexes+1 of modules
+	uint32_t *set;
+	size_t set_capacity;
+
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond; // a module was queued or workers should stop
+	pthread_cond_t done_cond; // a module was loaded
+	bool stop;
+
+	size_t worker_count;
+	pthread_t workers[MODULE_WORKER_MAX];
+	CompilerContext contexts[MODULE_WORKER_MAX];
+} ModuleGraph;
+
+typedef struct{
+	ModuleGraph *graph;
+	CompilerContext *ctx;
+} ModuleWorker;
+
+
+
+static Module *module_get(ModuleGraph *graph, uint16_t id){
+	assert(id != 0);
+	return graph->modules + id - 1;
+}
+
+static uint64_t module_path_hash(const char *path){
+	// fnv-1a hash
+	uint64_t hash = 0xcbf29ce484222325u;
+	for (const char *it=path; *it!='\0'; it+=1){
+		hash = (hash ^ (uint8_t)*it) * 0x100000001b3u;
+	}
+	return hash;
+}
+
+// returns the id of the module with given canonical path, queues the module
+// if it was not seen before, returns 0 when there are too many modules.
+// graph->lock must be held
+static uint16_t module_graph_add_locked(
+	ModuleGraph *graph, const char *path, uint16_t importer, uint32_t import_pos
+){
+	uint64_t hash = module_path_hash(path);
+	size_t index_mask = graph->set_capacity - 1;
+	size_t index = hash & index_mask;
+	for (size_t i=0;; i+=1){
+		uint32_t entry = graph->set[index];
+		if (entry == 0) break; // module not found
+		const Module *m = graph->modules + entry - 1;
+		if (m->path_hash == hash && strcmp(m->path, path) == 0) return entry;
+		index = (index + i + 1) & index_mask;
+	}
+
+	if (graph->size == MODULE_COUNT_MAX) return 0;
+	char *path_copy = strdup(path);
+	assert(path_copy != NULL && "module allocation failrule");
+
+	graph->size += 1;
+	uint16_t id = graph->size;
+	Module *m = graph->modules + id - 1;
+	*m = (Module){
+		.path = path_copy,
+		.path_hash = hash,
+		.importer = importer,
+		.import_pos = import_pos,
+		.state = ModuleState_Queued
+	};
+	graph->set[index] = id;
+	graph->pending += 1;
+	pthread_cond_signal(&graph->work_cond);
+
+	UNLIKELY if (4*graph->size >= 3*graph->set_capacity){
+		// resize hash table
+		size_t new_capacity = 2*graph->set_capacity;
+		uint32_t *new_set = calloc(new_capacity, sizeof(uint32_t));
+		assert(new_set != NULL && "module allocation failrule");
+		size_t new_index_mask = new_capacity - 1;
+		for (size_t i=0; i!=graph->set_capacity; i+=1){
+			uint32_t entry = graph->set[i];
+			if (entry == 0) continue;
+			size_t elem_index = graph->modules[entry-1].path_hash & new_index_mask;
+			for (size_t i=0;; i+=1){
+				if (new_set[elem_index] == 0) break; // add elem to new table
+				elem_index = (elem_index + i + 1) & new_index_mask;
+			}
+			new_set[elem_index] = entry;
+		}
+		free(graph->set);
+		graph->set = new_set;
+		graph->set_capacity = new_capacity;
+	}
+	return id;
+}
+
+// resolves the imported path relative to the directory of the importer
+static bool module_resolve_path(
+	char *res, const char *importer_path, const char *path, size_t path_size
+){
+	char joined[PATH_MAX];
+	if (path[0] == '/'){
+		if (path_size >= sizeof(joined)) return false;
+		memcpy(joined, path, path_size + 1);
+	} else{
+		const char *slash = strrchr(importer_path, '/');
+		size_t dir_size = slash != NULL ? slash - importer_path + 1 : 0;
+		if (dir_size + path_size >= sizeof(joined)) return false;
+		memcpy(joined, importer_path, dir_size);
+		memcpy(joined + dir_size, path, path_size + 1);
+	}
+	return realpath(joined, res) != NULL;
+}
+
+static void module_load(ModuleGraph *graph, CompilerContext *ctx, uint16_t id){
+	TraceSpan span = trace_begin("load module");
+	uint64_t start = trace_now_ns();
+	Module *m = module_get(graph, id);
+	m->ctx = ctx;
+	enum ModuleState state = ModuleState_Failed;
+
+	m->text = mmap_file(m->path);
+	if (m->text.data == NULL){
+		m->error = "cannot read the module file";
+		goto Return;
+	}
+
+	AstArray tokens = make_tokens(ctx, m->text.data);
+	if (tokens.data == NULL){
+		m->error = tokens.error;
+		m->error_pos = tokens.position;
+		goto Return;
+	}
+
+	// queue imported modules before parsing, so they load in parallel with it
+	uint32_t import_capacity = 0;
+	for (AstNode *it=tokens.data+1; it->type!=Ast_Terminator; it+=TokenSizes[it->type]){
+		if (it->type != Ast_Import || (it+1)->type != Ast_String) continue;
+		Data path_data = (it+2)->data;
+		const char *path = (const char *)(ctx->bc + path_data.bufinfo.index);
+
+		char resolved[PATH_MAX];
+		if (!module_resolve_path(resolved, m->path, path, path_data.bufinfo.size)){
+			m->error = "cannot resolve the imported module";
+			m->error_pos = it->pos;
+			ast_array_free(&tokens);
+			goto Return;
+		}
+		pthread_mutex_lock(&graph->lock);
+		uint16_t import_id = module_graph_add_locked(graph, resolved, id, it->pos);
+		pthread_mutex_unlock(&graph->lock);
+		if (import_id == 0){
+			m->error = "too many modules";
+			m->error_pos = it->pos;
+			ast_array_free(&tokens);
+			goto Return;
+		}
+		it->count = import_id;
+
+		if (m->import_count == import_capacity){
+			import_capacity = import_capacity == 0 ? 8 : 2*import_capacity;
+			m->imports = realloc(m->imports, import_capacity*sizeof(uint16_t));
+			assert(m->imports != NULL && "module allocation failrule");
+		}
+		m->imports[m->import_count] = import_id;
+		m->import_count += 1;
+	}
+
+	AstArray buffer = tokens;
+	m->ast = parse_tokens(ctx, tokens);
+	if (m->ast.data == NULL){
+		m->error = m->ast.error;
+		m->error_pos = m->ast.position;
+		m->ast = (AstArray){};
+		ast_array_free(&buffer);
+		goto Return;
+	}
+	fold_constants(&m->ast);
+	state = ModuleState_Parsed;
+
+Return:
+	m->load_time_ns = trace_now_ns() - start;
+	atomic_store_explicit(&m->state, state, memory_order_release);
+	trace_end(span);
+}
+
+static void *module_worker(void *arg){
+	ModuleWorker worker = *(ModuleWorker *)arg;
+	free(arg);
+	ModuleGraph *graph = worker.graph;
+
+	pthread_mutex_lock(&graph->lock);
+	for (;;){
+		while (!graph->stop && graph->next_to_load == graph->size){
+			pthread_cond_wait(&graph->work_cond, &graph->lock);
+		}
+		if (graph->next_to_load == graph->size) break; // stopped and no work left
+		graph->next_to_load += 1;
+		uint16_t id = graph->next_to_load;
+		graph->modules[id-1].state = ModuleState_Loading;
+		pthread_mutex_unlock(&graph->lock);
+
+		module_load(graph, worker.ctx, id);
+
+		pthread_mutex_lock(&graph->lock);
+		graph->pending -= 1;
+		pthread_cond_broadcast(&graph->done_cond);
+	}
+	pthread_mutex_unlock(&graph->lock);
+	return NULL;
+}
+
+
+
+// starts the workers, init_compiler_shared must be called before,
+// the graph must not be moved after initialization
+static bool module_graph_init(ModuleGraph *graph, size_t worker_count){
+	worker_count = util_clamp_usize(worker_count, 1, MODULE_WORKER_MAX);
+	*graph = (ModuleGraph){ .set_capacity = 64 };
+	graph->modules = calloc(MODULE_COUNT_MAX, sizeof(Module));
+	graph->set = calloc(graph->set_capacity, sizeof(uint32_t));
+	if (graph->modules == NULL || graph->set == NULL){
+		free(graph->modules);
+		free(graph->set);
+		return false;
+	}
+	pthread_mutex_init(&graph->lock, NULL);
+	pthread_cond_init(&graph->work_cond, NULL);
+	pthread_cond_init(&graph->done_cond, NULL);
+
+	for (size_t i=0; i!=worker_count; i+=1){
+		init_compiler_context(graph->contexts + i);
+		ModuleWorker *worker = malloc(sizeof(ModuleWorker));
+		assert(worker != NULL && "module allocation failrule");
+		*worker = (ModuleWorker){ .graph = graph, .ctx = graph->contexts + i };
+		if (pthread_create(graph->workers + i, NULL, module_worker, worker) != 0){
+			free(worker);
+			free_compiler_context(graph->contexts + i);
+			break;
+		}
+		graph->worker_count += 1;
+	}
+	return graph->worker_count != 0;
+}
+
+// queues the root module, the path is relative to the working directory,
+// returns 0 when the path cannot be resolved
+static uint16_t module_graph_import(ModuleGraph *graph, const char *path){
+	char resolved[PATH_MAX];
+	if (realpath(path, resolved) == NULL) return 0;
+	pthread_mutex_lock(&graph->lock);
+	uint16_t id = module_graph_add_locked(graph, resolved, 0, 0);
+	pthread_mutex_unlock(&graph->lock);
+	return id;
+}
+
+static bool module_is_loaded(const Module *m){
+	return atomic_load_explicit(&m->state, memory_order_acquire) >= ModuleState_Parsed;
+}
+
+// waits until the module is parsed or fails
+static const Module *module_wait(ModuleGraph *graph, uint16_t id){
+	Module *m = module_get(graph, id);
+	if (module_is_loaded(m)) return m;
+	pthread_mutex_lock(&graph->lock);
+	while (!module_is_loaded(m)) pthread_cond_wait(&graph->done_cond, &graph->lock);
+	pthread_mutex_unlock(&graph->lock);
+	return m;
+}
+
+// waits until the module and all modules it imports, directly or not, are
+// loaded, so phases that depend on them can start. returns false if any of
+// them failed
+static bool module_wait_imports(ModuleGraph *graph, uint16_t id){
+	// modules can be added while waiting, so the sets cover all possible ids
+	uint8_t *visited = calloc(MODULE_COUNT_MAX + 1, 1);
+	uint16_t *stack = malloc(MODULE_COUNT_MAX*sizeof(uint16_t));
+	assert(visited != NULL && stack != NULL && "module allocation failrule");
+	bool ok = true;
+	size_t stack_size = 1;
+	stack[0] = id;
+	visited[id] = 1;
+	while (stack_size != 0){
+		stack_size -= 1;
+		const Module *m = module_wait(graph, stack[stack_size]);
+		ok &= m->state == ModuleState_Parsed;
+		for (uint32_t i=0; i!=m->import_count; i+=1){
+			uint16_t import_id = m->imports[i];
+			if (visited[import_id]) continue;
+			visited[import_id] = 1;
+			stack[stack_size] = import_id;
+			stack_size += 1;
+		}
+	}
+	free(stack);
+	free(visited);
+	return ok;
+}
+
+// waits until every queued module is loaded
+static void module_graph_wait_all(ModuleGraph *graph){
+	pthread_mutex_lock(&graph->lock);
+	while (graph->pending != 0) pthread_cond_wait(&graph->done_cond, &graph->lock);
+	pthread_mutex_unlock(&graph->lock);
+}
+
+static void module_graph_free(ModuleGraph *graph){
+	pthread_mutex_lock(&graph->lock);
+	graph->stop = true;
+	pthread_cond_broadcast(&graph->work_cond);
+	pthread_mutex_unlock(&graph->lock);
+	for (size_t i=0; i!=graph->worker_count; i+=1){
+		pthread_join(graph->workers[i], NULL);
+	}
+
+	for (size_t i=0; i!=graph->size; i+=1){
+		Module *m = graph->modules + i;
+		ast_array_free(&m->ast);
+		unmap_file(m->text);
+		free(m->imports);
+		free(m->path);
+	}
+	for (size_t i=0; i!=graph->worker_count; i+=1){
+		free_compiler_context(graph->contexts + i);
+	}
+	pthread_mutex_destroy(&graph->lock);
+	pthread_cond_destroy(&graph->work_cond);
+	pthread_cond_destroy(&graph->done_cond);
+	free(graph->modules);
+	free(graph->set);
+}
@@ -4,8 +4,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include "classes.h"
+#include "trace.h"
 
 _Static_assert(sizeof(DataHeader) == sizeof(BcNode));
 
@@ -50,6 +52,7 @@ static AstArray ast_array_new(size_t capacity){
 	if (arr.data == NULL){
 		assert(false && "node array allocation failrule");
 	}
+	memory_track(MemTag_Ast, capacity*sizeof(AstNode));
 	arr.end = arr.data;
 	arr.maxptr = arr.data + capacity;
 	return arr;
@@ -61,19 +64,30 @@ static AstArray ast_array_clone(AstArray ast){
 	size_t size = ast.end - ast.data;
 	res.data = malloc(size*sizeof(AstNode));
 	if (res.data == NULL) return res;
+	memory_track(MemTag_Ast, size*sizeof(AstNode));
 	memcpy(res.data, ast.data, size*sizeof(AstNode));
 	res.end = res.data + size;
 	res.maxptr = res.data + size;
 	return res;
 }
 
+static void ast_array_free(AstArray *arr){
+	if (arr->data == NULL) return;
+	memory_track(MemTag_Ast, -(int64_t)((arr->maxptr - arr->data)*sizeof(AstNode)));
+	free(arr->data);
+	arr->data = NULL;
+}
+
 static void ast_array_grow(AstArray *arr){
-	size_t new_capacity = 2*(arr->maxptr - arr->data);
+	size_t old_capacity = arr->maxptr - arr->data;
+	size_t new_capacity = 2*old_capacity;
 	size_t arr_size = arr->end - arr->data;
 	arr->data = realloc(arr->data, new_capacity*sizeof(AstNode));
 	if (arr->data == NULL){
 		assert(false && "node array allocation failrule");
 	}
+	STATS_AST_GROW(new_capacity*sizeof(AstNode));
+	memory_track(MemTag_Ast, (new_capacity - old_capacity)*sizeof(AstNode));
 	arr->end = arr->data + arr_size;
 	arr->maxptr = arr->data + new_capacity;
 }
@@ -97,7 +111,8 @@ static AstNode *ast_array_push2(AstArray *arr, AstNode node, Data data){
 
 
 
-static AstArray make_tokens(const char *input){
+static AstArray make_tokens(CompilerContext *ctx, const char *input){
+	TraceSpan span = trace_begin("lex");
 	const char *text_begin = input;
 	AstArray res = ast_array_new(4096);
 	ast_array_push(&res, (AstNode){ .type = Ast_Terminator });
@@ -377,7 +392,7 @@ static AstArray make_tokens(const char *input){
 				while (is_valid_name_char(input[size])) size += 1;
 				curr.type = Ast_NamedInfered;
 				curr.count = size;
-				curr_data.name_id = get_name_id(input, size);
+				curr_data.name_id = get_name_id(ctx, input, size);
 				input += size;
 				goto AddTokenWithData;
 			}
@@ -458,7 +473,7 @@ static AstArray make_tokens(const char *input){
 				while (is_valid_name_char(input[size])) size += 1;
 				curr.type = Ast_GetField;
 				curr.count = size;
-				curr_data.name_id = get_name_id(input, size);
+				curr_data.name_id = get_name_id(ctx, input, size);
 				input += size;
 			}
 			goto AddTokenWithData;
@@ -494,7 +509,7 @@ static AstArray make_tokens(const char *input){
 		case '\"':{
 			input += 1;
 			size_t data_size = 0;
-			DataHeader *dest_node = (DataHeader *)(global_bc + global_bc_size);
+			DataHeader *dest_node = (DataHeader *)(ctx->bc + ctx->bc_size);
 			uint8_t *dest_data = (uint8_t *)(dest_node + 1);
 			while (*input != '\"'){
 				if (*input == '\0')
@@ -511,10 +526,12 @@ static AstArray make_tokens(const char *input){
 			*dest_node = (DataHeader){ .bytesize = data_size };
 
 			curr.type = Ast_String;
-			curr_data.bufinfo.index = global_bc_size + 1;
+			curr_data.bufinfo.index = ctx->bc_size + 1;
 			curr_data.bufinfo.size  = data_size;
 			
-			global_bc_size += 1 + (data_size + 2 + sizeof(BcNode) - 1)/sizeof(BcNode);
+			size_t data_nodes = 1 + (data_size + 2 + sizeof(BcNode) - 1)/sizeof(BcNode);
+			ctx->bc_size += data_nodes;
+			memory_track(MemTag_Bytecode, data_nodes*sizeof(BcNode));
 			goto AddTokenWithData;
 		}
 
@@ -537,6 +554,8 @@ static AstArray make_tokens(const char *input){
 			curr.type = Ast_Terminator;
 			curr.pos = position;
 			ast_array_push(&res, curr);
+			STATS_COUNT_TOKENS(res.data+1, res.end);
+			trace_end(span);
 			return res;
 
 		case '_':
@@ -565,7 +584,7 @@ static AstArray make_tokens(const char *input){
 				}
 				curr.type = Ast_Identifier;
 				curr.count = size;
-				curr_data.name_id = get_name_id(input, size);
+				curr_data.name_id = get_name_id(ctx, input, size);
 				input += size;
 				goto AddTokenWithData;
 			}
@@ -589,8 +608,8 @@ static AstArray make_tokens(const char *input){
 #undef PUSH_SCOPE 
 #undef RETURN_ERROR
 ReturnError:
-	free(res.data);
-	res.data = NULL;
+	ast_array_free(&res);
+	trace_end(span);
 	return res;
 }
 
@@ -598,7 +617,8 @@ ReturnError:
 
 
 
-static AstArray parse_tokens(AstArray tokens){
+static AstArray parse_tokens(CompilerContext *ctx, AstArray tokens){
+	TraceSpan span = trace_begin("parse");
 	AstNode opers[512];
 	size_t opers_size = 1;
 
@@ -756,6 +776,19 @@ ExpectValue:{
 			goto SimplePrefixOperator;
 		}
 
+		case Ast_Import:
+			// count of the import node is the id of imported module, it is set by
+			// the module loader, the data node holds the path string
+			if (opers_size != 1)
+				RETURN_ERROR("modules can be imported only in global scope", curr.pos);
+			if (it->type != Ast_String)
+				RETURN_ERROR("expected path of the imported module", curr.pos);
+			*res_it = curr;
+			(res_it+1)->data = (it+1)->data;
+			it += 2;
+			res_it += 2;
+			goto ExpectOperator;
+
 		case Ast_With:
 			*res_it = (AstNode){ .type = Ast_OpenBlock, .pos = curr.pos };
 			res_it += 1;
@@ -993,6 +1026,7 @@ EndOfFile:
 	*res_it = (AstNode){ .type = Ast_Terminator };
 	tokens.end = res_it;
 ReturnError:
+	trace_end(span);
 	return tokens;
 #undef RETURN_ERROR
 }
@@ -1001,6 +1035,303 @@ ReturnError:
 
 
 
+// CONSTANT FOLDING
+// the postfix ast is evaluated with a stack of constants, an operator whose
+// operands are all constant is replaced with one literal in place. unsigned
+// literals get their width later, it can be as narrow as the narrowest width
+// that holds the bigger operand, so a result is folded only when it fits that
+// width and doesn't go below zero or lose bits. such results are the same for
+// every width, and wrapping, saturating and expanded variants of operators
+// differ only on the other ones, so they fold the same. bitwise negations depend on the width and
+// are left for later. floats fold with floats of the same size, when the
+// result is finite
+#define FOLD_STACK_CAPACITY 64
+
+static Class fold_literal_class(enum AstType type){
+	switch (type){
+	case Ast_Unsigned: return CLASS_U64;
+	case Ast_Float32:  return CLASS_F32;
+	case Ast_Float64:  return CLASS_F64;
+	default:           return CLASS_Bool;
+	}
+}
+
+static enum AstType fold_literal_type(Class cl){
+	switch (cl.tag){
+	case Class_Unsigned: return Ast_Unsigned;
+	case Class_Float:    return cl.basic_size == 4 ? Ast_Float32 : Ast_Float64;
+	default:             return Ast_Bool;
+	}
+}
+
+// largest value of the narrowest unsigned width that holds the value
+static uint64_t fold_width_max(uint64_t value){
+	if (value <= UINT8_MAX)  return UINT8_MAX;
+	if (value <= UINT16_MAX) return UINT16_MAX;
+	if (value <= UINT32_MAX) return UINT32_MAX;
+	return UINT64_MAX;
+}
+
+static bool fold_bool(ValueInfo *res, bool value){
+	res->clas = CLASS_Bool;
+	res->data.u64 = value;
+	return true;
+}
+
+static bool fold_float(ValueInfo *res, double value){
+	if (!isfinite(value)) return false;
+	if (res->clas.basic_size == 4){
+		if (!isfinite((float)value)) return false;
+		res->data.f32 = (float)value;
+	} else{
+		res->data.f64 = value;
+	}
+	return true;
+}
+
+static bool fold_unary(AstNode oper, ValueInfo *val){
+	switch (val->clas.tag){
+	case Class_Unsigned:
+		if (oper.type == Ast_Plus) return true;
+		return oper.type == Ast_Minus && val->data.u64 == 0;
+	case Class_Float:
+		if (oper.type == Ast_Plus) return true;
+		if (oper.type != Ast_Minus) return false;
+		if (val->clas.basic_size == 4) val->data.f32 = -val->data.f32;
+		else val->data.f64 = -val->data.f64;
+		return true;
+	case Class_Bool:
+		return oper.type == Ast_LogicNot && fold_bool(val, !val->data.u64);
+	default:
+		return false;
+	}
+}
+
+static bool fold_binary(AstNode oper, ValueInfo *lhs, ValueInfo rhs){
+	bool negate = (oper.flags & AstFlag_Negate) != 0;
+	if (lhs->clas.id != rhs.clas.id) return false;
+	switch (lhs->clas.tag){
+	case Class_Unsigned:{
+		uint64_t a = lhs->data.u64, b = rhs.data.u64, res = 1;
+		switch (oper.type){
+		case Ast_Add:
+			if (__builtin_add_overflow(a, b, &res)) return false;
+			break;
+		case Ast_Subtract:
+			if (a < b) return false;
+			res = a - b;
+			break;
+		case Ast_Multiply:
+			if (__builtin_mul_overflow(a, b, &res)) return false;
+			break;
+		case Ast_Divide: // division of literals may be done on floats later
+			if (b == 0 || a % b != 0) return false;
+			res = a / b;
+			break;
+		case Ast_Modulo:
+			if (b == 0) return false;
+			res = a % b;
+			break;
+		case Ast_Power:
+			for (; b != 0; b >>= 1){
+				if ((b & 1) && __builtin_mul_overflow(res, a, &res)) return false;
+				if (b != 1 && __builtin_mul_overflow(a, a, &a)) return false;
+			}
+			break;
+		case Ast_BitOr:
+			if (negate) return false;
+			res = a | b;
+			break;
+		case Ast_BitAnd:
+			if (negate) return false;
+			res = a & b;
+			break;
+		case Ast_BitXor:
+			res = a ^ b;
+			break;
+		case Ast_ShiftLeft:
+			if (b >= 64 || (a << b) >> b != a) return false;
+			res = a << b;
+			break;
+		case Ast_ShiftRight:
+			if (b >= 64) return false;
+			res = a >> b;
+			break;
+		case Ast_Equal:   return fold_bool(lhs, (a == b) != negate);
+		case Ast_Less:    return fold_bool(lhs, negate ? a >= b : a < b);
+		case Ast_Greater: return fold_bool(lhs, negate ? a <= b : a > b);
+		default: return false;
+		}
+		if (res > fold_width_max(lhs->data.u64 | rhs.data.u64)) return false;
+		lhs->data.u64 = res;
+		return true;
+	}
+	case Class_Float:{
+		bool is_f32 = lhs->clas.basic_size == 4;
+		double a = is_f32 ? lhs->data.f32 : lhs->data.f64;
+		double b = is_f32 ? rhs.data.f32 : rhs.data.f64;
+		// sums, products and quotients of floats rounded from doubles are the
+		// same as the ones done on floats
+		switch (oper.type){
+		case Ast_Add:      return fold_float(lhs, a + b);
+		case Ast_Subtract: return fold_float(lhs, a - b);
+		case Ast_Multiply: return fold_float(lhs, a * b);
+		case Ast_Divide:   return b != 0.0 && fold_float(lhs, a / b);
+		case Ast_Equal:    return fold_bool(lhs, (a == b) != negate);
+		case Ast_Less:     return fold_bool(lhs, negate ? a >= b : a < b);
+		case Ast_Greater:  return fold_bool(lhs, negate ? a <= b : a > b);
+		default: return false;
+		}
+	}
+	case Class_Bool:{
+		bool a = lhs->data.u64, b = rhs.data.u64;
+		switch (oper.type){
+		case Ast_Equal:    return fold_bool(lhs, (a == b) != negate);
+		case Ast_LogicAnd: return fold_bool(lhs, (a && b) != negate);
+		case Ast_LogicOr:  return fold_bool(lhs, (a || b) != negate);
+		default: return false;
+		}
+	}
+	default:
+		return false;
+	}
+}
+
+typedef struct{
+	uint32_t r_end;  // read index after the scope or the initializer
+	uint32_t w_node; // written index of the scope or the variable
+	bool global;
+} FoldFixup;
+
+// folds the ast in place and returns the number of folded operators. sizes of
+// scopes and indexes after initializers of global variables are moved with
+// the nodes
+static uint32_t fold_constants(AstArray *ast){
+	TraceSpan span = trace_begin("fold constants");
+	AstNode *nodes = ast->data;
+	ValueInfo values[FOLD_STACK_CAPACITY];
+	size_t values_size = 0;
+	FoldFixup fixups[512];
+	size_t fixups_size = 0;
+	uint32_t folded = 0;
+
+	uint32_t w = 1;
+	for (uint32_t r=1;;){
+		// scopes and initializers nest, so they are closed in reverse order
+		while (fixups_size != 0 && fixups[fixups_size-1].r_end == r){
+			fixups_size -= 1;
+			uint32_t w_node = fixups[fixups_size].w_node;
+			if (fixups[fixups_size].global){
+				nodes[w_node+1].data.name_helper = w;
+				nodes[w-1].pos = w_node + 1; // global return points at the variable
+			} else{
+				nodes[w_node].pos = w - w_node;
+			}
+		}
+
+		AstNode node = nodes[r];
+		uint32_t node_size = AstNodeSizes[node.type];
+		switch (node.type){
+		case Ast_Terminator:
+			nodes[w] = node;
+			ast->end = nodes + w;
+			trace_end(span);
+			return folded;
+
+		case Ast_Unsigned:
+		case Ast_Float32:
+		case Ast_Float64:
+		case Ast_Bool:
+			if (values_size == FOLD_STACK_CAPACITY) values_size = 0;
+			values[values_size] = (ValueInfo){
+				.clas = fold_literal_class(node.type), .ast_start = w, .data = nodes[r+1].data
+			};
+			values_size += 1;
+			break;
+
+		case Ast_Plus:
+		case Ast_Minus:
+		case Ast_LogicNot:
+			if (values_size != 0 && fold_unary(node, values + values_size-1)) goto Folded;
+			values_size = 0;
+			break;
+
+		case Ast_Add:
+		case Ast_Subtract:
+		case Ast_Multiply:
+		case Ast_Divide:
+		case Ast_Modulo:
+		case Ast_Power:
+		case Ast_BitOr:
+		case Ast_BitAnd:
+		case Ast_BitXor:
+		case Ast_ShiftLeft:
+		case Ast_ShiftRight:
+		case Ast_Equal:
+		case Ast_Less:
+		case Ast_Greater:
+		case Ast_LogicAnd:
+		case Ast_LogicOr:
+			if (values_size >= 2){
+				ValueInfo lhs = values[values_size-2];
+				if (fold_binary(node, &lhs, values[values_size-1])){
+					values_size -= 1;
+					values[values_size-1] = lhs;
+					goto Folded;
+				}
+			}
+			values_size = 0;
+			break;
+
+		case Ast_StartScope:
+			assert(fixups_size != SIZE(fixups) && "scopes are nested too deep to fold");
+			fixups[fixups_size] = (FoldFixup){ .r_end = r + node.pos, .w_node = w };
+			fixups_size += 1;
+			values_size = 0;
+			break;
+
+		case Ast_Variable:
+			if (
+				(node.flags & AstFlag_Global) &&
+				(node.flags & AstFlag_ClassSpec) &&
+				(node.flags & AstFlag_Initialized)
+			){
+				assert(fixups_size != SIZE(fixups) && "scopes are nested too deep to fold");
+				fixups[fixups_size] = (FoldFixup){
+					.r_end = nodes[r+1].data.name_helper, .w_node = w, .global = true
+				};
+				fixups_size += 1;
+			}
+			values_size = 0;
+			break;
+
+		default:
+			values_size = 0;
+			break;
+		}
+		if (w != r){
+			nodes[w] = nodes[r];
+			if (node_size == 2) nodes[w+1] = nodes[r+1];
+		}
+		w += node_size;
+		r += node_size;
+		continue;
+
+	Folded:{
+		// the operator and its operands become the literal at the first operand
+		ValueInfo res = values[values_size-1];
+		nodes[res.ast_start].type = fold_literal_type(res.clas);
+		nodes[res.ast_start+1].data = res.data;
+		w = res.ast_start + 2;
+		r += node_size;
+		folded += 1;
+	}}
+}
+
+
+
+
+
 static bool is_valid_name_char(char c){
 	return (c>='a' && c<='z') || (c>='A' && c<='Z') || (c>='0' && c<='9') || c=='_';
 }
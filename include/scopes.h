@@ -0,0 +1,191 @@
+#pragma once
+
+#include "utils.h"
+#include "structs.h"
+#include "stats.h"
+#include "memtags.h"
+
+#include <stdlib.h>
+
+
+// SCOPE STACK
+// variables of all open scopes are kept on one stack and a hash index maps
+// every name to the innermost variable with that name, so a name defined in
+// any enclosing scope, global ones included, is found with a single lookup.
+// a variable remembers the one it shadows, popping a scope walks only the
+// variables defined in it and restores the shadowed ones.
+// slots of the index are never removed, a slot of a name that is not visible
+// anymore keeps the name with no variable and is reused when the name is
+// defined again, so lookups don't need tombstones
+#define SCOPE_INDEX_INITIAL_CAPACITY 1024 // must be a power of 2
+
+typedef struct{
+	NameId   name_id;  // 0 means empty slot
+	uint32_t var_index; // index+1 of the visible variable, 0 means none
+} ScopeEntry;
+
+typedef struct{
+	VariableInfo *vars;
+	uint32_t     *shadowed; // index+1 of the variable hidden by each variable, the undo log
+	uint32_t vars_size;
+	uint32_t vars_capacity;
+
+	ScopeInfo *scopes;
+	uint32_t scopes_size;
+	uint32_t scopes_capacity;
+
+	ScopeEntry *index;
+	uint32_t index_size; // used slots, with and without variables
+	uint32_t index_capacity;
+} ScopeStack;
+
+
+
+// fibonacci hashing, name ids are offsets into name data, so names of the
+// same length form arithmetic sequences, top bits of the product spread them
+// evenly over the slots
+static uint32_t scope_name_hash(NameId name_id, uint32_t capacity){
+	uint32_t shift = 64 - util_trailing_zeros_u32(capacity);
+	return (uint32_t)(((uint64_t)name_id * 0x9E3779B97F4A7C15ull) >> shift);
+}
+
+// returns the slot of the name or the empty slot where it belongs
+static ScopeEntry *scope_index_slot(const ScopeStack *s, NameId name_id){
+	assert(util_is_power2_u32(s->index_capacity));
+	uint32_t mask = s->index_capacity - 1;
+	uint32_t index = scope_name_hash(name_id, s->index_capacity);
+	for (uint32_t i=0;; i+=1){
+		ScopeEntry *entry = s->index + index;
+		if (entry->name_id == name_id || entry->name_id == 0){
+			STATS_PROBE(StatsTable_Scopes, i+1);
+			return entry;
+		}
+		index = (index + i + 1) & mask;
+	}
+}
+
+static void scope_index_grow(ScopeStack *s){
+	STATS_RESIZE(StatsTable_Scopes);
+	ScopeEntry *old_index = s->index;
+	uint32_t old_capacity = s->index_capacity;
+
+	// names without a visible variable are dropped, so the index can also shrink
+	uint32_t live = 0;
+	for (uint32_t i=0; i!=old_capacity; i+=1) live += old_index[i].var_index != 0;
+	uint32_t new_capacity = SCOPE_INDEX_INITIAL_CAPACITY;
+	while (new_capacity < 4*live) new_capacity *= 2;
+
+	s->index = calloc(new_capacity, sizeof(ScopeEntry));
+	assert(s->index != NULL && "scope allocation failrule");
+	memory_track(MemTag_Scopes,
+		((int64_t)new_capacity - (int64_t)old_capacity)*(int64_t)sizeof(ScopeEntry)
+	);
+	s->index_capacity = new_capacity;
+	s->index_size = live;
+	for (uint32_t i=0; i!=old_capacity; i+=1){
+		ScopeEntry entry = old_index[i];
+		if (entry.var_index == 0) continue;
+		*scope_index_slot(s, entry.name_id) = entry;
+	}
+	free(old_index);
+}
+
+static void scope_stack_init(ScopeStack *s){
+	*s = (ScopeStack){
+		.vars_capacity   = 256,
+		.scopes_capacity = 64,
+		.index_capacity  = SCOPE_INDEX_INITIAL_CAPACITY,
+	};
+	s->vars     = malloc(s->vars_capacity*sizeof(VariableInfo));
+	s->shadowed = malloc(s->vars_capacity*sizeof(uint32_t));
+	s->scopes   = malloc(s->scopes_capacity*sizeof(ScopeInfo));
+	s->index    = calloc(s->index_capacity, sizeof(ScopeEntry));
+	assert(
+		s->vars != NULL && s->shadowed != NULL && s->scopes != NULL && s->index != NULL &&
+		"scope allocation failrule"
+	);
+	memory_track(MemTag_Scopes,
+		s->vars_capacity*(sizeof(VariableInfo) + sizeof(uint32_t)) +
+		s->scopes_capacity*sizeof(ScopeInfo) +
+		s->index_capacity*sizeof(ScopeEntry)
+	);
+}
+
+static void scope_stack_free(ScopeStack *s){
+	memory_track(MemTag_Scopes, -(int64_t)(
+		s->vars_capacity*(sizeof(VariableInfo) + sizeof(uint32_t)) +
+		s->scopes_capacity*sizeof(ScopeInfo) +
+		s->index_capacity*sizeof(ScopeEntry)
+	));
+	free(s->vars);
+	free(s->shadowed);
+	free(s->scopes);
+	free(s->index);
+	*s = (ScopeStack){0};
+}
+
+static ScopeInfo *scope_current(ScopeStack *s){
+	assert(s->scopes_size != 0);
+	return s->scopes + s->scopes_size - 1;
+}
+
+static ScopeInfo *scope_push(ScopeStack *s, enum ScopeType type){
+	UNLIKELY if (s->scopes_size == s->scopes_capacity){
+		s->scopes = realloc(s->scopes, 2*s->scopes_capacity*sizeof(ScopeInfo));
+		assert(s->scopes != NULL && "scope allocation failrule");
+		memory_track(MemTag_Scopes, s->scopes_capacity*sizeof(ScopeInfo));
+		s->scopes_capacity *= 2;
+	}
+	ScopeInfo *scope = s->scopes + s->scopes_size;
+	*scope = (ScopeInfo){ .type = type, .vars_size = s->vars_size };
+	s->scopes_size += 1;
+	return scope;
+}
+
+// makes variables defined since the scope was pushed invisible and uncovers
+// the ones they shadowed
+static void scope_pop(ScopeStack *s){
+	uint32_t vars_begin = scope_current(s)->vars_size;
+	for (uint32_t i=s->vars_size; i!=vars_begin; i-=1){
+		ScopeEntry *entry = scope_index_slot(s, s->vars[i-1].name_id);
+		entry->var_index = s->shadowed[i-1];
+	}
+	s->vars_size = vars_begin;
+	s->scopes_size -= 1;
+}
+
+// returns index of the new variable or -1 if the name is already defined in
+// the current scope
+static VarIndex scope_define(ScopeStack *s, NameId name_id, uint32_t value_idx){
+	assert(name_id != 0);
+	ScopeEntry *entry = scope_index_slot(s, name_id);
+	uint32_t shadowed = entry->var_index;
+	if (shadowed > scope_current(s)->vars_size) return -1;
+
+	UNLIKELY if (s->vars_size == s->vars_capacity){
+		uint32_t new_capacity = 2*s->vars_capacity;
+		s->vars     = realloc(s->vars, new_capacity*sizeof(VariableInfo));
+		s->shadowed = realloc(s->shadowed, new_capacity*sizeof(uint32_t));
+		assert(s->vars != NULL && s->shadowed != NULL && "scope allocation failrule");
+		memory_track(MemTag_Scopes, s->vars_capacity*(sizeof(VariableInfo) + sizeof(uint32_t)));
+		s->vars_capacity = new_capacity;
+	}
+	VarIndex result = s->vars_size;
+	s->vars[result] = (VariableInfo){ .name_id = name_id, .value_idx = value_idx };
+	s->shadowed[result] = shadowed;
+	s->vars_size += 1;
+
+	if (entry->name_id == 0){
+		entry->name_id = name_id;
+		s->index_size += 1;
+	}
+	entry->var_index = result + 1;
+	// kept at most half full, so most lookups end at the first slot
+	UNLIKELY if (2*s->index_size >= s->index_capacity) scope_index_grow(s);
+	return result;
+}
+
+// returns index of the innermost visible variable with the name or -1
+static VarIndex scope_find(const ScopeStack *s, NameId name_id){
+	return (VarIndex)scope_index_slot(s, name_id)->var_index - 1;
+}
@@ -0,0 +1,525 @@
+#pragma once
+
+#include "utils.h"
+#include "modules.h"
+#include "scopes.h"
+
+#include <stdlib.h>
+
+
+// DEMAND DRIVEN ANALYSIS
+// globals of every module are collected first, without looking into procedure
+// bodies. analysis starts from the roots and a global is analysed only when
+// something that is analysed refers to it, so procedures that nothing reaches
+// never have their bodies walked. every global is analysed once, its result is
+// kept with it and later references only read it.
+// globals that are referenced are queued instead of being analysed right away,
+// so a scope stack of a module holds only one body at a time above its global
+// scope. a definition that needs a global which is not finished yet is
+// suspended where it stopped and resumed when that global is finished, so no
+// definition is walked twice whatever the order of declarations. a global
+// that waits for itself through other suspended globals closes a cycle, all
+// globals of the loop fail and the ones waiting for them go on.
+// for now the analysis resolves names, a name that is not defined in the
+// module is looked up in globals of the modules it imports
+#define SEMA_NESTING_MAX 256 // nested scopes in one definition
+
+enum SemaState{
+	SemaState_Unreached,
+	SemaState_Queued,
+	SemaState_Suspended, // waits until a declaration it depends on is finished
+	SemaState_Analysed,
+	SemaState_Failed
+};
+
+typedef struct{
+	uint16_t module_id; // 0 means none
+	uint32_t global;
+} SemaItem;
+
+// state of a suspended analysis, local scopes and variables of the definition
+// are taken off the scope stack of the module and pushed back on resume
+typedef struct{
+	uint32_t pos; // node to resume from
+	uint32_t depth;
+	uint32_t params_open; // procedures whose body did not start yet
+	uint8_t  closes_params[SEMA_NESTING_MAX]; // if a scope is a body of a procedure
+
+	uint32_t scope_count;
+	uint32_t var_count;
+	ScopeInfo    *scopes;
+	VariableInfo *vars;
+} SemaTask;
+
+typedef struct{
+	NameId   name_id;
+	uint32_t begin; // first node of the definition
+	uint32_t end;   // node after the definition
+	uint32_t body_size; // nodes of the body of a global procedure, 0 for other globals
+	uint8_t  state;
+
+	// result of the analysis
+	uint32_t unresolved_count;
+	uint32_t unresolved_pos;
+	const char *error;
+	uint32_t error_pos;
+	bool cycle_head; // the cycle was found while analysing this global
+
+	// a suspended global is on the list of waiters of the one it waits for,
+	// waiting_on stays set on globals of a cycle, so the loop can be printed
+	SemaTask *task;
+	SemaItem waiting_on;
+	SemaItem first_waiter;
+	SemaItem next_waiter;
+} SemaGlobal;
+
+typedef struct{
+	const Module *module; // NULL if the module failed to load
+	SemaGlobal *globals;
+	uint32_t global_count;
+	ScopeStack scopes; // the global scope stays at the bottom
+	uint32_t global_var_count; // variables of the global scope, redefined globals are left out
+} SemaModule;
+
+typedef struct{
+	size_t globals;
+	size_t globals_analysed;
+	size_t redefined;
+	size_t procedures;
+	size_t bodies_analysed;
+	size_t bodies_skipped;
+	size_t body_nodes;
+	size_t body_nodes_skipped;
+	size_t unresolved;
+	size_t suspensions;
+	size_t cycles;
+	size_t nodes;         // ast size of analysed definitions
+	size_t nodes_visited; // a resumed definition visits again the node it stopped at
+} SemaStats;
+
+typedef struct{
+	ModuleGraph *graph;
+	SemaModule *modules; // module with id i is at index i-1
+	uint32_t module_count;
+
+	SemaItem *queue;
+	size_t queue_size;
+	size_t queue_capacity;
+
+	size_t suspensions;
+	size_t cycles;
+	size_t nodes_visited;
+} Sema;
+
+// builtin names that are not globals of any module
+static const char *const SemaBuiltinNames[] = {
+	"u8", "u16", "u32", "u64", "i8", "i16", "i32", "i64",
+	"f32", "f64", "bool", "void", "uptr", "iptr", "usize", "isize",
+	"true", "false", "null",
+};
+
+
+
+static SemaModule *sema_module(Sema *s, uint16_t module_id){
+	assert(module_id != 0 && module_id <= s->module_count);
+	return s->modules + module_id - 1;
+}
+
+static SemaGlobal *sema_global(Sema *s, SemaItem item){
+	return sema_module(s, item.module_id)->globals + item.global;
+}
+
+static bool sema_same_item(SemaItem a, SemaItem b){
+	return a.module_id == b.module_id && a.global == b.global;
+}
+
+static bool sema_is_finished(const SemaGlobal *g){
+	return g->state == SemaState_Analysed || g->state == SemaState_Failed;
+}
+
+static void sema_add_global(SemaModule *sm, NameId name_id, uint32_t begin, uint32_t end){
+	const AstNode *ast = sm->module->ast.data;
+	uint32_t body_size = 0;
+	if (ast[begin].type == Ast_Procedure){
+		// parameters come before the body, a default value can contain a
+		// procedure, so the body is the last scope of the definition
+		for (uint32_t i=begin; i<end;){
+			if (ast[i].type == Ast_StartScope){
+				body_size = ast[i].pos;
+				i += ast[i].pos;
+			} else{
+				i += AstNodeSizes[ast[i].type];
+			}
+		}
+	}
+	sm->globals[sm->global_count] = (SemaGlobal){
+		.name_id = name_id, .begin = begin, .end = end, .body_size = body_size
+	};
+	sm->global_count += 1;
+}
+
+// collects globals of a module, bodies are jumped over
+static void sema_collect_globals(SemaModule *sm){
+	const AstNode *ast = sm->module->ast.data;
+	size_t node_count = sm->module->ast.end - ast;
+	sm->globals = malloc(node_count*sizeof(SemaGlobal));
+	assert(sm->globals != NULL && "sema allocation failrule");
+
+	uint32_t begin = 1;
+	for (uint32_t i=1; ast[i].type!=Ast_Terminator;){
+		AstNode node = ast[i];
+		if (node.type == Ast_StartScope){
+			i += node.pos;
+		} else if (node.type == Ast_Import){
+			i += AstNodeSizes[Ast_Import];
+			begin = i;
+		} else if (node.type == Ast_Variable && (node.flags & AstFlag_Global)){
+			uint32_t end = i + AstNodeSizes[Ast_Variable];
+			if ((node.flags & AstFlag_ClassSpec) && (node.flags & AstFlag_Initialized)){
+				end = ast[i+1].data.name_helper; // the initializer follows the variable
+			}
+			sema_add_global(sm, ast[i+1].data.name_id, begin, end);
+			i = end;
+			begin = end;
+		} else{
+			i += AstNodeSizes[node.type];
+		}
+	}
+
+	scope_stack_init(&sm->scopes);
+	scope_push(&sm->scopes, Scope_Global);
+	// a redefined global is not visible, it is counted in the stats
+	for (uint32_t i=0; i!=sm->global_count; i+=1){
+		scope_define(&sm->scopes, sm->globals[i].name_id, i);
+	}
+	sm->global_var_count = sm->scopes.vars_size;
+}
+
+// must be called after module_graph_wait_all
+static void sema_init(Sema *s, ModuleGraph *graph){
+	*s = (Sema){ .graph = graph, .module_count = graph->size, .queue_capacity = 256 };
+	s->modules = calloc(s->module_count, sizeof(SemaModule));
+	s->queue = malloc(s->queue_capacity*sizeof(SemaItem));
+	assert(s->modules != NULL && s->queue != NULL && "sema allocation failrule");
+	for (uint16_t id=1; id<=s->module_count; id+=1){
+		const Module *m = module_get(graph, id);
+		if (m->state != ModuleState_Parsed) continue;
+		SemaModule *sm = sema_module(s, id);
+		sm->module = m;
+		sema_collect_globals(sm);
+	}
+}
+
+static void sema_free(Sema *s){
+	for (uint32_t i=0; i!=s->module_count; i+=1){
+		SemaModule *sm = s->modules + i;
+		if (sm->module == NULL) continue;
+		for (uint32_t j=0; j!=sm->global_count; j+=1) free(sm->globals[j].task);
+		scope_stack_free(&sm->scopes);
+		free(sm->globals);
+	}
+	free(s->modules);
+	free(s->queue);
+}
+
+static void sema_queue(Sema *s, SemaItem item){
+	UNLIKELY if (s->queue_size == s->queue_capacity){
+		s->queue_capacity *= 2;
+		s->queue = realloc(s->queue, s->queue_capacity*sizeof(SemaItem));
+		assert(s->queue != NULL && "sema allocation failrule");
+	}
+	s->queue[s->queue_size] = item;
+	s->queue_size += 1;
+}
+
+static void sema_require(Sema *s, uint16_t module_id, uint32_t global){
+	SemaGlobal *g = sema_module(s, module_id)->globals + global;
+	if (g->state != SemaState_Unreached) return;
+	g->state = SemaState_Queued;
+	sema_queue(s, (SemaItem){ .module_id = module_id, .global = global });
+}
+
+// finds a global of a module by a name from the context of another module
+static int64_t sema_find_global(
+	const SemaModule *sm, const CompilerContext *name_ctx, NameId name_id
+){
+	const CompilerContext *ctx = sm->module->ctx;
+	if (ctx != name_ctx){
+		const char *name = (const char *)name_ctx->names.data + name_id;
+		name_id = find_name_id(ctx, name, name_ctx->names.data[name_id-1]);
+		if (name_id == 0) return -1;
+	}
+	VarIndex var = scope_find(&sm->scopes, name_id);
+	if (var < 0 || (uint32_t)var >= sm->global_var_count) return -1;
+	return sm->scopes.vars[var].value_idx;
+}
+
+static bool sema_is_builtin(const CompilerContext *ctx, NameId name_id){
+	const char *name = (const char *)ctx->names.data + name_id;
+	uint8_t length = ctx->names.data[name_id-1];
+	for (size_t i=0; i!=SIZE(SemaBuiltinNames); i+=1){
+		if (
+			strlen(SemaBuiltinNames[i]) == length &&
+			memcmp(SemaBuiltinNames[i], name, length) == 0
+		) return true;
+	}
+	return false;
+}
+
+// returns the global the name refers to, module_id is 0 for locals and
+// unresolved names
+static SemaItem sema_resolve(
+	Sema *s, uint16_t module_id, SemaGlobal *g, NameId name_id, uint32_t pos
+){
+	SemaModule *sm = sema_module(s, module_id);
+	VarIndex var = scope_find(&sm->scopes, name_id);
+	if (var >= 0){
+		if ((uint32_t)var >= sm->global_var_count) return (SemaItem){0};
+		uint32_t global = sm->scopes.vars[var].value_idx;
+		sema_require(s, module_id, global);
+		return (SemaItem){ .module_id = module_id, .global = global };
+	}
+	const Module *m = sm->module;
+	for (uint32_t i=0; i!=m->import_count; i+=1){
+		SemaModule *imported = sema_module(s, m->imports[i]);
+		if (imported->module == NULL) continue;
+		int64_t global = sema_find_global(imported, m->ctx, name_id);
+		if (global >= 0){
+			sema_require(s, m->imports[i], global);
+			return (SemaItem){ .module_id = m->imports[i], .global = global };
+		}
+	}
+	if (!sema_is_builtin(m->ctx, name_id)){
+		if (g->unresolved_count == 0) g->unresolved_pos = pos;
+		g->unresolved_count += 1;
+	}
+	return (SemaItem){0};
+}
+
+
+
+// SUSPENSION
+
+// queues everything that waited for the global
+static void sema_wake_waiters(Sema *s, SemaGlobal *g){
+	SemaItem waiter = g->first_waiter;
+	g->first_waiter = (SemaItem){0};
+	while (waiter.module_id != 0){
+		SemaGlobal *w = sema_global(s, waiter);
+		SemaItem next = w->next_waiter;
+		w->next_waiter = (SemaItem){0};
+		if (w->state == SemaState_Suspended) sema_queue(s, waiter);
+		waiter = next;
+	}
+}
+
+static void sema_task_save(
+	SemaGlobal *g, const SemaTask *t, ScopeStack *scopes, uint32_t global_var_count
+){
+	uint32_t scope_count = scopes->scopes_size - 1;
+	uint32_t var_count = scopes->vars_size - global_var_count;
+	SemaTask *task = malloc(
+		sizeof(SemaTask) + scope_count*sizeof(ScopeInfo) + var_count*sizeof(VariableInfo)
+	);
+	assert(task != NULL && "sema allocation failrule");
+	*task = *t;
+	task->scope_count = scope_count;
+	task->var_count = var_count;
+	task->scopes = (ScopeInfo *)(task + 1);
+	task->vars = (VariableInfo *)(task->scopes + scope_count);
+	memcpy(task->scopes, scopes->scopes + 1, scope_count*sizeof(ScopeInfo));
+	memcpy(task->vars, scopes->vars + global_var_count, var_count*sizeof(VariableInfo));
+	while (scopes->scopes_size != 1) scope_pop(scopes);
+	g->task = task;
+}
+
+// variables get the same indexes, because the stack is back at the global scope
+static void sema_task_restore(SemaGlobal *g, SemaTask *t, ScopeStack *scopes){
+	SemaTask *task = g->task;
+	*t = *task;
+	uint32_t vars_begin = scopes->vars_size;
+	uint32_t vars_end = vars_begin + task->var_count;
+	for (uint32_t i=0; i!=task->scope_count; i+=1){
+		uint32_t scope_end = i+1 != task->scope_count ? task->scopes[i+1].vars_size : vars_end;
+		scope_push(scopes, task->scopes[i].type);
+		while (scopes->vars_size != scope_end){
+			VariableInfo var = task->vars[scopes->vars_size - vars_begin];
+			scope_define(scopes, var.name_id, var.value_idx);
+		}
+	}
+	free(task);
+	g->task = NULL;
+}
+
+// every global on the loop fails, the loop stays in their waiting_on fields
+static void sema_fail_cycle(Sema *s, SemaItem head, uint32_t pos){
+	s->cycles += 1;
+	SemaItem item = head;
+	do{
+		SemaGlobal *g = sema_global(s, item);
+		g->state = SemaState_Failed;
+		g->error = "circular dependency between declarations";
+		g->error_pos = pos;
+		if (g->task != NULL){
+			g->error_pos = sema_module(s, item.module_id)->module->ast.data[g->task->pos].pos;
+		}
+		free(g->task);
+		g->task = NULL;
+		item = g->waiting_on;
+	} while (!sema_same_item(item, head));
+	sema_global(s, head)->cycle_head = true;
+
+	do{
+		SemaGlobal *g = sema_global(s, item);
+		sema_wake_waiters(s, g);
+		item = g->waiting_on;
+	} while (!sema_same_item(item, head));
+}
+
+// suspends the running global until dep is finished, if that would close a
+// loop the loop fails instead
+static void sema_suspend(Sema *s, SemaItem item, SemaTask *t, SemaItem dep){
+	SemaModule *sm = sema_module(s, item.module_id);
+	SemaGlobal *g = sm->globals + item.global;
+	g->waiting_on = dep;
+	for (SemaItem it=dep;;){
+		if (sema_same_item(it, item)){
+			while (sm->scopes.scopes_size != 1) scope_pop(&sm->scopes);
+			sema_fail_cycle(s, item, sm->module->ast.data[t->pos].pos);
+			return;
+		}
+		SemaGlobal *other = sema_global(s, it);
+		if (other->state != SemaState_Suspended) break;
+		it = other->waiting_on;
+	}
+
+	s->suspensions += 1;
+	sema_task_save(g, t, &sm->scopes, sm->global_var_count);
+	g->state = SemaState_Suspended;
+	SemaGlobal *d = sema_global(s, dep);
+	g->next_waiter = d->first_waiter;
+	d->first_waiter = item;
+	// the dependency runs next, even if it was queued long ago
+	if (d->state == SemaState_Queued) sema_queue(s, dep);
+}
+
+
+
+// walks the definition from where it stopped, procedures nested in it are
+// analysed with it. a reference to a global that is not a procedure needs
+// the global to be finished, otherwise the analysis is suspended and resumes
+// from the same reference, procedures are needed only by their signatures
+static void sema_analyse(Sema *s, SemaItem item){
+	SemaModule *sm = sema_module(s, item.module_id);
+	SemaGlobal *g = sm->globals + item.global;
+	const AstNode *ast = sm->module->ast.data;
+	ScopeStack *scopes = &sm->scopes;
+
+	SemaTask t = { .pos = g->begin };
+	if (g->task != NULL) sema_task_restore(g, &t, scopes);
+	g->waiting_on = (SemaItem){0};
+
+	for (uint32_t i=t.pos; i!=g->end; i+=AstNodeSizes[ast[i].type]){
+		AstNode node = ast[i];
+		s->nodes_visited += AstNodeSizes[node.type];
+		switch (node.type){
+		case Ast_Procedure:
+			scope_push(scopes, Scope_Params);
+			t.params_open += 1;
+			break;
+		case Ast_StartScope:
+			assert(t.depth < SEMA_NESTING_MAX);
+			t.closes_params[t.depth] = t.params_open != 0;
+			t.depth += 1;
+			scope_push(scopes, t.params_open != 0 ? Scope_Procedure : Scope_Block);
+			if (t.params_open != 0) t.params_open -= 1;
+			break;
+		case Ast_EndScope:
+			t.depth -= 1;
+			scope_pop(scopes);
+			if (t.closes_params[t.depth]) scope_pop(scopes);
+			break;
+		case Ast_Variable:
+			if (node.flags & AstFlag_Global) break;
+			scope_define(scopes, ast[i+1].data.name_id, 0);
+			break;
+		case Ast_Identifier:{
+			SemaItem dep = sema_resolve(s, item.module_id, g, ast[i+1].data.name_id, node.pos);
+			if (dep.module_id == 0) break;
+			SemaGlobal *d = sema_global(s, dep);
+			if (d->body_size != 0 || sema_is_finished(d)) break;
+			t.pos = i;
+			sema_suspend(s, item, &t, dep);
+			return;
+		}
+		default: break;
+		}
+	}
+	assert(scopes->scopes_size == 1 && "unbalanced scopes in a global definition");
+	g->state = SemaState_Analysed;
+	sema_wake_waiters(s, g);
+}
+
+// queues a root by name, returns false if the module has no such global
+static bool sema_add_root(Sema *s, uint16_t module_id, const char *name){
+	SemaModule *sm = sema_module(s, module_id);
+	if (sm->module == NULL) return false;
+	NameId name_id = find_name_id(sm->module->ctx, name, strlen(name));
+	if (name_id == 0) return false;
+	VarIndex var = scope_find(&sm->scopes, name_id);
+	if (var < 0) return false;
+	sema_require(s, module_id, sm->scopes.vars[var].value_idx);
+	return true;
+}
+
+static void sema_add_all_roots(Sema *s, uint16_t module_id){
+	SemaModule *sm = sema_module(s, module_id);
+	for (uint32_t i=0; i!=sm->global_count; i+=1) sema_require(s, module_id, i);
+}
+
+// analyses queued globals and everything they reach
+static void sema_run(Sema *s){
+	TraceSpan span = trace_begin("analyse");
+	while (s->queue_size != 0){
+		s->queue_size -= 1;
+		SemaItem item = s->queue[s->queue_size];
+		SemaGlobal *g = sema_global(s, item);
+		// a global can be queued more than once, it runs when it is not
+		// finished and does not wait for anything
+		if (sema_is_finished(g)) continue;
+		if (g->state == SemaState_Suspended && !sema_is_finished(sema_global(s, g->waiting_on))){
+			continue;
+		}
+		sema_analyse(s, item);
+	}
+	trace_end(span);
+}
+
+static SemaStats sema_stats(const Sema *s){
+	SemaStats stats = {
+		.suspensions = s->suspensions, .cycles = s->cycles, .nodes_visited = s->nodes_visited
+	};
+	for (uint32_t i=0; i!=s->module_count; i+=1){
+		const SemaModule *sm = s->modules + i;
+		if (sm->module == NULL) continue;
+		stats.globals += sm->global_count;
+		stats.redefined += sm->global_count - sm->global_var_count;
+		for (uint32_t j=0; j!=sm->global_count; j+=1){
+			const SemaGlobal *g = sm->globals + j;
+			bool analysed = g->state == SemaState_Analysed;
+			stats.globals_analysed += analysed;
+			if (analysed) stats.nodes += g->end - g->begin;
+			stats.unresolved += g->unresolved_count;
+			if (g->body_size == 0) continue;
+			stats.procedures += 1;
+			stats.body_nodes += g->body_size;
+			if (analysed){
+				stats.bodies_analysed += 1;
+			} else{
+				stats.bodies_skipped += 1;
+				stats.body_nodes_skipped += g->body_size;
+			}
+		}
+	}
+	return stats;
+}
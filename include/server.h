@@ -0,0 +1,321 @@
+#pragma once
+
+#include "utils.h"
+#include "parser.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+
+// PROTOCOL
+// every request is a single line sent over a new connection, the server sends
+// back a textual reply and closes the connection
+//   parse <absolute path>  -> ok/error line
+//   stats                  -> cache and table statistics
+//   stop                   -> server exits
+#define SERVER_DEFAULT_SOCKET "/tmp/yackd.sock"
+#define SERVER_MESSAGE_CAPACITY 4096
+#define SERVER_TIMEOUT_MS       2000 // an idle client doesn't stall other requests longer
+
+
+static int server_connect(const char *socket_path){
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(socket_path) >= sizeof(addr.sun_path)) return -1;
+	strcpy(addr.sun_path, socket_path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1) return -1;
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0){
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int server_listen(const char *socket_path){
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(socket_path) >= sizeof(addr.sun_path)) return -1;
+	strcpy(addr.sun_path, socket_path);
+
+	// only a socket that nobody listens on is replaced
+	struct stat s;
+	if (lstat(socket_path, &s) == 0){
+		if (!S_ISSOCK(s.st_mode)) return -1;
+		int live_fd = server_connect(socket_path);
+		if (live_fd != -1){
+			close(live_fd);
+			return -1;
+		}
+		unlink(socket_path);
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1) return -1;
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0){
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void server_set_timeout(int fd){
+	struct timeval timeout = {
+		.tv_sec = SERVER_TIMEOUT_MS / 1000, .tv_usec = SERVER_TIMEOUT_MS % 1000 * 1000
+	};
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+static bool server_write_all(int fd, const char *data, size_t size){
+	while (size != 0){
+		ssize_t written = write(fd, data, size);
+		if (written <= 0) return false;
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+// reads until newline, end of stream or timeout, the result is always null
+// terminated
+static size_t server_read_line(int fd, char *buf, size_t capacity){
+	size_t size = 0;
+	while (size+1 < capacity){
+		ssize_t received = read(fd, buf+size, capacity-1-size);
+		if (received <= 0) break;
+		size += received;
+		if (buf[size-1] == '\n') break;
+	}
+	buf[size] = '\0';
+	return size;
+}
+
+
+
+
+// SOURCE CACHE
+// keeps lexed and parsed files alive between requests, a file is parsed again
+// only if its stat information and content hash both changed
+typedef struct{
+	char    *path;
+	uint64_t path_hash;
+
+	// fast check, compared before touching the file contents
+	struct timespec mtime;
+	off_t    size;
+	ino_t    inode;
+
+	uint64_t content_hash;
+
+	AstArray tokens;
+	AstArray ast;
+	// string literals of the trees, bufinfo indexes of their strings are
+	// relative to this instead of the bytecode buffer
+	BcNode  *strings;
+	size_t   string_nodes;
+	size_t   token_count;
+	size_t   node_count;
+
+	// error information, tokens and ast are empty when error is set
+	const char *error;
+	uint32_t    error_row;
+	uint32_t    error_col;
+} CachedSource;
+
+typedef struct{
+	CachedSource *data;
+	size_t size;
+	size_t capacity;
+
+	size_t hits;
+	size_t reparses;
+} SourceCache;
+
+
+static uint64_t source_hash(const char *data, size_t size){
+	// fnv-1a hash
+	uint64_t hash = 0xcbf29ce484222325u;
+	for (size_t i=0; i!=size; i+=1){
+		hash = (hash ^ (uint8_t)data[i]) * 0x100000001b3u;
+	}
+	return hash;
+}
+
+static void source_cache_init(SourceCache *cache){
+	cache->capacity = 64;
+	cache->size = 0;
+	cache->data = calloc(cache->capacity, sizeof(CachedSource));
+	assert(cache->data != NULL);
+	cache->hits = 0;
+	cache->reparses = 0;
+}
+
+static CachedSource *source_cache_find(SourceCache *cache, const char *path){
+	UNLIKELY if (4*(cache->size+1) >= 3*cache->capacity){
+		// resize hash table
+		size_t new_capacity = 2*cache->capacity;
+		CachedSource *new_data = calloc(new_capacity, sizeof(CachedSource));
+		assert(new_data != NULL && "source cache allocation failrule");
+		for (size_t i=0; i!=cache->capacity; i+=1){
+			CachedSource old_entry = cache->data[i];
+			if (old_entry.path == NULL) continue;
+			size_t index = old_entry.path_hash & (new_capacity - 1);
+			for (size_t j=0; new_data[index].path!=NULL; j+=1){
+				index = (index + j + 1) & (new_capacity - 1);
+			}
+			new_data[index] = old_entry;
+		}
+		free(cache->data);
+		cache->data = new_data;
+		cache->capacity = new_capacity;
+	}
+
+	uint64_t hash = source_hash(path, strlen(path));
+	size_t index_mask = cache->capacity - 1;
+	size_t index = hash & index_mask;
+	for (size_t i=0;; i+=1){
+		CachedSource *entry = cache->data + index;
+		if (entry->path == NULL) break;
+		if (entry->path_hash == hash && strcmp(entry->path, path) == 0) return entry;
+		index = (index + i + 1) & index_mask;
+	}
+
+	CachedSource *entry = cache->data + index;
+	entry->path = strdup(path);
+	assert(entry->path != NULL);
+	entry->path_hash = hash;
+	cache->size += 1;
+	return entry;
+}
+
+
+static void source_position(const char *text, uint32_t pos, uint32_t *row, uint32_t *col){
+	*row = 0;
+	*col = 0;
+	for (size_t i=0; i!=pos && text[i]!='\0'; i+=1){
+		*col += 1;
+		if (text[i]=='\n' || text[i]=='\v'){
+			*row += 1;
+			*col = 0;
+		}
+	}
+}
+
+static size_t source_count_nodes(AstArray ast, const uint8_t *sizes){
+	size_t res = 0;
+	for (size_t i=1; i<(size_t)(ast.end-ast.data);){
+		AstNode node = ast.data[i];
+		i += sizes[node.type];
+		res += 1;
+		if (node.type == Ast_Terminator) break;
+	}
+	return res;
+}
+
+
+static const char *source_string(const CachedSource *entry, const AstNode *string_node){
+	return (const char *)(entry->strings + string_node[1].data.bufinfo.index);
+}
+
+static void source_relocate_strings(AstArray nodes, const uint8_t *sizes, uint32_t bc_mark){
+	for (size_t i=1; i<(size_t)(nodes.end-nodes.data); i+=sizes[nodes.data[i].type]){
+		if (nodes.data[i].type == Ast_Terminator) break;
+		if (nodes.data[i].type == Ast_String) nodes.data[i+1].data.bufinfo.index -= bc_mark;
+	}
+}
+
+// the lexer puts string literals to the end of the bytecode buffer, they are
+// moved to the entry and the buffer is rewound, so a reparse takes no space
+// in it and other entries keep their strings
+static void source_keep_strings(CompilerContext *ctx, CachedSource *entry, size_t bc_mark){
+	size_t node_count = ctx->bc_size - bc_mark;
+	if (entry->ast.data != NULL && node_count != 0){
+		entry->strings = malloc(node_count*sizeof(BcNode));
+		assert(entry->strings != NULL && "source cache allocation failrule");
+		memcpy(entry->strings, ctx->bc + bc_mark, node_count*sizeof(BcNode));
+		entry->string_nodes = node_count;
+		memory_track(MemTag_Source, node_count*sizeof(BcNode));
+		source_relocate_strings(entry->tokens, TokenSizes, bc_mark);
+		source_relocate_strings(entry->ast, AstNodeSizes, bc_mark);
+	}
+	memory_track(MemTag_Bytecode, -(int64_t)(node_count*sizeof(BcNode)));
+	ctx->bc_size = bc_mark;
+}
+
+// returns false when the file cannot be read
+static bool source_cache_update(
+	CompilerContext *ctx, SourceCache *cache, CachedSource *entry, bool *reparsed
+){
+	*reparsed = false;
+	struct stat s;
+	if (stat(entry->path, &s) != 0 || !S_ISREG(s.st_mode)) return false;
+
+	bool same_stat = (
+		entry->content_hash != 0 &&
+		s.st_mtim.tv_sec == entry->mtime.tv_sec &&
+		s.st_mtim.tv_nsec == entry->mtime.tv_nsec &&
+		s.st_size == entry->size &&
+		s.st_ino == entry->inode
+	);
+	if (same_stat){
+		cache->hits += 1;
+		return true;
+	}
+
+	StringView text = mmap_file(entry->path);
+	if (text.data == NULL) return false;
+
+	entry->mtime = s.st_mtim;
+	entry->size  = s.st_size;
+	entry->inode = s.st_ino;
+
+	uint64_t content_hash = source_hash(text.data, text.size);
+	if (content_hash == entry->content_hash){
+		unmap_file(text);
+		cache->hits += 1;
+		return true;
+	}
+	entry->content_hash = content_hash;
+
+	ast_array_free(&entry->tokens);
+	ast_array_free(&entry->ast);
+	entry->tokens = (AstArray){};
+	entry->ast = (AstArray){};
+	memory_track(MemTag_Source, -(int64_t)(entry->string_nodes*sizeof(BcNode)));
+	free(entry->strings);
+	entry->strings = NULL;
+	entry->string_nodes = 0;
+	entry->token_count = 0;
+	entry->node_count = 0;
+	entry->error = NULL;
+
+	size_t bc_mark = ctx->bc_size;
+	AstArray tokens = make_tokens(ctx, text.data);
+	if (tokens.data == NULL){
+		entry->error = tokens.error;
+		source_position(text.data, tokens.position, &entry->error_row, &entry->error_col);
+		goto Return;
+	}
+	AstArray ast_buffer = ast_array_clone(tokens);
+	AstArray ast = parse_tokens(ctx, ast_buffer);
+	if (ast.data == NULL){
+		ast_array_free(&tokens);
+		ast_array_free(&ast_buffer);
+		entry->error = ast.error;
+		source_position(text.data, ast.position, &entry->error_row, &entry->error_col);
+		goto Return;
+	}
+	entry->tokens = tokens;
+	entry->ast = ast;
+	entry->token_count = source_count_nodes(tokens, TokenSizes);
+	entry->node_count = source_count_nodes(ast, AstNodeSizes);
+
+Return:
+	source_keep_strings(ctx, entry, bc_mark);
+	unmap_file(text);
+	cache->reparses += 1;
+	*reparsed = true;
+	return true;
+}
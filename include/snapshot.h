@@ -0,0 +1,238 @@
+#pragma once
+
+#include "utils.h"
+#include "classes.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+// COMPILER SNAPSHOT
+// image of an initialized compiler context, it contains only offsets, so it
+// can be mapped at any address. every section starts at a page boundary,
+// the bytecode and class info sections are mapped over the beginning of
+// reserved buffers, so they can grow past the image with copy on write
+#define SNAPSHOT_MAGIC   0x50414e534b434159u // "YACKSNAP"
+#define SNAPSHOT_VERSION 2u // bumped when layouts of class infos change
+
+typedef struct{
+	uint64_t offset;
+	uint64_t size;     // used bytes
+	uint64_t capacity; // bytes reserved in the image
+	uint64_t count;    // elements, meaning depends on the section
+} SnapshotSection;
+
+typedef struct{
+	uint64_t magic;
+	uint32_t version;
+	uint32_t page_size;
+
+	// sizes of structures, a snapshot is usable only by the same build
+	uint32_t layout[4];
+
+	SnapshotSection bc;
+	SnapshotSection classes;
+	SnapshotSection name_set;
+	SnapshotSection names;
+	SnapshotSection array_set;
+	SnapshotSection tuple_set;
+
+	uint32_t bc_head_next;
+	uint32_t bc_last; // UINT32_MAX means the list head
+} SnapshotHeader;
+
+
+static void snapshot_layout(uint32_t *layout){
+	layout[0] = sizeof(BcNode);
+	layout[1] = sizeof(ClassInfoHeader);
+	layout[2] = sizeof(struct NameEntry);
+	layout[3] = BC_BUFFER_CAPACITY;
+}
+
+static SnapshotSection snapshot_section(
+	uint64_t *offset, uint64_t size, uint64_t capacity, uint64_t count, uint64_t page_size
+){
+	SnapshotSection res = {
+		.offset = *offset, .size = size, .capacity = capacity, .count = count
+	};
+	*offset += util_alignsize(capacity, page_size);
+	return res;
+}
+
+static bool snapshot_write(int fd, const void *data, size_t size, uint64_t offset){
+	const uint8_t *it = data;
+	while (size != 0){
+		ssize_t written = pwrite(fd, it, size, offset);
+		if (written <= 0) return false;
+		it += written;
+		offset += written;
+		size -= written;
+	}
+	return true;
+}
+
+
+static bool save_compiler_snapshot(const CompilerContext *ctx, const char *path){
+	uint64_t page_size = sysconf(_SC_PAGESIZE);
+
+	SnapshotHeader h = {
+		.magic = SNAPSHOT_MAGIC,
+		.version = SNAPSHOT_VERSION,
+		.page_size = page_size
+	};
+	snapshot_layout(h.layout);
+
+	uint64_t offset = util_alignsize(sizeof(SnapshotHeader), page_size);
+	size_t bc_bytes = ctx->bc_size*sizeof(BcNode);
+	size_t classes_bytes = ctx->classes.size*sizeof(ClassInfoHeader);
+	size_t name_set_bytes = ctx->name_set.capacity*sizeof(struct NameEntry);
+	size_t array_set_bytes = ctx->array_set.capacity*sizeof(struct ArrayClassEntry);
+	size_t tuple_set_bytes = ctx->tuple_set.capacity*sizeof(struct TupleClassEntry);
+	h.bc = snapshot_section(&offset, bc_bytes, bc_bytes, ctx->bc_size, page_size);
+	h.classes = snapshot_section(
+		&offset, classes_bytes, classes_bytes, ctx->classes.size, page_size
+	);
+	h.name_set = snapshot_section(
+		&offset, name_set_bytes, name_set_bytes, ctx->name_set.size, page_size
+	);
+	h.names = snapshot_section(
+		&offset, ctx->names.size, ctx->names.capacity, ctx->names.size, page_size
+	);
+	h.array_set = snapshot_section(
+		&offset, array_set_bytes, array_set_bytes, ctx->array_set.size, page_size
+	);
+	h.tuple_set = snapshot_section(
+		&offset, tuple_set_bytes, tuple_set_bytes, ctx->tuple_set.size, page_size
+	);
+
+	h.bc_head_next = ctx->bc_head.inext;
+	h.bc_last = ctx->bc_last == &ctx->bc_head ? UINT32_MAX : ctx->bc_last - ctx->bc;
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) return false;
+	// unwritten parts of sections are holes, so they read as zeros
+	bool ok = (
+		ftruncate(fd, offset) == 0 &&
+		snapshot_write(fd, &h, sizeof(h), 0) &&
+		snapshot_write(fd, ctx->bc, h.bc.size, h.bc.offset) &&
+		snapshot_write(fd, ctx->classes.data, h.classes.size, h.classes.offset) &&
+		snapshot_write(fd, ctx->name_set.data, h.name_set.size, h.name_set.offset) &&
+		snapshot_write(fd, ctx->names.data, h.names.size, h.names.offset) &&
+		snapshot_write(fd, ctx->array_set.data, h.array_set.size, h.array_set.offset) &&
+		snapshot_write(fd, ctx->tuple_set.data, h.tuple_set.size, h.tuple_set.offset)
+	);
+	close(fd);
+	return ok;
+}
+
+
+// maps the buffer reservation and places the image section at its start
+static void *snapshot_map_buffer(int fd, SnapshotSection section, size_t capacity_bytes){
+	void *buffer = mmap(
+		NULL, capacity_bytes, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0
+	);
+	if (buffer == MAP_FAILED) return NULL;
+	if (section.capacity != 0){
+		void *mapped = mmap(
+			buffer, section.capacity, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_FIXED, fd, section.offset
+		);
+		if (mapped == MAP_FAILED){
+			munmap(buffer, capacity_bytes);
+			return NULL;
+		}
+	}
+	return buffer;
+}
+
+// initializes the context from a snapshot image instead of init_compiler_context,
+// the image is mapped privately, so the file is never modified
+static bool load_compiler_snapshot(CompilerContext *ctx, const char *path){
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) return false;
+
+	struct stat s;
+	if (fstat(fd, &s) != 0 || (size_t)s.st_size < sizeof(SnapshotHeader)){
+		close(fd);
+		return false;
+	}
+
+	uint8_t *image = mmap(NULL, s.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (image == MAP_FAILED){
+		close(fd);
+		return false;
+	}
+
+	const SnapshotHeader *h = (const SnapshotHeader *)image;
+	uint32_t layout[SIZE(h->layout)];
+	snapshot_layout(layout);
+	if (
+		h->magic != SNAPSHOT_MAGIC || h->version != SNAPSHOT_VERSION ||
+		h->page_size != (uint64_t)sysconf(_SC_PAGESIZE) ||
+		memcmp(layout, h->layout, sizeof(layout)) != 0 ||
+		h->tuple_set.offset + h->tuple_set.capacity > (uint64_t)s.st_size
+	) goto ReturnError;
+
+	size_t classes_capacity = CLASS_INFO_CAPACITY;
+	BcNode *bc = snapshot_map_buffer(fd, h->bc, BC_BUFFER_CAPACITY*sizeof(BcNode));
+	if (bc == NULL) goto ReturnError;
+	ClassInfoHeader *classes = snapshot_map_buffer(
+		fd, h->classes, classes_capacity*sizeof(ClassInfoHeader)
+	);
+	if (classes == NULL){
+		munmap(bc, BC_BUFFER_CAPACITY*sizeof(BcNode));
+		goto ReturnError;
+	}
+	close(fd);
+
+	ctx->bc = bc;
+	ctx->bc_size = h->bc.count;
+	ctx->bc_head = (BcNode){ .inext = h->bc_head_next };
+	ctx->bc_last = h->bc_last == UINT32_MAX ? &ctx->bc_head : bc + h->bc_last;
+
+	ctx->classes = (struct ClassInfoArray){
+		.data = classes, .size = h->classes.count, .capacity = classes_capacity
+	};
+	ctx->name_set = (struct GlobalNameSet){
+		.data = (struct NameEntry *)(image + h->name_set.offset),
+		.size = h->name_set.count,
+		.capacity = h->name_set.capacity / sizeof(struct NameEntry)
+	};
+	ctx->names = (struct GlobalNameData){
+		.data = image + h->names.offset,
+		.size = h->names.size,
+		.capacity = h->names.capacity
+	};
+	ctx->array_set = (struct ArrayClassSet){
+		.data = (struct ArrayClassEntry *)(image + h->array_set.offset),
+		.size = h->array_set.count,
+		.capacity = h->array_set.capacity / sizeof(struct ArrayClassEntry)
+	};
+	ctx->tuple_set = (struct TupleClassSet){
+		.data = (struct TupleClassEntry *)(image + h->tuple_set.offset),
+		.size = h->tuple_set.count,
+		.capacity = h->tuple_set.capacity / sizeof(struct TupleClassEntry)
+	};
+	init_instance_set(ctx);
+	init_call_cache(ctx);
+	init_eval_memo(ctx);
+	ctx->hash_colissions = 0;
+	ctx->image.data = image;
+	ctx->image.size = s.st_size;
+
+	memory_track(MemTag_Bytecode, h->bc.size);
+	memory_track(MemTag_Classes, h->classes.size);
+	memory_track(MemTag_NameSet, h->name_set.capacity);
+	memory_track(MemTag_Names, h->names.capacity);
+	memory_track(MemTag_ArraySet, h->array_set.capacity);
+	memory_track(MemTag_TupleSet, h->tuple_set.capacity);
+	return true;
+
+ReturnError:
+	munmap(image, s.st_size);
+	close(fd);
+	return false;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "utils.h"
+#include "ast_nodes.h"
+
+
+// COMPILE TIME INSTRUMENTATION
+// counters are enabled by defining YACK_STATS, otherwise every STATS_ macro
+// expands to nothing and the compiled code is the same as without them.
+// counters are thread local, so contexts on different threads don't share
+// cache lines, the report is printed by print_compiler_stats in classes.h
+#define STATS_PROBE_BUCKETS 16 // the last bucket counts all longer probes
+
+enum StatsTable{
+	StatsTable_Names,
+	StatsTable_Arrays,
+	StatsTable_Tuples,
+	StatsTable_Scopes,
+	StatsTable_Instances,
+	StatsTable_Calls,
+	StatsTable_EvalMemo,
+	StatsTable_Fields,
+	StatsTable_EnumNames,
+	StatsTable_Count
+};
+
+static const char *const StatsTableNames[] = {
+	"name_set", "array_set", "tuple_set", "scope_index", "instance_set",
+	"call_cache", "eval_memo", "struct_fields",
+	"enum_names"
+};
+
+#ifdef YACK_STATS
+
+typedef struct{
+	uint64_t probes[StatsTable_Count][STATS_PROBE_BUCKETS];
+	uint64_t resizes[StatsTable_Count];
+	uint64_t name_data_resizes;
+	uint64_t token_counts[SIZE(AstTypeNames)];
+	uint64_t ast_grows;
+	uint64_t ast_grow_bytes;
+} CompilerStats;
+
+static _Thread_local CompilerStats compiler_stats;
+
+// probe_count is the number of visited slots, including the last one
+#define STATS_PROBE(table, probe_count) \
+	(compiler_stats.probes[table][ \
+		util_min_usize((probe_count), STATS_PROBE_BUCKETS) - 1 \
+	] += 1)
+
+#define STATS_RESIZE(table) (compiler_stats.resizes[table] += 1)
+
+#define STATS_NAME_DATA_RESIZE() (compiler_stats.name_data_resizes += 1)
+
+#define STATS_AST_GROW(new_bytes) \
+	(compiler_stats.ast_grows += 1, compiler_stats.ast_grow_bytes += (new_bytes))
+
+// counts tokens of a finished token array, the first token is a terminator
+#define STATS_COUNT_TOKENS(begin, end) \
+	for (const AstNode *stats_it=(begin); stats_it!=(end);){ \
+		compiler_stats.token_counts[stats_it->type] += 1; \
+		stats_it += TokenSizes[stats_it->type]; \
+	}
+
+#define STATS_RESET() (compiler_stats = (CompilerStats){})
+
+#else
+
+#define STATS_PROBE(table, probe_count)
+#define STATS_RESIZE(table)
+#define STATS_NAME_DATA_RESIZE()
+#define STATS_AST_GROW(new_bytes)
+#define STATS_COUNT_TOKENS(begin, end)
+#define STATS_RESET()
+
+#endif
@@ -1,3 +1,5 @@
+#pragma once
+
 #include "utils.h"
 #include "ast_nodes.h"
 
@@ -253,6 +255,14 @@ typedef struct{
 } EnumClassInfo;
 
 
+// stored fields are laid out in the order of declaration or, when opted in,
+// ordered by alignment to leave no padding between them. fields keep their
+// indexes in both cases, only their offsets differ
+enum StructLayout{
+	StructLayout_Declared,
+	StructLayout_Compact
+};
+
 typedef struct{
 	uint32_t bytesize  : 24;
 	uint8_t  alignment :  8;
@@ -266,6 +276,7 @@ typedef struct{
 	uint16_t module_id;
 	uint8_t  state;
 	uint8_t  name_length;
+	enum StructLayout layout : 8;
 
 	char     *name;
 
@@ -275,14 +286,52 @@ typedef struct{
 } StructClassInfo;
 
 
+// instance of a generic procedure, the key is the procedure with values of
+// its compile time arguments followed by the infered classes
 typedef struct{
-	uint32_t bc_index;
-	uint16_t hash;
+	uint64_t hash;
+	uint32_t proc_idx;  // class info index of the generic procedure
+	uint32_t bc_index;  // UINT32_MAX until the instance is generated
 	uint16_t data_size;
 	Data data[];
 } InstanceInfo;
 
 
+enum ArgConversion{
+	ArgConversion_None,
+	ArgConversion_ZeroExtend,
+	ArgConversion_SignExtend,
+	ArgConversion_Value // compile time argument that is matched by its value
+};
+
+// result of matching arguments of a call with parameters of a procedure, the
+// key is the procedure with classes of the arguments and the mask of compile
+// time arguments
+typedef struct{
+	uint64_t hash;
+	uint32_t proc_idx;
+	uint8_t  arg_count;
+	uint8_t  infer_count;
+	uint64_t const_mask;
+	uint64_t infer_mask; // named infers that were set, from index 1
+	Class    classes[]; // classes of the arguments
+// Class   targets[];     // pretend it exists
+// Class   infers[];      // pretend it exists
+// uint8_t conversions[]; // pretend it exists
+} CallResolution;
+
+
+// memoized evaluation of a class that depends on infers, the key is the class
+// followed by what it depends on, the value is what the key maps to
+typedef struct{
+	uint64_t hash;
+	uint16_t key_size;
+	uint16_t value_size;
+	Data     data[]; // key
+// Data    value[]; // pretend it exists
+} EvalRecord;
+
+
 // structures that containt information abount non unique classes
 typedef struct{
 	uint32_t bytesize  : 24;
@@ -300,10 +349,7 @@ typedef struct{
 
 	uint16_t module_id;
 
-	InstanceInfo *instances;
-	uint16_t instance_count;
-	uint16_t instance_capacity;
-	
+	// instances are kept in the instance set of the context
 	uint32_t ast_pos;
 	NameId   name_id;
 
@@ -360,11 +406,11 @@ typedef union AstNode{
 
 // SEMENTIC ALALYSIS REALTED STRUCTS
 enum ValueFlags{
-	VF_Const = 0,
-	VF_Big,
-	VF_Dependant,
-	VF_Lvalue,
-	VF_Uninitialized
+	VF_Const         = 1 << 0,
+	VF_Big           = 1 << 1,
+	VF_Dependant     = 1 << 2,
+	VF_Lvalue        = 1 << 3,
+	VF_Uninitialized = 1 << 4
 };
 
 
@@ -489,6 +535,45 @@ enum BcType{
 	// reassigning operations used for implicit converions
 	BC_ZeroExtendVariable,
 	BC_SignExtendVariable,
+
+	// arithmetic on 64 bit words, narrower results are truncated by extensions
+	BC_Add,
+	BC_Subtract,
+	BC_Multiply,
+	BC_Divide,
+	BC_DivideSigned,
+	BC_Modulo,
+	BC_ModuloSigned,
+	BC_Negate,
+	BC_BitAnd,
+	BC_BitOr,
+	BC_BitXor,
+	BC_BitNot,
+	BC_ShiftLeft,
+	BC_ShiftRight,
+	BC_ShiftRightSigned,
+
+	BC_AddFloat,
+	BC_SubtractFloat,
+	BC_MultiplyFloat,
+	BC_DivideFloat,
+
+	// comparisons push 0 or 1
+	BC_Equal,
+	BC_NotEqual,
+	BC_Less,
+	BC_LessSigned,
+	BC_LessEqual,
+	BC_LessEqualSigned,
+	BC_LessFloat,
+	BC_LessEqualFloat,
+
+	// control flow, targets are in the node after the operation
+	BC_Jump,
+	BC_JumpIfZero,
+	BC_JumpIfNotZero,
+	BC_Call,
+	BC_Return,
 };
 
 
@@ -523,5 +608,6 @@ typedef struct BcProcHeader{
 	bool is_inline : 1;
 	bool is_pure   : 1;
 	bool is_const  : 1;
+	bool is_linear : 1; // body is contiguous, see bc_linearize
 } BcProcHeader;
 
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+
+// PHASE TRACING
+// spans are recorded into per thread ring buffers and written at exit as
+// chrome trace event json, which can be opened in perfetto or chrome://tracing.
+// while tracing is off a span costs a single branch
+#define TRACE_BUFFER_CAPACITY (1 << 16) // events per thread, must be a power of 2
+
+typedef struct{
+	const char *name; // must outlive the program, usually a string literal
+	uint64_t begin;
+	uint64_t end;
+} TraceEvent;
+
+typedef struct TraceBuffer{
+	struct TraceBuffer *next;
+	uint32_t tid;
+	uint64_t count; // all recorded events, only the last ones are kept
+	TraceEvent events[TRACE_BUFFER_CAPACITY];
+} TraceBuffer;
+
+typedef struct{
+	const char *name;
+	uint64_t begin;
+} TraceSpan;
+
+static struct{
+	bool enabled;
+	const char *path;
+	uint64_t start;
+	pthread_mutex_t lock; // guards the buffer list
+	TraceBuffer *buffers;
+	uint32_t thread_count;
+} trace_state = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static _Thread_local TraceBuffer *trace_buffer;
+
+
+static uint64_t trace_now_ns(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec*1000000000u + (uint64_t)t.tv_nsec;
+}
+
+static void trace_record(const char *name, uint64_t begin, uint64_t end){
+	TraceBuffer *buffer = trace_buffer;
+	UNLIKELY if (buffer == NULL){
+		buffer = malloc(sizeof(TraceBuffer));
+		if (buffer == NULL) return; // tracing is best effort
+		buffer->count = 0;
+		pthread_mutex_lock(&trace_state.lock);
+		buffer->tid = trace_state.thread_count;
+		trace_state.thread_count += 1;
+		buffer->next = trace_state.buffers;
+		trace_state.buffers = buffer;
+		pthread_mutex_unlock(&trace_state.lock);
+		trace_buffer = buffer;
+	}
+	buffer->events[buffer->count & (TRACE_BUFFER_CAPACITY-1)] = (TraceEvent){
+		.name = name, .begin = begin, .end = end
+	};
+	buffer->count += 1;
+}
+
+static TraceSpan trace_begin(const char *name){
+	TraceSpan span = { .name = name };
+	UNLIKELY if (trace_state.enabled) span.begin = trace_now_ns();
+	return span;
+}
+
+static void trace_end(TraceSpan span){
+	UNLIKELY if (trace_state.enabled) trace_record(span.name, span.begin, trace_now_ns());
+}
+
+
+static void trace_write_event(FILE *out, bool *first, uint32_t tid, TraceEvent e){
+	fprintf(out,
+		"%s\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, "
+		"\"ts\": %.3lf, \"dur\": %.3lf}",
+		*first ? "" : ",", e.name, tid,
+		(double)(e.begin - trace_state.start)*1e-3, (double)(e.end - e.begin)*1e-3
+	);
+	*first = false;
+}
+
+// writes all buffers, it is registered with atexit by trace_init, so it also
+// runs when the compiler exits on an error. buffers are not freed, since other
+// threads can still be recording into them
+static void trace_flush(void){
+	if (!trace_state.enabled) return;
+	trace_state.enabled = false;
+
+	FILE *out = fopen(trace_state.path, "w");
+	if (out == NULL){
+		fprintf(stderr, "cannot write the trace: \"%s\"\n", trace_state.path);
+		return;
+	}
+	fprintf(out, "{\"traceEvents\": [");
+	bool first = true;
+	pthread_mutex_lock(&trace_state.lock);
+	for (TraceBuffer *b=trace_state.buffers; b!=NULL;){
+		fprintf(out,
+			"%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+			"\"args\": {\"name\": \"thread %u\"}}",
+			first ? "" : ",", b->tid, b->tid
+		);
+		first = false;
+		uint64_t begin = b->count > TRACE_BUFFER_CAPACITY ? b->count - TRACE_BUFFER_CAPACITY : 0;
+		for (uint64_t i=begin; i!=b->count; i+=1){
+			trace_write_event(out, &first, b->tid, b->events[i & (TRACE_BUFFER_CAPACITY-1)]);
+		}
+		b = b->next;
+	}
+	pthread_mutex_unlock(&trace_state.lock);
+	fprintf(out, "\n], \"displayTimeUnit\": \"ms\"}\n");
+	fclose(out);
+}
+
+static void trace_init(const char *path){
+	if (trace_state.enabled) return;
+	trace_state.path = path;
+	trace_state.start = trace_now_ns();
+	trace_state.enabled = true;
+	atexit(trace_flush);
+}
+
+// handles the --trace=<file.json> option of drivers
+static bool trace_parse_option(const char *arg){
+	if (strncmp(arg, "--trace=", 8) != 0) return false;
+	trace_init(arg + 8);
+	return true;
+}
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "classes.h"
+#include "bench.h"
+
+
+// call resolution benchmark, procedures with integer, float, pointer and
+// infered parameters are called from many call sites with arguments of
+// classes that convert to the parameters, some of them compile time values.
+// the call sites are matched over and over, argument by argument and through
+// the call resolution cache
+#define MAX_PARAMS 8
+#define MAX_INFERS 3
+
+typedef struct{
+	uint32_t proc_idx;
+	uint8_t  arg_count;
+	ValueInfo args[MAX_PARAMS];
+} Call;
+
+typedef struct{
+	size_t matched;
+	size_t conversions;
+	uint64_t checksum; // of matched classes and infers, must be the same for both
+} CallCounts;
+
+static const Class Integers[] = {
+	CLASS_U8, CLASS_U16, CLASS_U32, CLASS_U64, CLASS_I8, CLASS_I16, CLASS_I32, CLASS_I64
+};
+
+
+
+// GENERATOR
+static Class random_param(BenchRandom *rng, uint8_t *infer_count){
+	switch (bench_random_below(rng, 8)){
+	case 0: return CLASS_F64;
+	case 1: return class_add_prefix(CLASS_U8, ClassPrefix_Pointer);
+	case 2:
+		if (*infer_count == MAX_INFERS) break;
+		*infer_count += 1;
+		return (Class){ .tag = Class_Infered, .infered = true, .param_id = *infer_count };
+	default: break;
+	}
+	return Integers[bench_random_below(rng, SIZE(Integers))];
+}
+
+static uint32_t add_procedure(CompilerContext *ctx, BenchRandom *rng){
+	uint8_t param_count = 1 + bench_random_below(rng, MAX_PARAMS);
+	uint32_t idx = class_info_alloc(ctx, sizeof(ProcedureClassInfo) + param_count*sizeof(Class));
+	ProcedureClassInfo *info = procedure_class_info(ctx, idx);
+	*info = (ProcedureClassInfo){ .param_count = param_count };
+	uint8_t infer_count = 0;
+	for (size_t i=0; i!=param_count; i+=1) info->classes[i] = random_param(rng, &infer_count);
+	info->named_infers_count = infer_count;
+	return idx;
+}
+
+// arguments convert to the parameters, integers can be narrower and compile
+// time integers are small values of any integer class
+static ValueInfo random_arg(BenchRandom *rng, Class param){
+	ValueInfo arg = { .clas = param };
+	if (param.tag == Class_Infered){
+		arg.clas = Integers[bench_random_below(rng, 4)];
+		if (bench_random_below(rng, 2)) arg.clas = CLASS_F64;
+		return arg;
+	}
+	if (param.prefixes != 0 || (param.tag != Class_Unsigned && param.tag != Class_Integer)){
+		return arg;
+	}
+	if (bench_random_below(rng, 8) == 0){
+		arg.clas = Integers[bench_random_below(rng, SIZE(Integers))];
+		arg.flags = VF_Const;
+		arg.data.u64 = bench_random_below(rng, 100);
+		return arg;
+	}
+	uint32_t size_log = util_trailing_zeros_u32(param.basic_size);
+	Class narrower = Integers[bench_random_below(rng, size_log+1)];
+	if (param.tag == Class_Integer && bench_random_below(rng, 2)){
+		narrower = Integers[4 + bench_random_below(rng, size_log+1)];
+	}
+	arg.clas = narrower;
+	return arg;
+}
+
+// calls of a procedure use a few argument combinations, like calls in real code
+static void gen_sites(
+	CompilerContext *ctx, Call *sites, size_t site_count, const uint32_t *procs, size_t proc_count,
+	size_t variants, uint64_t seed
+){
+	BenchRandom rng = { seed | 1u };
+	for (size_t i=0; i!=site_count; i+=1){
+		uint32_t p = bench_random_below(&rng, proc_count);
+		BenchRandom variant = { (p*variants + bench_random_below(&rng, variants)) | 1u };
+		const ProcedureClassInfo *info = procedure_class_info(ctx, procs[p]);
+		Call *c = sites + i;
+		c->proc_idx = procs[p];
+		c->arg_count = info->param_count;
+		for (size_t j=0; j!=c->arg_count; j+=1) c->args[j] = random_arg(&variant, info->classes[j]);
+	}
+}
+
+
+
+// MATCHING
+static void count_call(
+	CallCounts *c, const ValueInfo *args, size_t arg_count,
+	const ValueInfo *infers, const uint8_t *conversions
+){
+	c->matched += 1;
+	for (size_t i=0; i!=arg_count; i+=1){
+		c->conversions += conversions[i] != ArgConversion_None;
+		c->checksum = (c->checksum ^ args[i].clas.id ^ args[i].data.u64) * 0x9E3779B97F4A7C15ull;
+	}
+	for (size_t i=1; i<=MAX_INFERS; i+=1){
+		c->checksum = (c->checksum ^ infers[i].data.clas.id) * 0x9E3779B97F4A7C15ull;
+	}
+}
+
+static CallCounts run_calls(
+	CompilerContext *ctx, const Call *sites, size_t site_count, size_t call_count, bool cached
+){
+	CallCounts c = {0};
+	for (size_t i=0; i!=call_count; i+=1){
+		const Call *site = sites + i % site_count;
+		ValueInfo args[MAX_PARAMS];
+		ValueInfo infers[1 + MAX_INFERS] = {0};
+		uint8_t conversions[MAX_PARAMS];
+		memcpy(args, site->args, site->arg_count*sizeof(ValueInfo));
+		const char *err;
+		if (cached){
+			err = match_call(ctx, site->proc_idx, args, site->arg_count, infers, conversions);
+		} else{
+			err = match_call_args(
+				ctx, procedure_class_info(ctx, site->proc_idx), args, site->arg_count,
+				infers, conversions
+			);
+		}
+		if (err != NULL){
+			fprintf(stderr, "call %zu: %s\n", i, err);
+			exit(1);
+		}
+		count_call(&c, args, site->arg_count, infers, conversions);
+	}
+	return c;
+}
+
+
+
+int main(int argc, char **argv){
+	size_t runs = 5;
+	size_t proc_count = 500;
+	size_t call_count = 1000000;
+	size_t site_count = 20000;
+	size_t variants = 4;
+	uint64_t seed = 1;
+	enum BenchFormat format = BenchFormat_Text;
+
+	for (int i=1; i!=argc; i+=1){
+		if (strcmp(argv[i], "-n") == 0 && i+1 != argc){
+			runs = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-p") == 0 && i+1 != argc){
+			proc_count = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-c") == 0 && i+1 != argc){
+			call_count = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-s") == 0 && i+1 != argc){
+			site_count = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-v") == 0 && i+1 != argc){
+			variants = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-r") == 0 && i+1 != argc){
+			seed = strtoull(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-f") == 0 && i+1 != argc){
+			if (!bench_parse_format(argv[i+1], &format)){
+				fprintf(stderr, "unknown format: %s\n", argv[i+1]);
+				return 10;
+			}
+			i += 1;
+		} else if (strcmp(argv[i], "-h") == 0){
+			printf(
+				"callbench <options>\n  options:\n"
+				"  -h           print help\n"
+				"  -n <runs>    number of runs (default: 5)\n"
+				"  -p <count>   procedures (default: 500)\n"
+				"  -c <count>   calls (default: 1000000)\n"
+				"  -s <count>   call sites, called in turns (default: 20000)\n"
+				"  -v <count>   argument combinations of every procedure (default: 4)\n"
+				"  -r <seed>    seed of the generator (default: 1)\n"
+				"  -f <format>  text, csv or json (default: text)\n"
+			);
+			return 0;
+		} else{
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			return 10;
+		}
+	}
+	if (runs == 0 || proc_count == 0 || site_count == 0 || variants == 0){
+		fprintf(stderr, "number of runs, procedures, call sites and variants must be positive\n");
+		return 10;
+	}
+
+	init_compiler_shared();
+	CompilerContext ctx;
+	init_compiler_context(&ctx);
+
+	uint32_t *procs = malloc(proc_count*sizeof(uint32_t));
+	Call *sites = malloc(site_count*sizeof(Call));
+	uint64_t *samples = malloc(runs*sizeof(uint64_t));
+	if (procs == NULL || sites == NULL || samples == NULL){
+		fprintf(stderr, "allocation failrule\n");
+		return 1;
+	}
+	BenchRandom rng = { seed | 1u };
+	for (size_t i=0; i!=proc_count; i+=1) procs[i] = add_procedure(&ctx, &rng);
+	gen_sites(&ctx, sites, site_count, procs, proc_count, variants, seed);
+
+	BenchReport report = bench_report_begin(stdout, format);
+
+	CallCounts matched = {0};
+	for (size_t i=0; i!=runs; i+=1){
+		uint64_t start = bench_now_ns();
+		matched = run_calls(&ctx, sites, site_count, call_count, false);
+		samples[i] = bench_now_ns() - start;
+	}
+	bench_report_row(&report, "argument matching", 0, samples, runs);
+
+	CallCounts cached = {0};
+	for (size_t i=0; i!=runs; i+=1){
+		free_call_cache(&ctx);
+		init_call_cache(&ctx);
+		STATS_RESET();
+		uint64_t start = bench_now_ns();
+		cached = run_calls(&ctx, sites, site_count, call_count, true);
+		samples[i] = bench_now_ns() - start;
+	}
+	bench_report_row(&report, "resolution cache", 0, samples, runs);
+	bench_report_end(&report);
+
+	if (format == BenchFormat_Text){
+		const struct CallCache *cache = &ctx.call_cache;
+		printf(
+			"\ncalls: %zu, conversions: %zu, hits: %zu, misses: %zu, uncached: %zu"
+			", hit rate: %.2lf%%\n",
+			cached.matched, cached.conversions, cache->hits, cache->misses, cache->uncached,
+			100.0*(double)cache->hits/(double)util_max_usize(cached.matched, 1)
+		);
+#ifdef YACK_STATS
+		printf("call cache probes:");
+		for (size_t i=0; i!=STATS_PROBE_BUCKETS; i+=1){
+			printf(" %lu", compiler_stats.probes[StatsTable_Calls][i]);
+		}
+		putchar('\n');
+#endif
+	}
+	free_compiler_context(&ctx);
+	if (memcmp(&matched, &cached, sizeof(CallCounts)) != 0){
+		fprintf(stderr, "matching results differ\n");
+		return 1;
+	}
+	return 0;
+}
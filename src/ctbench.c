@@ -0,0 +1,478 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "comptime.h"
+#include "bench.h"
+
+
+// compile time execution benchmark, loops that run one operation over and
+// over measure the cost of every operation with its dispatch, then recursive
+// fibonacci measures calls and a sieve of eratosthenes measures loops over
+// the compile time heap. results are checked against the same programs in c.
+// procedures are built as lists, then no-ops are inserted between other
+// allocations, like later passes do, and the lists are linearized. programs
+// and walks over all bodies run on both layouts
+#define OP_UNROLL 16
+
+enum OperandKind{
+	Operand_Words,  // two words
+	Operand_Floats, // two floats
+	Operand_Word,   // one word
+	Operand_None,
+	Operand_Memory, // pointer to the heap and an index
+};
+
+typedef struct{
+	const char *name;
+	enum BcType type;
+	uint16_t count;
+	enum OperandKind operands;
+} OpBench;
+
+// locals of operation loops
+enum{
+	Local_N, Local_A, Local_B, Local_FA, Local_FB, Local_Ptr, Local_I, Local_Sink
+};
+
+static const OpBench OpBenches[] = {
+	{ "load store",     BC_Bitcast,        0, Operand_Word   },
+	{ "push",           BC_Push,           0, Operand_None   },
+	{ "add",            BC_Add,            0, Operand_Words  },
+	{ "subtract",       BC_Subtract,       0, Operand_Words  },
+	{ "multiply",       BC_Multiply,       0, Operand_Words  },
+	{ "divide",         BC_Divide,         0, Operand_Words  },
+	{ "modulo signed",  BC_ModuloSigned,   0, Operand_Words  },
+	{ "bit and",        BC_BitAnd,         0, Operand_Words  },
+	{ "shift left",     BC_ShiftLeft,      0, Operand_Words  },
+	{ "less",           BC_Less,           0, Operand_Words  },
+	{ "equal",          BC_Equal,          0, Operand_Words  },
+	{ "sign extend",    BC_SignExtend,     2, Operand_Word   },
+	{ "add float",      BC_AddFloat,       0, Operand_Floats },
+	{ "multiply float", BC_MultiplyFloat,  0, Operand_Floats },
+	{ "divide float",   BC_DivideFloat,    0, Operand_Floats },
+	{ "less float",     BC_LessFloat,      0, Operand_Floats },
+	{ "mem load",       BC_MemLoad,        0, Operand_Memory },
+	{ "mem store",      BC_MemStore,       0, Operand_Memory },
+	{ "load index",     BC_LoadIndex,      0, Operand_Memory },
+	{ "store index",    BC_StoreIndex,     0, Operand_Memory },
+	{ "call",           BC_Call,           1, Operand_Word   },
+};
+
+
+
+// PROGRAMS
+static uint32_t build_identity(CompilerContext *ctx){
+	BcBuilder b = bc_begin_proc(ctx, 1, true);
+	bc_emit(ctx, &b, BC_Load, 0);
+	bc_emit(ctx, &b, BC_Return, 1);
+	return b.proc;
+}
+
+static void emit_op(CompilerContext *ctx, BcBuilder *b, const OpBench *op, uint32_t identity){
+	switch (op->operands){
+	case Operand_Words:
+		bc_emit(ctx, b, BC_Load, Local_A);
+		bc_emit(ctx, b, BC_Load, Local_B);
+		bc_emit(ctx, b, op->type, op->count);
+		break;
+	case Operand_Floats:
+		bc_emit(ctx, b, BC_Load, Local_FA);
+		bc_emit(ctx, b, BC_Load, Local_FB);
+		bc_emit(ctx, b, op->type, op->count);
+		break;
+	case Operand_Word:
+		bc_emit(ctx, b, BC_Load, Local_A);
+		if (op->type == BC_Call) bc_emit_call(ctx, b, identity);
+		else bc_emit(ctx, b, op->type, op->count);
+		break;
+	case Operand_None:
+		bc_emit_push(ctx, b, CLASS_U64, (Data){ .u64 = 3 });
+		break;
+	case Operand_Memory:
+		bc_emit(ctx, b, BC_Load, Local_Ptr);
+		switch (op->type){
+		case BC_MemLoad:
+			bc_emit_class(ctx, b, BC_MemLoad, 0, CLASS_U64);
+			break;
+		case BC_MemStore:
+			bc_emit(ctx, b, BC_Load, Local_A);
+			bc_emit_class(ctx, b, BC_MemStore, 0, CLASS_U64);
+			bc_emit(ctx, b, BC_Load, Local_A);
+			break;
+		case BC_LoadIndex:
+			bc_emit(ctx, b, BC_Load, Local_B);
+			bc_emit_class(ctx, b, BC_LoadIndex, 0, CLASS_U64);
+			break;
+		default:
+			bc_emit(ctx, b, BC_Load, Local_B);
+			bc_emit(ctx, b, BC_Load, Local_A);
+			bc_emit_class(ctx, b, BC_StoreIndex, 0, CLASS_U64);
+			bc_emit(ctx, b, BC_Load, Local_A);
+			break;
+		}
+		break;
+	}
+	bc_emit(ctx, b, BC_Store, Local_Sink);
+}
+
+// loop(n) runs the operation n*OP_UNROLL times and returns the last result
+static uint32_t build_op_loop(CompilerContext *ctx, const OpBench *op, uint32_t identity){
+	BcBuilder b = bc_begin_proc(ctx, 1, true);
+	bc_emit_push(ctx, &b, CLASS_U64, (Data){ .u64 = 12345 });
+	bc_emit_push(ctx, &b, CLASS_U64, (Data){ .u64 = 7 });
+	bc_emit_push(ctx, &b, CLASS_F64, (Data){ .f64 = 1.5 });
+	bc_emit_push(ctx, &b, CLASS_F64, (Data){ .f64 = 0.75 });
+	bc_emit_push(ctx, &b, CLASS_U64, (Data){ .u64 = 8 });
+	bc_emit_class(ctx, &b, BC_Alloc, 0, CLASS_U64);
+	bc_emit_push(ctx, &b, CLASS_U64, (Data){ .u64 = 0 });
+	bc_emit_push(ctx, &b, CLASS_U64, (Data){ .u64 = 0 });
+
+	uint32_t head = bc_emit(ctx, &b, BC_Load, Local_I);
+	bc_emit(ctx, &b, BC_Load, Local_N);
+	bc_emit(ctx, &b, BC_Less, 0);
+	uint32_t exit = bc_emit_jump(ctx, &b, BC_JumpIfZero);
+	for (size_t i=0; i!=OP_UNROLL; i+=1) emit_op(ctx, &b, op, identity);
+	bc_emit(ctx, &b, BC_Load, Local_I);
+	bc_emit_push(ctx, &b, CLASS_U64, (Data){ .u64 = 1 });
+	bc_emit(ctx, &b, BC_Add, 0);
+	bc_emit(ctx, &b, BC_Store, Local_I);
+	uint32_t back = bc_emit_jump(ctx, &b, BC_Jump);
+	bc_set_target(ctx, back, head);
+	uint32_t end = bc_emit(ctx, &b, BC_Load, Local_Sink);
+	bc_set_target(ctx, exit, end);
+	bc_emit(ctx, &b, BC_Return, 1);
+	return b.proc;
+}
+
+// fib(n) = n < 2 ? n : fib(n-1) + fib(n-2)
+static uint32_t build_fib(CompilerContext *ctx){
+	BcBuilder b = bc_begin_proc(ctx, 1, true);
+	bc_emit(ctx, &b, BC_Load, 0);
+	bc_emit_push(ctx, &b, CLASS_U64, (Data){ .u64 = 2 });
+	bc_emit(ctx, &b, BC_Less, 0);
+	uint32_t recurse = bc_emit_jump(ctx, &b, BC_JumpIfZero);
+	bc_emit(ctx, &b, BC_Load, 0);
+	bc_emit(ctx, &b, BC_Return, 1);
+	uint32_t target = bc_emit(ctx, &b, BC_Load, 0);
+	bc_set_target(ctx, recurse, target);
+	bc_emit_push(ctx, &b, CLASS_U64, (Data){ .u64 = 1 });
+	bc_emit(ctx, &b, BC_Subtract, 0);
+	bc_emit_call(ctx, &b, b.proc);
+	bc_emit(ctx, &b, BC_Load, 0);
+	bc_emit_push(ctx, &b, CLASS_U64, (Data){ .u64 = 2 });
+	bc_emit(ctx, &b, BC_Subtract, 0);
+	bc_emit_call(ctx, &b, b.proc);
+	bc_emit(ctx, &b, BC_Add, 0);
+	bc_emit(ctx, &b, BC_Return, 1);
+	return b.proc;
+}
+
+// sieve(n) counts primes below n, composite numbers are marked in a heap array
+static uint32_t build_sieve(CompilerContext *ctx){
+	enum{ N, Marks, Count, I, J };
+	BcBuilder b = bc_begin_proc(ctx, 1, true);
+	bc_emit(ctx, &b, BC_Load, N);
+	bc_emit_class(ctx, &b, BC_Alloc, 0, CLASS_U8);
+	bc_emit_push(ctx, &b, CLASS_U64, (Data){ .u64 = 0 });
+	bc_emit_push(ctx, &b, CLASS_U64, (Data){ .u64 = 2 });
+	bc_emit_push(ctx, &b, CLASS_U64, (Data){ .u64 = 0 });
+
+	uint32_t outer = bc_emit(ctx, &b, BC_Load, I);
+	bc_emit(ctx, &b, BC_Load, N);
+	bc_emit(ctx, &b, BC_Less, 0);
+	uint32_t done = bc_emit_jump(ctx, &b, BC_JumpIfZero);
+	bc_emit(ctx, &b, BC_Load, Marks);
+	bc_emit(ctx, &b, BC_Load, I);
+	bc_emit_class(ctx, &b, BC_LoadIndex, 0, CLASS_U8);
+	uint32_t composite = bc_emit_jump(ctx, &b, BC_JumpIfNotZero);
+	bc_emit(ctx, &b, BC_Load, Count);
+	bc_emit_push(ctx, &b, CLASS_U64, (Data){ .u64 = 1 });
+	bc_emit(ctx, &b, BC_Add, 0);
+	bc_emit(ctx, &b, BC_Store, Count);
+	bc_emit(ctx, &b, BC_Load, I);
+	bc_emit(ctx, &b, BC_Load, I);
+	bc_emit(ctx, &b, BC_Multiply, 0);
+	bc_emit(ctx, &b, BC_Store, J);
+
+	uint32_t inner = bc_emit(ctx, &b, BC_Load, J);
+	bc_emit(ctx, &b, BC_Load, N);
+	bc_emit(ctx, &b, BC_Less, 0);
+	uint32_t inner_done = bc_emit_jump(ctx, &b, BC_JumpIfZero);
+	bc_emit(ctx, &b, BC_Load, Marks);
+	bc_emit(ctx, &b, BC_Load, J);
+	bc_emit_push(ctx, &b, CLASS_U8, (Data){ .u64 = 1 });
+	bc_emit_class(ctx, &b, BC_StoreIndex, 0, CLASS_U8);
+	bc_emit(ctx, &b, BC_Load, J);
+	bc_emit(ctx, &b, BC_Load, I);
+	bc_emit(ctx, &b, BC_Add, 0);
+	bc_emit(ctx, &b, BC_Store, J);
+	bc_set_target(ctx, bc_emit_jump(ctx, &b, BC_Jump), inner);
+
+	uint32_t next = bc_emit(ctx, &b, BC_Load, I);
+	bc_set_target(ctx, composite, next);
+	bc_set_target(ctx, inner_done, next);
+	bc_emit_push(ctx, &b, CLASS_U64, (Data){ .u64 = 1 });
+	bc_emit(ctx, &b, BC_Add, 0);
+	bc_emit(ctx, &b, BC_Store, I);
+	bc_set_target(ctx, bc_emit_jump(ctx, &b, BC_Jump), outer);
+
+	uint32_t end = bc_emit(ctx, &b, BC_Load, Count);
+	bc_set_target(ctx, done, end);
+	bc_emit(ctx, &b, BC_Return, 1);
+	return b.proc;
+}
+
+static uint64_t native_fib(uint64_t n){
+	return n < 2 ? n : native_fib(n-1) + native_fib(n-2);
+}
+
+static uint64_t native_sieve(uint64_t n){
+	uint8_t *marks = calloc(n, 1);
+	assert(marks != NULL && "allocation failrule");
+	uint64_t count = 0;
+	for (uint64_t i=2; i<n; i+=1){
+		if (marks[i]) continue;
+		count += 1;
+		for (uint64_t j=i*i; j<n; j+=i) marks[j] = 1;
+	}
+	free(marks);
+	return count;
+}
+
+
+
+// LAYOUTS
+// a bitcast is inserted after percent of the instructions, with up to 7
+// nodes of static data before it
+static void scatter_proc(CompilerContext *ctx, uint32_t proc, uint32_t percent, BenchRandom *rng){
+	static uint8_t zeros[7*sizeof(BcNode)];
+	for (uint32_t i=proc+1; i!=0; i=ctx->bc[i].inext){
+		if (bench_random_below(rng, 100) >= percent) continue;
+		size_t filler = bench_random_below(rng, 8);
+		if (filler != 0) static_data_alloc(ctx, zeros, (filler-1)*sizeof(BcNode), 3);
+		i = bc_insert_after(ctx, proc, i, BC_Bitcast, 0);
+	}
+}
+
+// counts instructions of every type, like analysis passes, the checksum
+// must be the same for both layouts
+static uint64_t walk_procs(const CompilerContext *ctx, const uint32_t *procs, size_t count){
+	uint64_t counts[BC_Return+1] = {0};
+	for (size_t p=0; p!=count; p+=1){
+		const BcProcHeader *header = bc_proc_header(ctx, procs[p]);
+		if (header->is_linear){
+			const BcNode *end = ctx->bc + procs[p] + 1 + header->body_size;
+			for (const BcNode *ip=ctx->bc+procs[p]+1; ip!=end; ip=bc_linear_next(ip)){
+				counts[ip->type] += 1;
+			}
+		} else{
+			for (uint32_t i=procs[p]+1; i!=0; i=ctx->bc[i].inext) counts[ctx->bc[i].type] += 1;
+		}
+	}
+	uint64_t checksum = 0;
+	for (size_t i=0; i!=SIZE(counts); i+=1) checksum = (checksum ^ counts[i]) * 0x9E3779B97F4A7C15ull;
+	return checksum;
+}
+
+
+
+// RUNNING
+static uint64_t run_proc(CtMachine *m, uint32_t proc, uint64_t arg){
+	uint64_t res;
+	ct_reset_heap(m);
+	const char *err = ct_run(m, proc, &arg, &res);
+	if (err != NULL){
+		fprintf(stderr, "compile time execution failed: %s\n", err);
+		exit(1);
+	}
+	return res;
+}
+
+
+
+int main(int argc, char **argv){
+	size_t runs = 5;
+	size_t iterations = 100000;
+	uint64_t fib_n = 27;
+	uint64_t sieve_n = 1000000;
+	uint32_t inserted = 25;
+	size_t walks = 1000;
+	uint64_t seed = 1;
+	enum BenchFormat format = BenchFormat_Text;
+
+	for (int i=1; i!=argc; i+=1){
+		if (strcmp(argv[i], "-n") == 0 && i+1 != argc){
+			runs = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-c") == 0 && i+1 != argc){
+			iterations = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-b") == 0 && i+1 != argc){
+			fib_n = strtoull(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-s") == 0 && i+1 != argc){
+			sieve_n = strtoull(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-i") == 0 && i+1 != argc){
+			inserted = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-w") == 0 && i+1 != argc){
+			walks = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-r") == 0 && i+1 != argc){
+			seed = strtoull(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-f") == 0 && i+1 != argc){
+			if (!bench_parse_format(argv[i+1], &format)){
+				fprintf(stderr, "unknown format: %s\n", argv[i+1]);
+				return 10;
+			}
+			i += 1;
+		} else if (strcmp(argv[i], "-h") == 0){
+			printf(
+				"ctbench <options>\n  options:\n"
+				"  -h           print help\n"
+				"  -n <runs>    number of runs (default: 5)\n"
+				"  -c <count>   iterations of operation loops, %d operations each (default: 100000)\n"
+				"  -b <n>       fibonacci number (default: 27)\n"
+				"  -s <n>       primes below n are counted (default: 1000000)\n"
+				"  -i <percent> no-ops inserted after construction (default: 25)\n"
+				"  -w <count>   walks over all bodies (default: 1000)\n"
+				"  -r <seed>    seed of the insertions (default: 1)\n"
+				"  -f <format>  text, csv or json (default: text)\n",
+				OP_UNROLL
+			);
+			return 0;
+		} else{
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			return 10;
+		}
+	}
+	if (runs == 0 || iterations == 0 || walks == 0 || fib_n > 40 || sieve_n > UINT32_MAX || inserted > 100){
+		fprintf(stderr,
+			"number of runs, iterations and walks must be positive, fibonacci number must be"
+			" at most 40, sieve limit must fit in 32 bits, at most 100 percent is inserted\n"
+		);
+		return 10;
+	}
+
+	init_compiler_shared();
+	CompilerContext ctx;
+	init_compiler_context(&ctx);
+	CtMachine machine;
+	init_ct_machine(&machine, &ctx);
+
+	uint64_t *samples = malloc(runs*sizeof(uint64_t));
+	double *op_ns = malloc(SIZE(OpBenches)*sizeof(double));
+	if (samples == NULL || op_ns == NULL){
+		fprintf(stderr, "allocation failrule\n");
+		return 1;
+	}
+	// identity, fibonacci, sieve and the operation loops
+	enum{ Proc_Identity, Proc_Fib, Proc_Sieve, Proc_Loops };
+	uint32_t list[Proc_Loops + SIZE(OpBenches)];
+	list[Proc_Identity] = build_identity(&ctx);
+	list[Proc_Fib] = build_fib(&ctx);
+	list[Proc_Sieve] = build_sieve(&ctx);
+	for (size_t o=0; o!=SIZE(OpBenches); o+=1){
+		list[Proc_Loops+o] = build_op_loop(&ctx, OpBenches + o, list[Proc_Identity]);
+	}
+	BenchRandom rng = { seed | 1u };
+	for (size_t p=0; p!=SIZE(list); p+=1) scatter_proc(&ctx, list[p], inserted, &rng);
+	size_t list_nodes = ctx.bc_size;
+	uint32_t linear[SIZE(list)];
+	memcpy(linear, list, sizeof(list));
+	bc_linearize(&ctx, linear, SIZE(linear));
+	size_t body_nodes = 0;
+	for (size_t p=0; p!=SIZE(linear); p+=1) body_nodes += bc_proc_header(&ctx, linear[p])->body_size;
+
+	BenchReport report = bench_report_begin(stdout, format);
+
+	// OPERATIONS
+	for (size_t o=0; o!=SIZE(OpBenches); o+=1){
+		for (size_t i=0; i!=runs; i+=1){
+			uint64_t start = bench_now_ns();
+			run_proc(&machine, linear[Proc_Loops+o], iterations);
+			samples[i] = bench_now_ns() - start;
+		}
+		op_ns[o] = (double)bench_percentile(samples, runs, 50) / (double)(iterations*OP_UNROLL);
+		bench_report_row(&report, OpBenches[o].name, 0, samples, runs);
+	}
+
+	// PROGRAMS
+	uint64_t results[6] = {0};
+	for (size_t i=0; i!=runs; i+=1){
+		uint64_t start = bench_now_ns();
+		results[0] = run_proc(&machine, list[Proc_Fib], fib_n);
+		samples[i] = bench_now_ns() - start;
+	}
+	bench_report_row(&report, "fibonacci list", 0, samples, runs);
+	for (size_t i=0; i!=runs; i+=1){
+		uint64_t start = bench_now_ns();
+		results[1] = run_proc(&machine, linear[Proc_Fib], fib_n);
+		samples[i] = bench_now_ns() - start;
+	}
+	bench_report_row(&report, "fibonacci linear", 0, samples, runs);
+	for (size_t i=0; i!=runs; i+=1){
+		uint64_t start = bench_now_ns();
+		results[2] = native_fib(fib_n);
+		samples[i] = bench_now_ns() - start;
+	}
+	bench_report_row(&report, "native fibonacci", 0, samples, runs);
+	for (size_t i=0; i!=runs; i+=1){
+		uint64_t start = bench_now_ns();
+		results[3] = run_proc(&machine, list[Proc_Sieve], sieve_n);
+		samples[i] = bench_now_ns() - start;
+	}
+	bench_report_row(&report, "sieve list", 0, samples, runs);
+	for (size_t i=0; i!=runs; i+=1){
+		uint64_t start = bench_now_ns();
+		results[4] = run_proc(&machine, linear[Proc_Sieve], sieve_n);
+		samples[i] = bench_now_ns() - start;
+	}
+	bench_report_row(&report, "sieve linear", 0, samples, runs);
+	for (size_t i=0; i!=runs; i+=1){
+		uint64_t start = bench_now_ns();
+		results[5] = native_sieve(sieve_n);
+		samples[i] = bench_now_ns() - start;
+	}
+	bench_report_row(&report, "native sieve", 0, samples, runs);
+
+	// WALKS
+	uint64_t checksums[2] = {0};
+	for (size_t l=0; l!=2; l+=1){
+		for (size_t i=0; i!=runs; i+=1){
+			uint64_t start = bench_now_ns();
+			for (size_t w=0; w!=walks; w+=1) checksums[l] += walk_procs(&ctx, l ? linear : list, SIZE(list));
+			samples[i] = bench_now_ns() - start;
+		}
+		bench_report_row(
+			&report, l ? "walk linear" : "walk list", walks*body_nodes*sizeof(BcNode), samples, runs
+		);
+	}
+	bench_report_end(&report);
+
+	if (format == BenchFormat_Text){
+		printf("\nnanoseconds per operation with its loads and store:\n");
+		for (size_t o=0; o!=SIZE(OpBenches); o+=1){
+			printf("  %-16s %8.2lf\n", OpBenches[o].name, op_ns[o]);
+		}
+		printf(
+			"fibonacci(%lu) = %lu, primes below %lu: %lu\n"
+			"bytecode nodes: %zu with lists, %zu of linear bodies\n",
+			fib_n, results[1], sieve_n, results[4], list_nodes, body_nodes + SIZE(linear)
+		);
+	}
+	free(samples);
+	free(op_ns);
+	free_ct_machine(&machine);
+	free_compiler_context(&ctx);
+	if (
+		results[0] != results[2] || results[1] != results[2] ||
+		results[3] != results[5] || results[4] != results[5] || checksums[0] != checksums[1]
+	){
+		fprintf(stderr, "compile time results differ\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "classes.h"
+#include "bench.h"
+
+
+// enum benchmark, enum literals are matched with a large enum, like the
+// members of generated protocol enums, and values of the enum are printed by
+// name. the name index and the value map are compared with scans of the
+// names and of the values
+typedef struct{
+	size_t found;
+	uint64_t checksum; // of values or names, must be the same for both
+} EnumCounts;
+
+
+
+// GENERATOR
+// values go up from 0 with a gap here and there, or by the step
+static uint32_t add_enum(
+	CompilerContext *ctx, BenchRandom *rng, uint16_t elem_count, uint32_t step
+){
+	uint32_t *elem_values = malloc(elem_count*sizeof(uint32_t));
+	assert(elem_values != NULL && "allocation failrule");
+	uint32_t value = 0;
+	for (size_t i=0; i!=elem_count; i+=1){
+		elem_values[i] = value;
+		value += step != 0 ? step : 1 + (bench_random_below(rng, 8) == 0);
+	}
+	const uint16_t basic_size = sizeof(uint32_t);
+	uint64_t max_value = elem_values[elem_count-1];
+	uint32_t idx = class_info_alloc(ctx, enum_class_info_size(elem_count, basic_size, max_value));
+	EnumClassInfo *info = enum_class_info(ctx, idx);
+	*info = (EnumClassInfo){
+		.bytesize = basic_size, .alignment = 2, .elem_count = elem_count,
+		.basic_size = basic_size, .max_value = max_value
+	};
+	for (size_t i=0; i!=elem_count; i+=1) info->names[i] = bench_name_id(ctx, i);
+	memcpy(enum_values(info), elem_values, elem_count*sizeof(uint32_t));
+	free(elem_values);
+	complete_enum_class(info);
+	return idx;
+}
+
+
+
+// MATCHING
+static EnumCounts run_matches(
+	CompilerContext *ctx, Class target, const NameId *literals, size_t count, bool indexed
+){
+	EnumCounts c = {0};
+	const EnumClassInfo *info = enum_class_info(ctx, target.idx);
+	for (size_t i=0; i!=count; i+=1){
+		ValueInfo arg = { .clas = { .tag = Class_EnumLiteral, .name_id = literals[i] } };
+		bool found = false;
+		if (indexed){
+			uint8_t conversion;
+			found = match_argument(ctx, &arg, target, NULL, &conversion) == NULL;
+		} else{
+			// the scan that matching used before the name index
+			for (size_t j=0; j!=info->elem_count; j+=1){
+				if (info->names[j] == literals[i]){
+					arg.data.u64 = enum_element_value(info, j);
+					found = true;
+					break;
+				}
+			}
+		}
+		c.found += found;
+		if (found) c.checksum = (c.checksum ^ arg.data.u64) * 0x9E3779B97F4A7C15ull;
+	}
+	return c;
+}
+
+static EnumCounts run_prints(
+	const CompilerContext *ctx, Class target, const uint64_t *values, size_t count, bool mapped
+){
+	EnumCounts c = {0};
+	const EnumClassInfo *info = enum_class_info(ctx, target.idx);
+	for (size_t i=0; i!=count; i+=1){
+		NameId name_id = 0;
+		if (mapped){
+			name_id = enum_value_name(info, values[i]);
+		} else{
+			for (size_t j=0; j!=info->elem_count; j+=1){
+				if (enum_element_value(info, j) == values[i]){ name_id = info->names[j]; break; }
+			}
+		}
+		c.found += name_id != 0;
+		c.checksum = (c.checksum ^ name_id) * 0x9E3779B97F4A7C15ull;
+	}
+	return c;
+}
+
+
+
+int main(int argc, char **argv){
+	size_t runs = 5;
+	size_t elem_count = 5000;
+	size_t count = 50000;
+	uint32_t step = 0;
+	uint64_t seed = 1;
+	enum BenchFormat format = BenchFormat_Text;
+
+	for (int i=1; i!=argc; i+=1){
+		int common = bench_parse_common(argc, argv, &i, &runs, &seed, &format);
+		if (common < 0) return 10;
+		if (common > 0) continue;
+		if (strcmp(argv[i], "-e") == 0 && i+1 != argc){
+			elem_count = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-c") == 0 && i+1 != argc){
+			count = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-s") == 0 && i+1 != argc){
+			step = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-h") == 0){
+			printf(
+				"enumbench <options>\n  options:\n"
+				"  -h           print help\n"
+				"  -n <runs>    number of runs (default: 5)\n"
+				"  -e <count>   elements of the enum (default: 5000)\n"
+				"  -c <count>   matched literals and printed values (default: 50000)\n"
+				"  -s <step>    step between values, 0 means mostly 1 (default: 0)\n"
+				"  -r <seed>    seed of the generator (default: 1)\n"
+				"  -f <format>  text, csv or json (default: text)\n"
+			);
+			return 0;
+		} else{
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			return 10;
+		}
+	}
+	if (runs == 0 || elem_count == 0 || elem_count >= UINT16_MAX){
+		fprintf(stderr,
+			"number of runs must be positive, elements must be 1 to %d\n", UINT16_MAX-1
+		);
+		return 10;
+	}
+
+	init_compiler_shared();
+	CompilerContext ctx;
+	init_compiler_context(&ctx);
+
+	NameId *literals = malloc(count*sizeof(NameId));
+	uint64_t *values = malloc(count*sizeof(uint64_t));
+	uint64_t *samples = malloc(runs*sizeof(uint64_t));
+	if (literals == NULL || values == NULL || samples == NULL){
+		fprintf(stderr, "allocation failrule\n");
+		return 1;
+	}
+	BenchRandom rng = { seed | 1u };
+	Class target = { .tag = Class_Enum, .idx = add_enum(&ctx, &rng, elem_count, step) };
+	const EnumClassInfo *info = enum_class_info(&ctx, target.idx);
+	// one literal in 16 is not an element, values are anywhere up to the maximum
+	for (size_t i=0; i!=count; i+=1){
+		literals[i] = info->names[bench_random_below(&rng, elem_count)];
+		if (bench_random_below(&rng, 16) == 0) literals[i] = bench_name_id(&ctx, elem_count);
+		values[i] = enum_element_value(info, bench_random_below(&rng, elem_count));
+		if (bench_random_below(&rng, 16) == 0) values[i] += 1;
+	}
+
+	BenchReport report = bench_report_begin(stdout, format);
+	EnumCounts results[4] = {0};
+	static const char *const names[] = {
+		"literal name scan", "literal name index", "value scan", "value map"
+	};
+	for (size_t b=0; b!=4; b+=1){
+		for (size_t i=0; i!=runs; i+=1){
+			STATS_RESET();
+			uint64_t start = bench_now_ns();
+			if (b < 2){
+				results[b] = run_matches(&ctx, target, literals, count, b == 1);
+			} else{
+				results[b] = run_prints(&ctx, target, values, count, b == 3);
+			}
+			samples[i] = bench_now_ns() - start;
+		}
+		bench_report_row(&report, names[b], 0, samples, runs);
+	}
+	bench_report_end(&report);
+
+	if (format == BenchFormat_Text){
+		printf(
+			"\nelements: %u, max value: %lu, literals found: %zu, values found: %zu"
+			", index slots: %u, map slots: %u\n",
+			info->elem_count, info->max_value, results[1].found, results[3].found,
+			enum_name_index_capacity(info->elem_count),
+			enum_value_map_size(info->elem_count, info->max_value)
+		);
+	}
+	free_compiler_context(&ctx);
+	if (
+		memcmp(results+0, results+1, sizeof(EnumCounts)) != 0 ||
+		memcmp(results+2, results+3, sizeof(EnumCounts)) != 0
+	){
+		fprintf(stderr, "enum results differ\n");
+		return 1;
+	}
+	return 0;
+}
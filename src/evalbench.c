@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "classes.h"
+#include "bench.h"
+
+
+// evaluated class benchmark, nested arrays and tuples whose element classes
+// and sizes are infers are evaluated with values of the infers, like the
+// parameters of generic containers are for every argument match. every class
+// is evaluated from scratch and through the memo of evaluated classes
+#define CLASS_INFERS 3 // named infers 1 to 3 hold classes
+#define SIZE_INFERS  2 // named infers 4 and 5 hold array sizes
+#define INFER_COUNT (1 + CLASS_INFERS + SIZE_INFERS)
+
+typedef struct{
+	Class clas;
+	ValueInfo infers[INFER_COUNT];
+} Eval;
+
+typedef struct{
+	size_t evaluated;
+	uint64_t checksum; // of evaluated classes, must be the same for both
+} EvalCounts;
+
+static const Class Elements[] = {
+	CLASS_U8, CLASS_U16, CLASS_U32, CLASS_U64, CLASS_I32, CLASS_I64, CLASS_F32, CLASS_F64
+};
+
+
+
+// GENERATOR
+static Class random_class(CompilerContext *ctx, BenchRandom *rng, size_t depth){
+	uint32_t kind = depth == 0 ? 0 : bench_random_below(rng, 4);
+	switch (kind){
+	case 0:{
+		Class res = Elements[bench_random_below(rng, SIZE(Elements))];
+		if (bench_random_below(rng, 3) != 0){
+			res = (Class){
+				.tag = Class_Variable, .evaled = true,
+				.param_id = 1 + bench_random_below(rng, CLASS_INFERS)
+			};
+		}
+		if (bench_random_below(rng, 4) == 0) res = class_add_prefix(res, ClassPrefix_Pointer);
+		return res;
+	}
+	case 1:
+	case 2:{
+		Class arg = random_class(ctx, rng, depth-1);
+		uint32_t size = 1 + bench_random_below(rng, 8);
+		if (bench_random_below(rng, 2)){
+			uint32_t var_index = 1 + CLASS_INFERS + bench_random_below(rng, SIZE_INFERS);
+			size = ARRAY_SIZE_TAG_VARIABLE | var_index;
+		}
+		return get_array_class(ctx, arg, size);
+	}
+	default:{
+		Class cls[4];
+		size_t size = 2 + bench_random_below(rng, 3);
+		for (size_t i=0; i!=size; i+=1) cls[i] = random_class(ctx, rng, depth-1);
+		return get_tuple_class(ctx, cls, size);
+	}
+	}
+}
+
+// a generic container is used with a few combinations of infers, like
+// generic code in real programs
+static void random_infers(BenchRandom *rng, ValueInfo *infers){
+	infers[0] = (ValueInfo){0};
+	for (size_t i=1; i<=CLASS_INFERS; i+=1){
+		infers[i] = (ValueInfo){
+			.clas = CLASS_CLASS, .flags = VF_Const,
+			.data.clas = Elements[bench_random_below(rng, SIZE(Elements))]
+		};
+	}
+	for (size_t i=1+CLASS_INFERS; i!=INFER_COUNT; i+=1){
+		infers[i] = (ValueInfo){
+			.clas = CLASS_U32, .flags = VF_Const, .data.u64 = 1 + bench_random_below(rng, 16)
+		};
+	}
+}
+
+static void gen_evals(
+	CompilerContext *ctx, Eval *evals, size_t eval_count, size_t container_count,
+	size_t depth, size_t variants, uint64_t seed
+){
+	Class *containers = malloc(container_count*sizeof(Class));
+	assert(containers != NULL && "allocation failrule");
+	BenchRandom rng = { seed | 1u };
+	for (size_t i=0; i!=container_count; i+=1){
+		do containers[i] = random_class(ctx, &rng, depth); while (!containers[i].evaled);
+	}
+	for (size_t i=0; i!=eval_count; i+=1){
+		uint32_t c = bench_random_below(&rng, container_count);
+		BenchRandom variant = { (c*variants + bench_random_below(&rng, variants)) | 1u };
+		evals[i].clas = containers[c];
+		random_infers(&variant, evals[i].infers);
+	}
+	free(containers);
+}
+
+
+
+// EVALUATION
+static EvalCounts run_evals(
+	CompilerContext *ctx, const Eval *evals, size_t eval_count, size_t count
+){
+	EvalCounts c = {0};
+	for (size_t i=0; i!=count; i+=1){
+		const Eval *e = evals + i % eval_count;
+		ValueInfo infers[INFER_COUNT];
+		memcpy(infers, e->infers, sizeof(infers));
+		Class res = e->clas;
+		const char *err = eval_class(ctx, &res, infers);
+		if (err != NULL){
+			fprintf(stderr, "evaluation %zu: %s\n", i, err);
+			exit(1);
+		}
+		c.evaluated += 1;
+		c.checksum = (c.checksum ^ res.id) * 0x9E3779B97F4A7C15ull;
+	}
+	return c;
+}
+
+
+
+int main(int argc, char **argv){
+	size_t runs = 5;
+	size_t container_count = 200;
+	size_t count = 1000000;
+	size_t eval_count = 20000;
+	size_t depth = 3;
+	size_t variants = 4;
+	uint64_t seed = 1;
+	enum BenchFormat format = BenchFormat_Text;
+
+	for (int i=1; i!=argc; i+=1){
+		if (strcmp(argv[i], "-n") == 0 && i+1 != argc){
+			runs = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-t") == 0 && i+1 != argc){
+			container_count = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-c") == 0 && i+1 != argc){
+			count = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-s") == 0 && i+1 != argc){
+			eval_count = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-d") == 0 && i+1 != argc){
+			depth = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-v") == 0 && i+1 != argc){
+			variants = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-r") == 0 && i+1 != argc){
+			seed = strtoull(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-f") == 0 && i+1 != argc){
+			if (!bench_parse_format(argv[i+1], &format)){
+				fprintf(stderr, "unknown format: %s\n", argv[i+1]);
+				return 10;
+			}
+			i += 1;
+		} else if (strcmp(argv[i], "-h") == 0){
+			printf(
+				"evalbench <options>\n  options:\n"
+				"  -h           print help\n"
+				"  -n <runs>    number of runs (default: 5)\n"
+				"  -t <count>   generic containers (default: 200)\n"
+				"  -c <count>   evaluations (default: 1000000)\n"
+				"  -s <count>   distinct evaluations, done in turns (default: 20000)\n"
+				"  -d <depth>   nesting of containers (default: 3)\n"
+				"  -v <count>   combinations of infers of every container (default: 4)\n"
+				"  -r <seed>    seed of the generator (default: 1)\n"
+				"  -f <format>  text, csv or json (default: text)\n"
+			);
+			return 0;
+		} else{
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			return 10;
+		}
+	}
+	if (runs == 0 || container_count == 0 || eval_count == 0 || depth == 0 || variants == 0){
+		fprintf(stderr, "number of runs, containers, evaluations, depth and variants must be positive\n");
+		return 10;
+	}
+
+	init_compiler_shared();
+	CompilerContext ctx;
+	init_compiler_context(&ctx);
+
+	Eval *evals = malloc(eval_count*sizeof(Eval));
+	uint64_t *samples = malloc(runs*sizeof(uint64_t));
+	if (evals == NULL || samples == NULL){
+		fprintf(stderr, "allocation failrule\n");
+		return 1;
+	}
+	gen_evals(&ctx, evals, eval_count, container_count, depth, variants, seed);
+
+	// evaluated classes are interned once before measuring, so both ways
+	// only find them
+	ctx.eval_memo.disabled = true;
+	run_evals(&ctx, evals, eval_count, eval_count);
+
+	BenchReport report = bench_report_begin(stdout, format);
+
+	EvalCounts scratch = {0};
+	for (size_t i=0; i!=runs; i+=1){
+		uint64_t start = bench_now_ns();
+		scratch = run_evals(&ctx, evals, eval_count, count);
+		samples[i] = bench_now_ns() - start;
+	}
+	bench_report_row(&report, "evaluation", 0, samples, runs);
+
+	ctx.eval_memo.disabled = false;
+	EvalCounts memoized = {0};
+	for (size_t i=0; i!=runs; i+=1){
+		free_eval_memo(&ctx);
+		init_eval_memo(&ctx);
+		STATS_RESET();
+		uint64_t start = bench_now_ns();
+		memoized = run_evals(&ctx, evals, eval_count, count);
+		samples[i] = bench_now_ns() - start;
+	}
+	bench_report_row(&report, "memoized evaluation", 0, samples, runs);
+	bench_report_end(&report);
+
+	if (format == BenchFormat_Text){
+		// variables are substituted without the memo, nested classes are looked up
+		// again on misses
+		const struct EvalMemo *memo = &ctx.eval_memo;
+		printf(
+			"\nevaluations: %zu, hits: %zu, misses: %zu, uncached: %zu, records: %zu"
+			", hit rate: %.2lf%%\n",
+			memoized.evaluated, memo->hits, memo->misses, memo->uncached, (size_t)memo->size,
+			100.0*(double)memo->hits/(double)util_max_usize(memo->hits + memo->misses + memo->uncached, 1)
+		);
+#ifdef YACK_STATS
+		printf("eval memo probes:");
+		for (size_t i=0; i!=STATS_PROBE_BUCKETS; i+=1){
+			printf(" %lu", compiler_stats.probes[StatsTable_EvalMemo][i]);
+		}
+		putchar('\n');
+#endif
+	}
+	free_compiler_context(&ctx);
+	if (memcmp(&scratch, &memoized, sizeof(EvalCounts)) != 0){
+		fprintf(stderr, "evaluation results differ\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "classes.h"
+#include "bench.h"
+
+
+// struct field benchmark, fields of wide structs, like generated record
+// types, are resolved by name over and over. the index of field names is
+// compared with a scan of the names
+typedef struct{
+	uint32_t struct_idx;
+	NameId   name_id;
+} Access;
+
+typedef struct{
+	size_t found;
+	uint64_t checksum; // of field indexes, must be the same for both
+} FieldCounts;
+
+static const Class FieldClasses[] = {
+	CLASS_U8, CLASS_U16, CLASS_U32, CLASS_U64, CLASS_I32, CLASS_I64, CLASS_F32, CLASS_F64
+};
+
+
+
+// GENERATOR
+// fields of all structs are named from the same words, so structs share
+// most of their names and only their order differs
+static uint32_t add_struct(CompilerContext *ctx, BenchRandom *rng, uint16_t field_count){
+	uint32_t idx = class_info_alloc(ctx, struct_class_info_size(field_count));
+	StructClassInfo *info = struct_class_info(ctx, idx);
+	*info = (StructClassInfo){
+		.size = field_count, .stored_field_count = field_count, .field_count = field_count
+	};
+	uint32_t *offsets = struct_offsets(info);
+	NameId *names = struct_field_names(info);
+	uint32_t bytesize = 0;
+	uint8_t max_alignment = 0;
+	for (size_t i=0; i!=field_count; i+=1){
+		Class cl = FieldClasses[bench_random_below(rng, SIZE(FieldClasses))];
+		info->classes[i] = cl;
+		bytesize = util_alignsize(bytesize, 1<<cl.basic_alignment);
+		offsets[i] = bytesize;
+		bytesize += cl.basic_size;
+		if (cl.basic_alignment > max_alignment) max_alignment = cl.basic_alignment;
+	}
+	info->bytesize = util_alignsize(bytesize, 1<<max_alignment);
+	info->alignment = max_alignment;
+
+	// names are a random selection of the shared ones in a random order
+	for (size_t i=0; i!=field_count; i+=1){
+		names[i] = bench_name_id(ctx, i + bench_random_below(rng, 4)*field_count);
+	}
+	for (size_t i=field_count; i>1; i-=1){
+		size_t j = bench_random_below(rng, i);
+		NameId tmp = names[i-1];
+		names[i-1] = names[j];
+		names[j] = tmp;
+	}
+	// a name may repeat, the first field keeps it
+	for (size_t i=0; i!=field_count; i+=1){
+		for (size_t j=0; j!=i; j+=1){
+			if (names[j] == names[i]){ names[i] = bench_name_id(ctx, 4*field_count + i); break; }
+		}
+	}
+	complete_struct_class(info);
+	return idx;
+}
+
+
+
+// RESOLUTION
+static int32_t scan_struct_field(const StructClassInfo *info, NameId name_id){
+	const NameId *names = struct_field_names(info);
+	for (uint32_t i=0; i!=info->field_count; i+=1){
+		if (names[i] == name_id) return i;
+	}
+	return -1;
+}
+
+static FieldCounts run_accesses(
+	const CompilerContext *ctx, const Access *accesses, size_t access_count, bool indexed
+){
+	FieldCounts c = {0};
+	for (size_t i=0; i!=access_count; i+=1){
+		const StructClassInfo *info = struct_class_info(ctx, accesses[i].struct_idx);
+		int32_t field = indexed ?
+			find_struct_field(info, accesses[i].name_id) :
+			scan_struct_field(info, accesses[i].name_id);
+		c.found += field >= 0;
+		c.checksum = (c.checksum ^ (uint32_t)field) * 0x9E3779B97F4A7C15ull;
+	}
+	return c;
+}
+
+
+
+int main(int argc, char **argv){
+	size_t runs = 5;
+	size_t struct_count = 64;
+	size_t field_count = 300;
+	size_t access_count = 1000000;
+	uint64_t seed = 1;
+	enum BenchFormat format = BenchFormat_Text;
+
+	for (int i=1; i!=argc; i+=1){
+		int common = bench_parse_common(argc, argv, &i, &runs, &seed, &format);
+		if (common < 0) return 10;
+		if (common > 0) continue;
+		if (strcmp(argv[i], "-t") == 0 && i+1 != argc){
+			struct_count = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-w") == 0 && i+1 != argc){
+			field_count = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-c") == 0 && i+1 != argc){
+			access_count = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-h") == 0){
+			printf(
+				"fieldbench <options>\n  options:\n"
+				"  -h           print help\n"
+				"  -n <runs>    number of runs (default: 5)\n"
+				"  -t <count>   structs (default: 64)\n"
+				"  -w <count>   fields of every struct (default: 300)\n"
+				"  -c <count>   field accesses (default: 1000000)\n"
+				"  -r <seed>    seed of the generator (default: 1)\n"
+				"  -f <format>  text, csv or json (default: text)\n"
+			);
+			return 0;
+		} else{
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			return 10;
+		}
+	}
+	if (runs == 0 || struct_count == 0 || field_count == 0 || field_count > UINT16_MAX/8){
+		fprintf(stderr,
+			"number of runs and structs must be positive, fields must be 1 to %d\n", UINT16_MAX/8
+		);
+		return 10;
+	}
+
+	init_compiler_shared();
+	CompilerContext ctx;
+	init_compiler_context(&ctx);
+
+	uint32_t *structs = malloc(struct_count*sizeof(uint32_t));
+	Access *accesses = malloc(access_count*sizeof(Access));
+	uint64_t *samples = malloc(runs*sizeof(uint64_t));
+	if (structs == NULL || accesses == NULL || samples == NULL){
+		fprintf(stderr, "allocation failrule\n");
+		return 1;
+	}
+	BenchRandom rng = { seed | 1u };
+	for (size_t i=0; i!=struct_count; i+=1) structs[i] = add_struct(&ctx, &rng, field_count);
+	// one access in 16 names a field the struct doesn't have
+	for (size_t i=0; i!=access_count; i+=1){
+		uint32_t idx = structs[bench_random_below(&rng, struct_count)];
+		const StructClassInfo *info = struct_class_info(&ctx, idx);
+		NameId name_id = struct_field_names(info)[bench_random_below(&rng, field_count)];
+		if (bench_random_below(&rng, 16) == 0) name_id = bench_name_id(&ctx, 5*field_count);
+		accesses[i] = (Access){ .struct_idx = idx, .name_id = name_id };
+	}
+
+	BenchReport report = bench_report_begin(stdout, format);
+
+	FieldCounts scanned = {0};
+	for (size_t i=0; i!=runs; i+=1){
+		uint64_t start = bench_now_ns();
+		scanned = run_accesses(&ctx, accesses, access_count, false);
+		samples[i] = bench_now_ns() - start;
+	}
+	bench_report_row(&report, "name scan", 0, samples, runs);
+
+	FieldCounts indexed = {0};
+	for (size_t i=0; i!=runs; i+=1){
+		STATS_RESET();
+		uint64_t start = bench_now_ns();
+		indexed = run_accesses(&ctx, accesses, access_count, true);
+		samples[i] = bench_now_ns() - start;
+	}
+	bench_report_row(&report, "field index", 0, samples, runs);
+	bench_report_end(&report);
+
+	if (format == BenchFormat_Text){
+		printf(
+			"\naccesses: %zu, found: %zu, fields: %zu, index slots: %u, class info bytes: %zu\n",
+			access_count, indexed.found, field_count, struct_field_index_capacity(field_count),
+			struct_class_info_size(field_count)
+		);
+#ifdef YACK_STATS
+		printf("field index probes:");
+		for (size_t i=0; i!=STATS_PROBE_BUCKETS; i+=1){
+			printf(" %lu", compiler_stats.probes[StatsTable_Fields][i]);
+		}
+		putchar('\n');
+#endif
+	}
+	free_compiler_context(&ctx);
+	if (memcmp(&scanned, &indexed, sizeof(FieldCounts)) != 0){
+		fprintf(stderr, "field results differ\n");
+		return 1;
+	}
+	return 0;
+}
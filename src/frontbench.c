@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "parser.h"
+#include "files.h"
+#include "bench.h"
+
+
+// front end benchmark, every phase is measured separately on the same input,
+// the input is a source file or a generated corpus, so runs with the same seed
+// and size can be compared between commits and machines
+int main(int argc, char **argv){
+	size_t runs = 10;
+	size_t corpus_size = 16 << 20;
+	uint64_t seed = 1;
+	enum BenchFormat format = BenchFormat_Text;
+	const char *input = NULL;
+	const char *corpus_path = NULL;
+	bool generate_only = false;
+
+	for (int i=1; i!=argc; i+=1){
+		if (trace_parse_option(argv[i])) continue;
+		if (strcmp(argv[i], "-n") == 0 && i+1 != argc){
+			runs = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-s") == 0 && i+1 != argc){
+			corpus_size = bench_parse_size(argv[i+1]);
+			i += 1;
+		} else if (strcmp(argv[i], "-r") == 0 && i+1 != argc){
+			seed = strtoull(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-o") == 0 && i+1 != argc){
+			corpus_path = argv[i+1];
+			i += 1;
+		} else if (strcmp(argv[i], "-f") == 0 && i+1 != argc){
+			if (!bench_parse_format(argv[i+1], &format)){
+				fprintf(stderr, "unknown format: %s\n", argv[i+1]);
+				return 10;
+			}
+			i += 1;
+		} else if (strcmp(argv[i], "-g") == 0){
+			generate_only = true;
+		} else if (strcmp(argv[i], "-h") == 0){
+			printf(
+				"frontbench <options> <source file>\n  options:\n"
+				"  -h             print help\n"
+				"  -n <runs>      number of runs of every phase (default: 10)\n"
+				"  -s <size>      size of the generated corpus, like 64k, 16M, 1G (default: 16M)\n"
+				"  -r <seed>      seed of the corpus generator (default: 1)\n"
+				"  -o <path>      where to write the corpus (default: temporary file)\n"
+				"  -g             only write the corpus to the -o path or stdout\n"
+				"  -f <format>    text, csv or json (default: text)\n"
+				"  --trace=<file.json>  write a chrome trace of all runs\n"
+				"  without a source file the generated corpus is measured\n"
+			);
+			return 0;
+		} else if (argv[i][0] == '-'){
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			return 10;
+		} else{
+			input = argv[i];
+		}
+	}
+	if (runs == 0){
+		fprintf(stderr, "number of runs must be positive\n");
+		return 10;
+	}
+
+	if (generate_only){
+		FILE *out = corpus_path != NULL ? fopen(corpus_path, "wb") : stdout;
+		if (out == NULL){
+			fprintf(stderr, "cannot write the corpus: \"%s\"\n", corpus_path);
+			return 21;
+		}
+		gen_source(out, corpus_size, seed);
+		if (out != stdout) fclose(out);
+		return 0;
+	}
+
+	char temp_path[] = "/tmp/frontbench-XXXXXX";
+	if (input == NULL){
+		FILE *out;
+		if (corpus_path != NULL){
+			out = fopen(corpus_path, "wb");
+			input = corpus_path;
+		} else{
+			int fd = mkstemp(temp_path);
+			out = fd != -1 ? fdopen(fd, "wb") : NULL;
+			input = temp_path;
+		}
+		if (out == NULL){
+			fprintf(stderr, "cannot write the corpus: \"%s\"\n", input);
+			return 21;
+		}
+		gen_source(out, corpus_size, seed);
+		fclose(out);
+	}
+
+	uint64_t *samples = malloc(runs*sizeof(uint64_t));
+	if (samples == NULL){
+		fprintf(stderr, "allocation failrule\n");
+		return 1;
+	}
+
+	init_compiler_shared();
+	CompilerContext ctx;
+	init_compiler_context(&ctx);
+	BenchReport report = bench_report_begin(stdout, format);
+
+	// READING
+	StringView text = {};
+	for (size_t i=0; i!=runs; i+=1){
+		if (text.data != NULL) unmap_file(text);
+		uint64_t start = bench_now_ns();
+		text = mmap_file(input);
+		samples[i] = bench_now_ns() - start;
+		if (text.data == NULL){
+			fprintf(stderr, "error while reading the file: \"%s\"\n", input);
+			return 21;
+		}
+	}
+	bench_report_row(&report, "read", text.size, samples, runs);
+
+	// string literals are stored in the bytecode buffer, it is rewound after
+	// every run, so all runs start from the same state. names stay interned
+	// after the first run, like in a compiler that is already warmed up
+	size_t bc_size = ctx.bc_size;
+	BcNode bc_head = ctx.bc_head;
+	BcNode *bc_last = ctx.bc_last;
+
+	// LEXING
+	AstArray tokens = {};
+	for (size_t i=0; i!=runs; i+=1){
+		ast_array_free(&tokens);
+		ctx.bc_size = bc_size;
+		ctx.bc_head = bc_head;
+		ctx.bc_last = bc_last;
+		uint64_t start = bench_now_ns();
+		tokens = make_tokens(&ctx, text.data);
+		samples[i] = bench_now_ns() - start;
+		if (tokens.data == NULL) raise_error(text.data, tokens.error, tokens.position);
+	}
+	bench_report_row(&report, "lex", text.size, samples, runs);
+
+	// PARSING
+	// tokens are consumed by the parser, so every run gets a fresh copy
+	size_t lexed_bc_size = ctx.bc_size;
+	for (size_t i=0; i!=runs; i+=1){
+		ctx.bc_size = lexed_bc_size;
+		AstArray ast = ast_array_clone(tokens);
+		if (ast.data == NULL){
+			fprintf(stderr, "allocation failrule\n");
+			return 1;
+		}
+		uint64_t start = bench_now_ns();
+		ast = parse_tokens(&ctx, ast);
+		samples[i] = bench_now_ns() - start;
+		if (ast.data == NULL) raise_error(text.data, ast.error, ast.position);
+		ast_array_free(&ast);
+	}
+	bench_report_row(&report, "parse", text.size, samples, runs);
+
+	// FOLDING
+	// folding works in place, so every run gets a fresh copy of the parsed ast
+	ctx.bc_size = lexed_bc_size;
+	AstArray parsed = parse_tokens(&ctx, ast_array_clone(tokens));
+	if (parsed.data == NULL) raise_error(text.data, parsed.error, parsed.position);
+	size_t parsed_size = parsed.end - parsed.data + 1; // with the terminator
+	uint32_t folded = 0;
+	size_t folded_size = 0;
+	for (size_t i=0; i!=runs; i+=1){
+		AstArray ast = ast_array_new(util_max_usize(parsed_size, 32));
+		memcpy(ast.data, parsed.data, parsed_size*sizeof(AstNode));
+		ast.end = ast.data + parsed_size - 1;
+		uint64_t start = bench_now_ns();
+		folded = fold_constants(&ast);
+		samples[i] = bench_now_ns() - start;
+		folded_size = ast.end - ast.data;
+		ast_array_free(&ast);
+	}
+	bench_report_row(&report, "fold constants", text.size, samples, runs);
+
+	// WHOLE FRONT END
+	for (size_t i=0; i!=runs; i+=1){
+		ctx.bc_size = bc_size;
+		ctx.bc_head = bc_head;
+		ctx.bc_last = bc_last;
+		unmap_file(text);
+		uint64_t start = bench_now_ns();
+		text = mmap_file(input);
+		if (text.data == NULL){
+			fprintf(stderr, "error while reading the file: \"%s\"\n", input);
+			return 21;
+		}
+		AstArray ast = make_tokens(&ctx, text.data);
+		if (ast.data == NULL) raise_error(text.data, ast.error, ast.position);
+		ast = parse_tokens(&ctx, ast);
+		if (ast.data == NULL) raise_error(text.data, ast.error, ast.position);
+		fold_constants(&ast);
+		samples[i] = bench_now_ns() - start;
+		ast_array_free(&ast);
+	}
+	bench_report_row(&report, "front end", text.size, samples, runs);
+	bench_report_end(&report);
+	if (format == BenchFormat_Text){
+		printf(
+			"\nfolded operators: %u, ast nodes: %zu before folding, %zu after\n",
+			folded, (size_t)(parsed.end - parsed.data), folded_size
+		);
+	}
+	ast_array_free(&parsed);
+
+	ast_array_free(&tokens);
+	unmap_file(text);
+	free(samples);
+	free_compiler_context(&ctx);
+	if (input == temp_path) unlink(temp_path);
+	return 0;
+}
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "classes.h"
+#include "bench.h"
+
+
+// generic instance benchmark, one generic procedure is instantiated with many
+// different compile time arguments and every instance is then requested again
+// by several calls. the hashed instance set is compared with a linear scan of
+// a per procedure instance array that keeps 16 bits of the hash
+#define KEY_SIZE 3 // two compile time arguments and one infered class
+
+typedef struct{
+	size_t created;
+	size_t found;
+	uint64_t checksum; // of instance numbers, must be the same for both
+} InstanceCounts;
+
+// the obvious implementation, instances are appended in the order of creation
+typedef struct{
+	uint32_t index;
+	uint16_t hash;
+	Data     data[KEY_SIZE];
+} LinearInstance;
+
+typedef struct{
+	LinearInstance *data;
+	size_t size;
+	size_t capacity;
+} LinearInstances;
+
+static uint32_t linear_get(LinearInstances *s, const Data *key, bool *created){
+	uint16_t hash = (uint16_t)data_hash(0, key, KEY_SIZE);
+	for (size_t i=0; i!=s->size; i+=1){
+		const LinearInstance *inst = s->data + i;
+		if (inst->hash == hash && memcmp(inst->data, key, sizeof(inst->data)) == 0){
+			*created = false;
+			return inst->index;
+		}
+	}
+	if (s->size == s->capacity){
+		s->capacity = s->capacity == 0 ? 64 : 2*s->capacity;
+		s->data = realloc(s->data, s->capacity*sizeof(LinearInstance));
+		assert(s->data != NULL && "allocation failrule");
+	}
+	LinearInstance *inst = s->data + s->size;
+	inst->index = s->size;
+	inst->hash = hash;
+	memcpy(inst->data, key, sizeof(inst->data));
+	s->size += 1;
+	*created = true;
+	return inst->index;
+}
+
+
+
+// KEYS
+// compile time arguments are small integers and classes of a handful of
+// kinds, like the arguments of real generic code
+static void make_key(Data *key, uint32_t n){
+	static const Class infered[] = {
+		CLASS_U8, CLASS_U16, CLASS_U32, CLASS_U64, CLASS_I32, CLASS_I64, CLASS_F32, CLASS_F64
+	};
+	key[0] = (Data){ .u64 = n / SIZE(infered) };
+	key[1] = (Data){ .u64 = n % 3 };
+	key[2] = (Data){ .clas = infered[n % SIZE(infered)] };
+}
+
+static InstanceCounts run_hashed(CompilerContext *ctx, const uint32_t *calls, size_t call_count){
+	InstanceCounts c = {0};
+	for (size_t i=0; i!=call_count; i+=1){
+		Data key[KEY_SIZE];
+		make_key(key, calls[i]);
+		bool created;
+		InstanceInfo *inst = get_instance(ctx, 0, key, KEY_SIZE, &created);
+		if (created) inst->bc_index = c.created;
+		c.created += created;
+		c.found += !created;
+		c.checksum += (uint64_t)inst->bc_index * 0x9E3779B97F4A7C15ull;
+	}
+	return c;
+}
+
+static InstanceCounts run_linear(LinearInstances *s, const uint32_t *calls, size_t call_count){
+	InstanceCounts c = {0};
+	for (size_t i=0; i!=call_count; i+=1){
+		Data key[KEY_SIZE];
+		make_key(key, calls[i]);
+		bool created;
+		uint32_t index = linear_get(s, key, &created);
+		c.created += created;
+		c.found += !created;
+		c.checksum += (uint64_t)index * 0x9E3779B97F4A7C15ull;
+	}
+	return c;
+}
+
+
+
+int main(int argc, char **argv){
+	size_t runs = 5;
+	size_t instance_count = 50000;
+	size_t calls_per_instance = 4;
+	uint64_t seed = 1;
+	bool skip_linear = false;
+	enum BenchFormat format = BenchFormat_Text;
+
+	for (int i=1; i!=argc; i+=1){
+		if (strcmp(argv[i], "-n") == 0 && i+1 != argc){
+			runs = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-i") == 0 && i+1 != argc){
+			instance_count = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-c") == 0 && i+1 != argc){
+			calls_per_instance = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-r") == 0 && i+1 != argc){
+			seed = strtoull(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-f") == 0 && i+1 != argc){
+			if (!bench_parse_format(argv[i+1], &format)){
+				fprintf(stderr, "unknown format: %s\n", argv[i+1]);
+				return 10;
+			}
+			i += 1;
+		} else if (strcmp(argv[i], "-l") == 0){
+			skip_linear = true;
+		} else if (strcmp(argv[i], "-h") == 0){
+			printf(
+				"instbench <options>\n  options:\n"
+				"  -h           print help\n"
+				"  -n <runs>    number of runs (default: 5)\n"
+				"  -i <count>   instances of the generic procedure (default: 50000)\n"
+				"  -c <count>   calls of every instance after the first (default: 4)\n"
+				"  -r <seed>    seed of the call order (default: 1)\n"
+				"  -l           skip the linear scan, it runs only once anyway\n"
+				"  -f <format>  text, csv or json (default: text)\n"
+			);
+			return 0;
+		} else{
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			return 10;
+		}
+	}
+	if (runs == 0 || instance_count == 0){
+		fprintf(stderr, "number of runs and instances must be positive\n");
+		return 10;
+	}
+
+	// every instance is created by its first call, later calls are shuffled
+	size_t call_count = instance_count*(1 + calls_per_instance);
+	uint32_t *calls = malloc(call_count*sizeof(uint32_t));
+	uint64_t *samples = malloc(runs*sizeof(uint64_t));
+	if (calls == NULL || samples == NULL){
+		fprintf(stderr, "allocation failrule\n");
+		return 1;
+	}
+	BenchRandom rng = { seed | 1u };
+	for (size_t i=0; i!=call_count; i+=1){
+		calls[i] = i < instance_count ? i : bench_random_below(&rng, instance_count);
+	}
+
+	init_compiler_shared();
+	CompilerContext ctx;
+	init_compiler_context(&ctx);
+	BenchReport report = bench_report_begin(stdout, format);
+
+	InstanceCounts hashed = {0};
+	for (size_t i=0; i!=runs; i+=1){
+		free_instance_set(&ctx);
+		init_instance_set(&ctx);
+		STATS_RESET();
+		uint64_t start = bench_now_ns();
+		hashed = run_hashed(&ctx, calls, call_count);
+		samples[i] = bench_now_ns() - start;
+	}
+	bench_report_row(&report, "hashed instances", 0, samples, runs);
+
+	InstanceCounts linear = hashed;
+	if (!skip_linear){
+		// quadratic in the number of instances, so it runs only once
+		LinearInstances scan = {0};
+		uint64_t start = bench_now_ns();
+		linear = run_linear(&scan, calls, call_count);
+		samples[0] = bench_now_ns() - start;
+		bench_report_row(&report, "linear scan", 0, samples, 1);
+		free(scan.data);
+	}
+	bench_report_end(&report);
+
+	if (format == BenchFormat_Text){
+		printf(
+			"\ncalls: %zu, instances: %zu, found: %zu, table capacity: %zu\n",
+			call_count, hashed.created, hashed.found, (size_t)ctx.instance_set.capacity
+		);
+#ifdef YACK_STATS
+		printf("instance set probes:");
+		for (size_t i=0; i!=STATS_PROBE_BUCKETS; i+=1){
+			printf(" %lu", compiler_stats.probes[StatsTable_Instances][i]);
+		}
+		putchar('\n');
+#endif
+	}
+	free_compiler_context(&ctx);
+	if (memcmp(&hashed, &linear, sizeof(InstanceCounts)) != 0){
+		fprintf(stderr, "instance results differ\n");
+		return 1;
+	}
+	return 0;
+}
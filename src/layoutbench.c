@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "classes.h"
+#include "bench.h"
+
+
+// struct layout benchmark, data heavy structs with fields of mixed sizes are
+// laid out in the order of declaration and in the compact layout. the bytes
+// saved are reported per struct, then arrays of records of both sizes are
+// traversed, reading one field of every record, like hot loops over records
+typedef struct{
+	uint32_t idx;
+	uint32_t saved;
+} Layout;
+
+static const Class FieldClasses[] = {
+	CLASS_U8, CLASS_U8, CLASS_U16, CLASS_U32, CLASS_U64, CLASS_I32, CLASS_F32, CLASS_F64,
+	CLASS_Bool, CLASS_VOID_PTR
+};
+
+
+
+// GENERATOR
+// the same fields in both layouts, a small array of bytes now and then, the
+// last field is a u64 that the traversal reads
+static uint32_t add_struct(
+	CompilerContext *ctx, BenchRandom rng, uint16_t field_count, enum StructLayout layout
+){
+	uint32_t idx = class_info_alloc(ctx, struct_class_info_size(field_count));
+	StructClassInfo *info = struct_class_info(ctx, idx);
+	*info = (StructClassInfo){
+		.size = field_count, .stored_field_count = field_count, .field_count = field_count,
+		.layout = layout
+	};
+	NameId *names = struct_field_names(info);
+	for (size_t i=0; i!=field_count; i+=1){
+		Class cl = FieldClasses[bench_random_below(&rng, SIZE(FieldClasses))];
+		if (bench_random_below(&rng, 8) == 0){
+			cl = get_array_class(ctx, CLASS_U8, 1 + bench_random_below(&rng, 6));
+		}
+		info->classes[i] = i+1 == field_count ? CLASS_U64 : cl;
+		names[i] = bench_name_id(ctx, i);
+	}
+	return idx;
+}
+
+// TRAVERSAL
+static uint64_t sum_field(
+	const uint8_t *records, size_t count, uint32_t bytesize, uint32_t offset
+){
+	uint64_t sum = 0;
+	for (size_t i=0; i!=count; i+=1){
+		uint64_t value;
+		memcpy(&value, records + i*bytesize + offset, sizeof(value));
+		sum += value;
+	}
+	return sum;
+}
+
+static uint8_t *make_records(const StructClassInfo *info, uint32_t field, size_t count){
+	uint8_t *records = calloc(count, info->bytesize);
+	assert(records != NULL && "allocation failrule");
+	for (uint64_t i=0; i!=count; i+=1){
+		memcpy(records + i*info->bytesize + struct_offsets(info)[field], &i, sizeof(i));
+	}
+	return records;
+}
+
+
+
+int main(int argc, char **argv){
+	size_t runs = 5;
+	size_t struct_count = 100;
+	size_t max_fields = 24;
+	size_t record_count = 1000000;
+	size_t printed = 10;
+	uint64_t seed = 1;
+	enum BenchFormat format = BenchFormat_Text;
+
+	for (int i=1; i!=argc; i+=1){
+		int common = bench_parse_common(argc, argv, &i, &runs, &seed, &format);
+		if (common < 0) return 10;
+		if (common > 0) continue;
+		if (strcmp(argv[i], "-t") == 0 && i+1 != argc){
+			struct_count = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-w") == 0 && i+1 != argc){
+			max_fields = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-c") == 0 && i+1 != argc){
+			record_count = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-p") == 0 && i+1 != argc){
+			printed = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-h") == 0){
+			printf(
+				"layoutbench <options>\n  options:\n"
+				"  -h           print help\n"
+				"  -n <runs>    number of runs (default: 5)\n"
+				"  -t <count>   structs (default: 100)\n"
+				"  -w <count>   most fields of a struct (default: 24)\n"
+				"  -c <count>   records of the traversed struct (default: 1000000)\n"
+				"  -p <count>   structs in the report (default: 10)\n"
+				"  -r <seed>    seed of the generator (default: 1)\n"
+				"  -f <format>  text, csv or json (default: text)\n"
+			);
+			return 0;
+		} else{
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			return 10;
+		}
+	}
+	if (runs == 0 || struct_count == 0 || max_fields < 2 || max_fields > UINT16_MAX/8){
+		fprintf(stderr,
+			"number of runs and structs must be positive, fields must be 2 to %d\n", UINT16_MAX/8
+		);
+		return 10;
+	}
+
+	init_compiler_shared();
+	CompilerContext ctx;
+	init_compiler_context(&ctx);
+
+	Layout *declared = malloc(struct_count*sizeof(Layout));
+	Layout *compact = malloc(struct_count*sizeof(Layout));
+	uint64_t *samples = malloc(runs*sizeof(uint64_t));
+	if (declared == NULL || compact == NULL || samples == NULL){
+		fprintf(stderr, "allocation failrule\n");
+		return 1;
+	}
+	BenchRandom rng = { seed | 1u };
+	size_t declared_bytes = 0, compact_bytes = 0;
+	for (size_t i=0; i!=struct_count; i+=1){
+		uint16_t field_count = 2 + bench_random_below(&rng, max_fields - 1);
+		BenchRandom fields = { bench_random(&rng) | 1u };
+		declared[i].idx = add_struct(&ctx, fields, field_count, StructLayout_Declared);
+		compact[i].idx = add_struct(&ctx, fields, field_count, StructLayout_Compact);
+		StructClassInfo *d = struct_class_info(&ctx, declared[i].idx);
+		StructClassInfo *c = struct_class_info(&ctx, compact[i].idx);
+		declared[i].saved = layout_struct_class(&ctx, d);
+		compact[i].saved = layout_struct_class(&ctx, c);
+		declared_bytes += d->bytesize;
+		compact_bytes += c->bytesize;
+		if (i < printed && format == BenchFormat_Text){
+			printf("struct %zu ", i);
+			print_struct_layout(stdout, c, compact[i].saved);
+		}
+	}
+	if (format == BenchFormat_Text){
+		printf(
+			"all %zu structs: %zu bytes declared, %zu bytes compact, saved %.1lf%%\n\n",
+			struct_count, declared_bytes, compact_bytes,
+			100.0*(double)(declared_bytes - compact_bytes)/(double)declared_bytes
+		);
+	}
+
+	// the struct that saves the most is traversed
+	size_t best = 0;
+	for (size_t i=0; i!=struct_count; i+=1){
+		if (compact[i].saved > compact[best].saved) best = i;
+	}
+	const StructClassInfo *d = struct_class_info(&ctx, declared[best].idx);
+	const StructClassInfo *c = struct_class_info(&ctx, compact[best].idx);
+	uint32_t field = d->stored_field_count - 1;
+	uint8_t *d_records = make_records(d, field, record_count);
+	uint8_t *c_records = make_records(c, field, record_count);
+
+	BenchReport report = bench_report_begin(stdout, format);
+	uint64_t d_sum = 0, c_sum = 0;
+	for (size_t i=0; i!=runs; i+=1){
+		uint64_t start = bench_now_ns();
+		d_sum = sum_field(d_records, record_count, d->bytesize, struct_offsets(d)[field]);
+		samples[i] = bench_now_ns() - start;
+	}
+	bench_report_row(&report, "declared layout", record_count*d->bytesize, samples, runs);
+	for (size_t i=0; i!=runs; i+=1){
+		uint64_t start = bench_now_ns();
+		c_sum = sum_field(c_records, record_count, c->bytesize, struct_offsets(c)[field]);
+		samples[i] = bench_now_ns() - start;
+	}
+	bench_report_row(&report, "compact layout", record_count*c->bytesize, samples, runs);
+	bench_report_end(&report);
+
+	if (format == BenchFormat_Text){
+		printf(
+			"\ntraversed struct %zu: %u bytes declared, %u bytes compact\n",
+			best, (uint32_t)d->bytesize, (uint32_t)c->bytesize
+		);
+	}
+	free(d_records);
+	free(c_records);
+	free_compiler_context(&ctx);
+	if (d_sum != c_sum){
+		fprintf(stderr, "traversal results differ\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <ftw.h>
+#include <sys/stat.h>
+
+#include "parser.h"
+#include "files.h"
+#include "loader.h"
+#include "bench.h"
+
+
+// compares loading of many small files one by one with mmap_file, with
+// io_uring and with the thread pool, with and without lexing every file as
+// soon as it is loaded
+static struct{
+	char **data;
+	size_t size;
+	size_t capacity;
+	size_t bytes;
+} paths;
+
+static int collect_path(const char *path, const struct stat *s, int type, struct FTW *ftw){
+	if (type != FTW_F) return 0;
+	size_t length = strlen(path);
+	if (length < 3 || strcmp(path + length - 3, ".yk") != 0) return 0;
+	if (paths.size == paths.capacity){
+		paths.capacity = paths.capacity == 0 ? 1024 : 2*paths.capacity;
+		paths.data = realloc(paths.data, paths.capacity*sizeof(char *));
+		if (paths.data == NULL) return 1;
+	}
+	paths.data[paths.size] = strdup(path);
+	paths.size += 1;
+	paths.bytes += s->st_size;
+	return 0;
+}
+
+static int compare_paths(const void *a, const void *b){
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// writes count files of random sizes into 100 subdirectories
+static bool generate_tree(const char *dir, size_t count, uint64_t seed){
+	BenchRandom rng = { seed | 1u };
+	char path[4096];
+	mkdir(dir, 0755);
+	for (size_t i=0; i!=count; i+=1){
+		snprintf(path, sizeof(path), "%s/d%02zu", dir, i % 100);
+		if (i < 100) mkdir(path, 0755);
+		snprintf(path, sizeof(path), "%s/d%02zu/f%05zu.yk", dir, i % 100, i);
+		FILE *out = fopen(path, "wb");
+		if (out == NULL) return false;
+		// mostly small files with a few big ones
+		size_t size = 512 + bench_random_below(&rng, 8192);
+		if (bench_random_below(&rng, 64) == 0) size *= 32;
+		gen_source(out, size, bench_random(&rng));
+		fclose(out);
+	}
+	return true;
+}
+
+// evicts the files from the page cache, clean pages can be dropped without root
+static void drop_cache(void){
+	for (size_t i=0; i!=paths.size; i+=1){
+		int fd = open(paths.data[i], O_RDONLY);
+		if (fd < 0) continue;
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+}
+
+static void lex_file(CompilerContext *ctx, StringView text){
+	size_t bc_size = ctx->bc_size;
+	AstArray tokens = make_tokens(ctx, text.data);
+	if (tokens.data == NULL){
+		fprintf(stderr, "lexing error: \"%s\"\n", tokens.error);
+		exit(1);
+	}
+	ast_array_free(&tokens);
+	ctx->bc_size = bc_size;
+}
+
+static uint64_t run_sequential(CompilerContext *ctx, bool lex){
+	uint64_t start = bench_now_ns();
+	for (size_t i=0; i!=paths.size; i+=1){
+		StringView text = mmap_file(paths.data[i]);
+		if (text.data == NULL){
+			fprintf(stderr, "error while reading the file: \"%s\"\n", paths.data[i]);
+			exit(21);
+		}
+		if (lex) lex_file(ctx, text);
+		unmap_file(text);
+	}
+	return bench_now_ns() - start;
+}
+
+static uint64_t run_loader(CompilerContext *ctx, bool lex, size_t thread_count, uint32_t flags){
+	uint64_t start = bench_now_ns();
+	FileLoader loader;
+	if (!file_loader_init(
+		&loader, (const char *const *)paths.data, paths.size, thread_count, flags
+	)){
+		fprintf(stderr, "cannot start the loader\n");
+		exit(1);
+	}
+	LoadedFile file;
+	while (file_loader_next(&loader, &file)){
+		if (file.error != 0){
+			fprintf(stderr, "error while reading the file: \"%s\"\n", paths.data[file.index]);
+			exit(21);
+		}
+		if (lex) lex_file(ctx, file.text);
+		free_file(file.text);
+	}
+	file_loader_free(&loader);
+	return bench_now_ns() - start;
+}
+
+
+
+int main(int argc, char **argv){
+	size_t runs = 5;
+	size_t file_count = 10000;
+	size_t thread_count = 2*sysconf(_SC_NPROCESSORS_ONLN);
+	uint64_t seed = 1;
+	bool cold = false;
+	bool generate = false;
+	enum BenchFormat format = BenchFormat_Text;
+	const char *dir = NULL;
+
+	for (int i=1; i!=argc; i+=1){
+		if (strcmp(argv[i], "-n") == 0 && i+1 != argc){
+			runs = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-g") == 0 && i+1 != argc){
+			file_count = strtoul(argv[i+1], NULL, 10);
+			generate = true;
+			i += 1;
+		} else if (strcmp(argv[i], "-r") == 0 && i+1 != argc){
+			seed = strtoull(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-j") == 0 && i+1 != argc){
+			thread_count = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-f") == 0 && i+1 != argc){
+			if (!bench_parse_format(argv[i+1], &format)){
+				fprintf(stderr, "unknown format: %s\n", argv[i+1]);
+				return 10;
+			}
+			i += 1;
+		} else if (strcmp(argv[i], "-c") == 0){
+			cold = true;
+		} else if (strcmp(argv[i], "-h") == 0){
+			printf(
+				"loadbench <options> <directory>\n  options:\n"
+				"  -h           print help\n"
+				"  -g <count>   first generate a tree of count files (10000 is a good size)\n"
+				"  -r <seed>    seed of the tree generator (default: 1)\n"
+				"  -n <runs>    number of runs (default: 5)\n"
+				"  -j <count>   threads of the pread pool (default: twice the cores)\n"
+				"  -c           drop the files from the page cache before every run\n"
+				"  -f <format>  text, csv or json (default: text)\n"
+				"  all .yk files in the directory are loaded\n"
+			);
+			return 0;
+		} else if (argv[i][0] == '-'){
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			return 10;
+		} else{
+			dir = argv[i];
+		}
+	}
+	if (dir == NULL || runs == 0){
+		fprintf(stderr, "directory is not specified, try -h\n");
+		return 10;
+	}
+
+	if (generate && !generate_tree(dir, file_count, seed)){
+		fprintf(stderr, "cannot generate the tree: \"%s\"\n", dir);
+		return 21;
+	}
+	if (nftw(dir, collect_path, 64, FTW_PHYS) != 0 || paths.size == 0){
+		fprintf(stderr, "no source files in: \"%s\"\n", dir);
+		return 21;
+	}
+	qsort(paths.data, paths.size, sizeof(char *), compare_paths);
+
+	init_compiler_shared();
+	CompilerContext ctx;
+	init_compiler_context(&ctx);
+	uint64_t *samples = malloc(runs*sizeof(uint64_t));
+	if (samples == NULL){
+		fprintf(stderr, "allocation failrule\n");
+		return 1;
+	}
+
+	FileLoader probe;
+	bool probe_ok = file_loader_init(&probe, NULL, 0, 1, 0);
+	bool has_uring = probe_ok && probe.use_uring;
+	if (probe_ok) file_loader_free(&probe);
+	if (!has_uring) fprintf(stderr, "io_uring is not available, only the pool is measured\n");
+
+	static const struct{ const char *name; int mode; bool lex; } Benchmarks[] = {
+		{ "mmap_file",          0, false },
+		{ "mmap_file + lex",    0, true  },
+		{ "io_uring",           1, false },
+		{ "io_uring + lex",     1, true  },
+		{ "pread pool",         2, false },
+		{ "pread pool + lex",   2, true  },
+	};
+	BenchReport report = bench_report_begin(stdout, format);
+	for (size_t b=0; b!=SIZE(Benchmarks); b+=1){
+		if (Benchmarks[b].mode == 1 && !has_uring) continue;
+		for (size_t i=0; i!=runs; i+=1){
+			if (cold) drop_cache();
+			switch (Benchmarks[b].mode){
+			case 0: samples[i] = run_sequential(&ctx, Benchmarks[b].lex); break;
+			case 1: samples[i] = run_loader(&ctx, Benchmarks[b].lex, thread_count, 0); break;
+			default:
+				samples[i] = run_loader(
+					&ctx, Benchmarks[b].lex, thread_count, LoaderFlag_NoUring
+				);
+				break;
+			}
+		}
+		bench_report_row(&report, Benchmarks[b].name, paths.bytes, samples, runs);
+	}
+	bench_report_end(&report);
+	return 0;
+}
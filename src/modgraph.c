@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "modules.h"
+#include "sema.h"
+
+
+static void print_global_name(FILE *file, const Module *m, NameId name_id){
+	const char *names = (const char *)m->ctx->names.data;
+	fprintf(file, "%.*s", (int)(uint8_t)names[name_id-1], names + name_id);
+}
+
+// prints the loop that the global closed
+static void print_cycle(Sema *s, SemaItem head){
+	SemaItem item = head;
+	do{
+		const Module *m = sema_module(s, item.module_id)->module;
+		const SemaGlobal *g = sema_global(s, item);
+		print_global_name(stderr, m, g->name_id);
+		fprintf(stderr, " -> ");
+		item = g->waiting_on;
+	} while (!sema_same_item(item, head));
+	print_global_name(stderr, sema_module(s, head.module_id)->module, sema_global(s, head)->name_id);
+	fputc('\n', stderr);
+}
+
+// loads the root module with everything it imports and prints the import graph
+int main(int argc, char **argv){
+	const char *input = NULL;
+	size_t worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+	bool show_time = false;
+	bool analyse = false;
+	const char **entries = malloc(argc*sizeof(char *));
+	size_t entry_count = 0;
+	for (int i=1; i!=argc; i+=1){
+		if (trace_parse_option(argv[i])) continue;
+		if (strcmp(argv[i], "-j") == 0 && i+1 != argc){
+			worker_count = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-e") == 0 && i+1 != argc){
+			entries[entry_count] = argv[i+1];
+			entry_count += 1;
+			analyse = true;
+			i += 1;
+		} else if (strcmp(argv[i], "-t") == 0){
+			show_time = true;
+		} else if (strcmp(argv[i], "-a") == 0){
+			analyse = true;
+		} else if (strcmp(argv[i], "-h") == 0){
+			printf(
+				"modgraph <options> <root module>\n  options:\n"
+				"  -h           print help\n"
+				"  -j <count>   number of workers (default: number of cores)\n"
+				"  -t           print loading time of every module\n"
+				"  -a           analyse globals reachable from the entry points and print\n"
+				"               how many procedure bodies were skipped\n"
+				"  -e <name>    entry point in the root module, can be repeated (default: main,\n"
+				"               or every global of the root module if it has no main)\n"
+				"  --trace=<file.json>  write a chrome trace of module loading\n"
+			);
+			return 0;
+		} else if (argv[i][0] == '-'){
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			return 10;
+		} else{
+			input = argv[i];
+		}
+	}
+	if (input == NULL){
+		fprintf(stderr, "root module is not specified, try -h\n");
+		return 10;
+	}
+
+	init_compiler_shared();
+	ModuleGraph graph;
+	if (!module_graph_init(&graph, worker_count)){
+		fprintf(stderr, "cannot start module workers\n");
+		return 1;
+	}
+	uint64_t start = trace_now_ns();
+	uint16_t root = module_graph_import(&graph, input);
+	if (root == 0){
+		fprintf(stderr, "error while reading the file: \"%s\"\n", input);
+		return 21;
+	}
+	module_graph_wait_all(&graph);
+	uint64_t total_time = trace_now_ns() - start;
+
+	int status = 0;
+	for (uint16_t id=1; id<=graph.size; id+=1){
+		const Module *m = module_get(&graph, id);
+		printf("%5u  %s", (unsigned)id, m->path);
+		if (show_time) printf("  %.3lf [ms]", (double)m->load_time_ns*1e-6);
+		printf("\n       imports:");
+		for (uint32_t i=0; i!=m->import_count; i+=1) printf(" %u", (unsigned)m->imports[i]);
+		putchar('\n');
+
+		if (m->error == NULL) continue;
+		status = 1;
+		if (m->text.data != NULL){
+			fprintf(stderr, "%s: error: \"%s\"", m->path, m->error);
+			print_codeline(m->text.data, m->error_pos);
+		} else if (m->importer != 0){
+			const Module *importer = module_get(&graph, m->importer);
+			fprintf(stderr, "%s: error: \"%s\"", importer->path, m->error);
+			print_codeline(importer->text.data, m->import_pos);
+		} else{
+			fprintf(stderr, "%s: error: \"%s\"\n", m->path, m->error);
+		}
+	}
+	if (show_time){
+		printf(
+			"modules: %u, workers: %zu, total time: %.3lf [ms]\n",
+			(unsigned)graph.size, graph.worker_count, (double)total_time*1e-6
+		);
+	}
+
+	if (analyse && status == 0){
+		Sema sema;
+		uint64_t analyse_start = trace_now_ns();
+		sema_init(&sema, &graph);
+		for (size_t i=0; i!=entry_count; i+=1){
+			if (!sema_add_root(&sema, root, entries[i])){
+				fprintf(stderr, "entry point is not defined: \"%s\"\n", entries[i]);
+				return 1;
+			}
+		}
+		if (entry_count == 0 && !sema_add_root(&sema, root, "main")){
+			sema_add_all_roots(&sema, root);
+		}
+		sema_run(&sema);
+		uint64_t analyse_time = trace_now_ns() - analyse_start;
+
+		for (uint16_t id=1; id<=sema.module_count; id+=1){
+			const SemaModule *sm = sema.modules + id - 1;
+			if (sm->module == NULL) continue;
+			for (uint32_t i=0; i!=sm->global_count; i+=1){
+				const SemaGlobal *g = sm->globals + i;
+				if (!g->cycle_head) continue;
+				status = 1;
+				fprintf(stderr, "%s: error: \"%s\"", sm->module->path, g->error);
+				print_codeline(sm->module->text.data, g->error_pos);
+				fprintf(stderr, "  ");
+				print_cycle(&sema, (SemaItem){ .module_id = id, .global = i });
+			}
+		}
+
+		SemaStats stats = sema_stats(&sema);
+		printf(
+			"globals: %zu, analysed: %zu, redefined: %zu, unresolved names: %zu\n"
+			"procedures: %zu, analysed bodies: %zu, skipped bodies: %zu\n"
+			"body nodes: %zu, skipped: %zu (%.1lf%%)\n"
+			"definition nodes: %zu, visited: %zu, suspensions: %zu, cycles: %zu\n",
+			stats.globals, stats.globals_analysed, stats.redefined, stats.unresolved,
+			stats.procedures, stats.bodies_analysed, stats.bodies_skipped,
+			stats.body_nodes, stats.body_nodes_skipped,
+			stats.body_nodes == 0 ? 0.0 :
+				100.0*(double)stats.body_nodes_skipped/(double)stats.body_nodes,
+			stats.nodes, stats.nodes_visited, stats.suspensions, stats.cycles
+		);
+		if (show_time) printf("analysis time: %.3lf [ms]\n", (double)analyse_time*1e-6);
+		sema_free(&sema);
+	}
+
+	module_graph_free(&graph);
+	return status;
+}
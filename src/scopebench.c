@@ -0,0 +1,347 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "parser.h"
+#include "files.h"
+#include "scopes.h"
+#include "bench.h"
+
+
+// name resolution benchmark, names of a token array are resolved with the
+// hashed scope stack and with a linear scan of a variable stack. the generated
+// file has many globals and procedures that use them, with parameters and
+// locals that shadow globals and nested blocks that open and close scopes
+typedef struct{
+	size_t defined;
+	size_t redefined;
+	size_t found;
+	size_t missing;
+	uint64_t checksum; // of found variable indexes, must be the same for both
+} ResolveCounts;
+
+// the obvious implementation, scopes remember where their variables begin
+typedef struct{
+	VariableInfo *vars;
+	uint32_t vars_size;
+	uint32_t vars_capacity;
+	uint32_t *scopes;
+	uint32_t scopes_size;
+	uint32_t scopes_capacity;
+} LinearScopes;
+
+static void linear_push(LinearScopes *s){
+	if (s->scopes_size == s->scopes_capacity){
+		s->scopes_capacity = s->scopes_capacity == 0 ? 64 : 2*s->scopes_capacity;
+		s->scopes = realloc(s->scopes, s->scopes_capacity*sizeof(uint32_t));
+		assert(s->scopes != NULL && "allocation failrule");
+	}
+	s->scopes[s->scopes_size] = s->vars_size;
+	s->scopes_size += 1;
+}
+
+static void linear_pop(LinearScopes *s){
+	s->scopes_size -= 1;
+	s->vars_size = s->scopes[s->scopes_size];
+}
+
+static VarIndex linear_find(const LinearScopes *s, NameId name_id, uint32_t end){
+	for (uint32_t i=s->vars_size; i!=end; i-=1){
+		if (s->vars[i-1].name_id == name_id) return i-1;
+	}
+	return -1;
+}
+
+static VarIndex linear_define(LinearScopes *s, NameId name_id){
+	if (linear_find(s, name_id, s->scopes[s->scopes_size-1]) >= 0) return -1;
+	if (s->vars_size == s->vars_capacity){
+		s->vars_capacity = s->vars_capacity == 0 ? 256 : 2*s->vars_capacity;
+		s->vars = realloc(s->vars, s->vars_capacity*sizeof(VariableInfo));
+		assert(s->vars != NULL && "allocation failrule");
+	}
+	s->vars[s->vars_size] = (VariableInfo){ .name_id = name_id };
+	s->vars_size += 1;
+	return s->vars_size - 1;
+}
+
+
+
+// RESOLUTION
+// walks the tokens, braces open block scopes, parameters of a procedure are
+// in its own scope that is closed together with the body
+enum OpenKind{ Open_Other, Open_Params, Open_Body, Open_Block };
+
+static bool is_opening_token(enum AstType type){
+	switch (type){
+	case Ast_OpenPar:
+	case Ast_OpenProcedureClass:
+	case Ast_OpenScope:
+	case Ast_OpenBlock:
+	case Ast_Subscript:
+	case Ast_FieldSubscript:
+		return true;
+	default: return false;
+	}
+}
+
+#define RESOLVE_WALK(ON_PUSH, ON_POP, ON_DEFINE, ON_FIND) \
+	uint8_t kinds[1024]; \
+	size_t depth = 0; \
+	bool in_params = false; \
+	bool body_next = false; \
+	for (const AstNode *it=tokens.data+1; it->type!=Ast_Terminator; it+=TokenSizes[it->type]){ \
+		enum AstType type = it->type; \
+		NameId name_id = it[1].data.name_id; \
+		if (type == Ast_Nop) continue; \
+		if (type == Ast_OpenProcedure){ \
+			ON_PUSH(Scope_Params); \
+			kinds[depth++] = Open_Params; \
+			in_params = true; \
+		} else if (type == Ast_OpenBrace){ \
+			ON_PUSH(body_next ? Scope_Procedure : Scope_Block); \
+			kinds[depth++] = body_next ? Open_Body : Open_Block; \
+		} else if (is_opening_token(type)){ \
+			kinds[depth++] = Open_Other; \
+		} else if (type == Ast_EndScope){ \
+			depth -= 1; \
+			if (kinds[depth] == Open_Params){ \
+				in_params = false; \
+				/* parameters stay visible in the body */ \
+				const AstNode *next = it + TokenSizes[type]; \
+				while (next->type == Ast_Nop) next += TokenSizes[Ast_Nop]; \
+				if (next->type == Ast_OpenBrace){ \
+					body_next = true; \
+					continue; \
+				} \
+				ON_POP(); \
+			} else if (kinds[depth] == Open_Body){ \
+				ON_POP(); \
+				ON_POP(); \
+			} else if (kinds[depth] == Open_Block){ \
+				ON_POP(); \
+			} \
+		} else if (type == Ast_Variable){ \
+			ON_DEFINE(name_id); \
+		} else if (type == Ast_Identifier){ \
+			if (in_params){ ON_DEFINE(name_id); } else{ ON_FIND(name_id); } \
+		} \
+		body_next = false; \
+		assert(depth < SIZE(kinds)); \
+	}
+
+static ResolveCounts resolve_hashed(ScopeStack *s, AstArray tokens){
+	ResolveCounts c = {0};
+	scope_push(s, Scope_Global);
+#define ON_PUSH(type) scope_push(s, type)
+#define ON_POP() scope_pop(s)
+#define ON_DEFINE(name_id) { \
+		VarIndex var = scope_define(s, name_id, 0); \
+		c.defined += var >= 0; \
+		c.redefined += var < 0; \
+	}
+#define ON_FIND(name_id) { \
+		VarIndex var = scope_find(s, name_id); \
+		c.found += var >= 0; \
+		c.missing += var < 0; \
+		c.checksum += (uint64_t)var * 0x9E3779B97F4A7C15ull; \
+	}
+	RESOLVE_WALK(ON_PUSH, ON_POP, ON_DEFINE, ON_FIND)
+#undef ON_PUSH
+#undef ON_POP
+#undef ON_DEFINE
+#undef ON_FIND
+	scope_pop(s);
+	assert(s->scopes_size == 0 && s->vars_size == 0);
+	return c;
+}
+
+static ResolveCounts resolve_linear(LinearScopes *s, AstArray tokens){
+	ResolveCounts c = {0};
+	linear_push(s);
+#define ON_PUSH(type) linear_push(s)
+#define ON_POP() linear_pop(s)
+#define ON_DEFINE(name_id) { \
+		VarIndex var = linear_define(s, name_id); \
+		c.defined += var >= 0; \
+		c.redefined += var < 0; \
+	}
+#define ON_FIND(name_id) { \
+		VarIndex var = linear_find(s, name_id, 0); \
+		c.found += var >= 0; \
+		c.missing += var < 0; \
+		c.checksum += (uint64_t)var * 0x9E3779B97F4A7C15ull; \
+	}
+	RESOLVE_WALK(ON_PUSH, ON_POP, ON_DEFINE, ON_FIND)
+#undef ON_PUSH
+#undef ON_POP
+#undef ON_DEFINE
+#undef ON_FIND
+	linear_pop(s);
+	assert(s->scopes_size == 0 && s->vars_size == 0);
+	return c;
+}
+
+
+
+// GENERATOR
+static void gen_globals_source(FILE *out, size_t global_count, size_t proc_count, uint64_t seed){
+	BenchRandom rng = { seed | 1u };
+	for (size_t i=0; i!=global_count; i+=1){
+		if (i < 2){
+			fprintf(out, "g%zu :: %zu;\n", i, i + 1);
+			continue;
+		}
+		fprintf(out, "g%zu :: g%u * g%u + %u;\n", i,
+			bench_random_below(&rng, i), bench_random_below(&rng, i),
+			bench_random_below(&rng, 1000)
+		);
+	}
+	for (size_t i=0; i!=proc_count; i+=1){
+		uint32_t g[6];
+		for (size_t j=0; j!=SIZE(g); j+=1) g[j] = bench_random_below(&rng, global_count);
+		fprintf(out,
+			"\nproc_%zu :: (a, b) => {\n"
+			"\tx := a + g%u;\n"
+			"\tg%u := x * b;\n"
+			"\ty := { x + g%u; g%u * a };\n"
+			"\tinner :: (a, c) => { d := a + c + g%u; d * x };\n"
+			"\tinner(y, g%u) + missing_%zu\n"
+			"};\n",
+			i, g[0], g[1], g[1], g[2], g[3], g[4], i
+		);
+	}
+}
+
+
+
+int main(int argc, char **argv){
+	size_t runs = 5;
+	size_t global_count = 100000;
+	size_t proc_count = 2000;
+	uint64_t seed = 1;
+	bool skip_linear = false;
+	enum BenchFormat format = BenchFormat_Text;
+	const char *input = NULL;
+
+	for (int i=1; i!=argc; i+=1){
+		if (strcmp(argv[i], "-n") == 0 && i+1 != argc){
+			runs = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-g") == 0 && i+1 != argc){
+			global_count = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-p") == 0 && i+1 != argc){
+			proc_count = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-r") == 0 && i+1 != argc){
+			seed = strtoull(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-f") == 0 && i+1 != argc){
+			if (!bench_parse_format(argv[i+1], &format)){
+				fprintf(stderr, "unknown format: %s\n", argv[i+1]);
+				return 10;
+			}
+			i += 1;
+		} else if (strcmp(argv[i], "-l") == 0){
+			skip_linear = true;
+		} else if (strcmp(argv[i], "-h") == 0){
+			printf(
+				"scopebench <options> <source file>\n  options:\n"
+				"  -h           print help\n"
+				"  -n <runs>    number of runs (default: 5)\n"
+				"  -g <count>   globals in the generated file (default: 100000)\n"
+				"  -p <count>   procedures in the generated file (default: 2000)\n"
+				"  -r <seed>    seed of the generator (default: 1)\n"
+				"  -l           skip the linear scan, it runs only once anyway\n"
+				"  -f <format>  text, csv or json (default: text)\n"
+				"  without a source file the generated file is measured\n"
+			);
+			return 0;
+		} else if (argv[i][0] == '-'){
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			return 10;
+		} else{
+			input = argv[i];
+		}
+	}
+	if (runs == 0 || global_count < 2){
+		fprintf(stderr, "number of runs must be positive and there must be at least 2 globals\n");
+		return 10;
+	}
+
+	StringView text;
+	if (input != NULL){
+		text = mmap_file(input);
+	} else{
+		FILE *out = tmpfile();
+		if (out == NULL){
+			fprintf(stderr, "cannot create a temporary file\n");
+			return 21;
+		}
+		gen_globals_source(out, global_count, proc_count, seed);
+		rewind(out);
+		text = read_file(out);
+		fclose(out);
+	}
+	if (text.data == NULL){
+		fprintf(stderr, "error while reading the file: \"%s\"\n", input ? input : "<generated>");
+		return 21;
+	}
+
+	init_compiler_shared();
+	CompilerContext ctx;
+	init_compiler_context(&ctx);
+	AstArray tokens = make_tokens(&ctx, text.data);
+	if (tokens.data == NULL){
+		raise_error(text.data, tokens.error, tokens.position);
+	}
+
+	uint64_t *samples = malloc(runs*sizeof(uint64_t));
+	if (samples == NULL){
+		fprintf(stderr, "allocation failrule\n");
+		return 1;
+	}
+	BenchReport report = bench_report_begin(stdout, format);
+
+	ScopeStack scopes;
+	scope_stack_init(&scopes);
+	ResolveCounts hashed = {0};
+	for (size_t i=0; i!=runs; i+=1){
+		uint64_t start = bench_now_ns();
+		hashed = resolve_hashed(&scopes, tokens);
+		samples[i] = bench_now_ns() - start;
+	}
+	bench_report_row(&report, "hashed scopes", text.size, samples, runs);
+	scope_stack_free(&scopes);
+
+	ResolveCounts linear = hashed;
+	if (!skip_linear){
+		// quadratic in the number of globals, so it runs only once
+		LinearScopes scan = {0};
+		uint64_t start = bench_now_ns();
+		linear = resolve_linear(&scan, tokens);
+		samples[0] = bench_now_ns() - start;
+		bench_report_row(&report, "linear scan", text.size, samples, 1);
+		free(scan.vars);
+		free(scan.scopes);
+	}
+	bench_report_end(&report);
+
+	if (format == BenchFormat_Text){
+		printf(
+			"\ndefined: %zu, redefined: %zu, found: %zu, missing: %zu\n",
+			hashed.defined, hashed.redefined, hashed.found, hashed.missing
+		);
+#ifdef YACK_STATS
+		printf("scope index probes:");
+		for (size_t i=0; i!=STATS_PROBE_BUCKETS; i+=1){
+			printf(" %lu", compiler_stats.probes[StatsTable_Scopes][i]);
+		}
+		putchar('\n');
+#endif
+	}
+	if (memcmp(&hashed, &linear, sizeof(ResolveCounts)) != 0){
+		fprintf(stderr, "resolution results differ\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+
+extern char **environ;
+
+static int compare_doubles(const void *a, const void *b){
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+// runs the command repeatedly and reports wall time of whole process lifetimes
+static bool bench_command(const char *label, char **args, size_t runs){
+	double *times = malloc(runs*sizeof(double));
+	if (times == NULL) return false;
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+	for (size_t i=0; i!=runs; i+=1){
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		pid_t pid;
+		if (posix_spawn(&pid, args[0], &actions, NULL, args, environ) != 0){
+			fprintf(stderr, "cannot run: \"%s\"\n", args[0]);
+			free(times);
+			return false;
+		}
+		int status;
+		waitpid(pid, &status, 0);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0){
+			fprintf(stderr, "\"%s\" failed\n", args[0]);
+			free(times);
+			return false;
+		}
+		times[i] = (end.tv_sec - start.tv_sec)*1e6 + (end.tv_nsec - start.tv_nsec)*1e-3;
+	}
+	posix_spawn_file_actions_destroy(&actions);
+
+	qsort(times, runs, sizeof(double), compare_doubles);
+	printf(
+		"%-10s median:%10.1lf [us]   p99:%10.1lf [us]   min:%10.1lf [us]\n",
+		label, times[runs/2], times[(runs*99)/100], times[0]
+	);
+	free(times);
+	return true;
+}
+
+
+
+int main(int argc, char **argv){
+	size_t runs = 200;
+	const char *program = "bin/testnodes";
+	const char *image = NULL;
+	const char *input = NULL;
+	for (int i=1; i!=argc; i+=1){
+		if (strcmp(argv[i], "-n") == 0 && i+1 != argc){
+			runs = strtoul(argv[i+1], NULL, 10);
+			i += 1;
+		} else if (strcmp(argv[i], "-p") == 0 && i+1 != argc){
+			program = argv[i+1];
+			i += 1;
+		} else if (strcmp(argv[i], "-I") == 0 && i+1 != argc){
+			image = argv[i+1];
+			i += 1;
+		} else if (strcmp(argv[i], "-h") == 0){
+			printf(
+				"startbench <options> <tiny source file>\n  options:\n"
+				"  -h            print help\n"
+				"  -n <runs>     number of runs (default: 200)\n"
+				"  -p <program>  front end driver (default: bin/testnodes)\n"
+				"  -I <image>    also measure starting from this snapshot\n"
+			);
+			return 0;
+		} else if (argv[i][0] == '-'){
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			return 10;
+		} else{
+			input = argv[i];
+		}
+	}
+	if (input == NULL || runs == 0){
+		fprintf(stderr, "input file is not specified, try -h\n");
+		return 10;
+	}
+
+	char *cold_args[] = {(char *)program, "-tas", (char *)input, NULL};
+	if (!bench_command("cold", cold_args, runs)) return 1;
+
+	if (image != NULL){
+		char *snap_args[] = {(char *)program, "-tas", "-I", (char *)image, (char *)input, NULL};
+		if (!bench_command("snapshot", snap_args, runs)) return 1;
+	}
+	return 0;
+}
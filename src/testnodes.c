@@ -1,16 +1,20 @@
 #include <stdio.h>
 #include <time.h>
 
-#include "eval.h"
+#include "parser.h"
 #include "files.h"
+#include "snapshot.h"
+#include "jobs.h"
 
 
-void print_tokens(AstArray tokens);
-void print_ast(AstArray tokens);
+void print_tokens(const CompilerContext *ctx, AstArray tokens);
+void print_ast(const CompilerContext *ctx, AstArray tokens);
 
 size_t count_tokens(AstArray tokens);
 size_t count_ast(AstArray ast);
 
+int run_parallel(char **inputs, size_t input_count, size_t max_threads);
+
 
 
 // settings
@@ -19,12 +23,20 @@ bool show_ast    = true;
 bool show_stats  = true;
 bool show_nops   = false;
 bool show_sets   = false;
+bool show_report = false;
+bool show_memory = false;
+bool fold        = false;
 
 
 
 int main(int argc, char **argv){
 	char *input = NULL;
+	char *snapshot_path = NULL;
+	char **inputs = malloc(argc*sizeof(char *));
+	size_t input_count = 0;
+	size_t thread_count = 0;
 	for (size_t i=1; i!=argc; i+=1){
+		if (trace_parse_option(argv[i])) continue;
 		if (argv[i][0] == '-'){
 			for (size_t j=1;; j+=1){
 				char opt = argv[i][j];
@@ -33,35 +45,78 @@ int main(int argc, char **argv){
 				case 'h':
 					printf(
 						"testnodes <option> <filename>\n  options:\n"
-						"  -h     print help\n"
-						"  -t     dont show tokens\n"
-						"  -a     dont show ast nodes\n"
-						"  -s     dont show statistics\n"
-						"  -S     print hash set info\n"
-						"  -n     show nops\n"
+						"  -h          print help\n"
+						"  -t          dont show tokens\n"
+						"  -a          dont show ast nodes\n"
+						"  -s          dont show statistics\n"
+						"  -S          print hash set info\n"
+						"  -n          show nops\n"
+						"  -F          fold constants after parsing\n"
+						"  -R          print instrumentation report as json (build with -DYACK_STATS)\n"
+						"  -M          print memory usage\n"
+						"  -I <image>  start from a compiler snapshot\n"
+						"  -j <count>  parse many files with up to count threads and print\n"
+						"              throughput for every thread count\n"
+						"  --trace=<file.json>\n"
+						"              write a chrome trace of compilation phases\n"
 					);
 					return 0;
+				case 'I':
+					if (argv[i][j+1] != '\0' || i+1 == (size_t)argc){
+						fprintf(stderr, "option -I takes a snapshot path\n");
+						return 10;
+					}
+					i += 1;
+					snapshot_path = argv[i];
+					goto NextArgument;
+				case 'j':
+					if (argv[i][j+1] != '\0' || i+1 == (size_t)argc){
+						fprintf(stderr, "option -j takes a thread count\n");
+						return 10;
+					}
+					i += 1;
+					thread_count = strtoul(argv[i], NULL, 10);
+					if (thread_count == 0){
+						fprintf(stderr, "thread count must be positive\n");
+						return 10;
+					}
+					goto NextArgument;
 				case 't': show_tokens = false; break;
 				case 'a': show_ast    = false; break;
 				case 's': show_stats  = false; break;
 				case 'n': show_nops   = true;  break;
 				case 'S': show_sets   = true;  break;
+				case 'R': show_report = true;  break;
+				case 'M': show_memory = true;  break;
+				case 'F': fold        = true;  break;
 				default:
 					fprintf(stderr, "unknown option: -%c\n", opt);
 					return 10;
 				}
 			}
 		} else{
-			if (input != NULL){
-				fprintf(stderr, "input file already specified\n");
-				return 20;
-			}
-			input = argv[i];
+			inputs[input_count] = argv[i];
+			input_count += 1;
+		}
+	NextArgument:;
+	}
+
+	if (thread_count != 0){
+		if (input_count == 0){
+			fprintf(stderr, "input files are not specified\n");
+			return 20;
 		}
+		return run_parallel(inputs, input_count, thread_count);
+	}
+	if (input_count > 1){
+		fprintf(stderr, "input file already specified\n");
+		return 20;
 	}
+	if (input_count == 1) input = inputs[0];
 
 	StringView text;
 	time_t read_time = clock();
+	TraceSpan read_span = trace_begin("read");
 	if (input == NULL){
 		text = read_file(stdin);
 		if (text.data == NULL){
@@ -75,12 +130,24 @@ int main(int argc, char **argv){
 			return 21;
 		}
 	}
+	trace_end(read_span);
 	read_time = clock() - read_time;
 
-	initialize_compiler_globals();
+	time_t init_time = clock();
+	init_compiler_shared();
+	CompilerContext ctx;
+	if (snapshot_path != NULL){
+		if (!load_compiler_snapshot(&ctx, snapshot_path)){
+			fprintf(stderr, "cannot load the snapshot: \"%s\"\n", snapshot_path);
+			return 22;
+		}
+	} else{
+		init_compiler_context(&ctx);
+	}
+	init_time = clock() - init_time;
 
 	time_t tok_time = clock();
-	AstArray tokens = make_tokens(text.data);
+	AstArray tokens = make_tokens(&ctx, text.data);
 	tok_time = clock() - tok_time; 
 	if (tokens.data == NULL){
 		raise_error(text.data, tokens.error, tokens.position);
@@ -88,26 +155,30 @@ int main(int argc, char **argv){
 
 	if (show_tokens){
 		puts("tokens:");
-		print_tokens(tokens);
+		print_tokens(&ctx, tokens);
 		putchar('\n');
 	}
 
 	AstArray ast = ast_array_clone(tokens);
 
 	time_t parse_time = clock();
-	ast = parse_tokens(ast);
+	ast = parse_tokens(&ctx, ast);
 	parse_time = clock() - parse_time;
 	if (ast.data == NULL){
 		raise_error(text.data, ast.error, ast.position);
 	}
+	time_t fold_time = clock();
+	uint32_t folded = fold ? fold_constants(&ast) : 0;
+	fold_time = clock() - fold_time;
 
 	if (show_ast){
 		puts("ast:");
-		print_ast(ast);
+		print_ast(&ctx, ast);
 		putchar('\n');
 	}
 
 	if (show_stats){
+		double init_time_s = (double)init_time * 0.000001;
 		double read_time_s = (double)read_time * 0.000001;
 		double tok_time_s = (double)tok_time * 0.000001;
 		double parse_time_s = (double)parse_time * 0.000001;
@@ -125,11 +196,17 @@ int main(int argc, char **argv){
 		printf("tokens size    :%10zu\n", token_size);
 		printf("ast nodes size :%10zu\n", ast_size);
 		printf("nodes/tokens size ratio : %8.6lf\n\n", (double)ast_size/(double)token_size);
+
+		if (fold){
+			printf("folded operators :%10u\n", folded);
+			printf("folding time     :%10.6lf [s]\n\n", (double)fold_time * 0.000001);
+		}
 		
 		printf("lexing speed     :%13.2lf [tokens/s]\n", (double)token_count/tok_time_s);
 		printf("parsing speed    :%13.2lf [nodes/s]\n", (double)ast_count/parse_time_s);
 		printf("making ast speed :%13.2lf [nodes/s]\n\n", (double)ast_count/making_ast_time_s);
 		
+		printf("init time       :%10.6lf [s]\n", init_time_s);
 		printf("reading time    :%10.6lf [s]\n", read_time_s);
 		printf("lexing time     :%10.6lf [s]\n", tok_time_s);
 		printf("parsing time    :%10.6lf [s]\n", parse_time_s);
@@ -142,18 +219,31 @@ int main(int argc, char **argv){
 	}
 
 	if (show_sets){
-		printf("uniuqe names:         %zu\n", global_name_set.size);
-		printf("name set capacity:    %zu\n", global_name_set.capacity);
-		printf("names data size:      %zu\n", global_names.size);
-		printf("names data capacity:  %zu\n", global_names.capacity);
-		printf("hash colissions:      %zu\n", hash_colissions);
-		printf("hash colission ratio: %lf\n", (double)hash_colissions/(double)global_name_set.size);
+		printf("uniuqe names:         %zu\n", ctx.name_set.size);
+		printf("name set capacity:    %zu\n", ctx.name_set.capacity);
+		printf("names data size:      %zu\n", ctx.names.size);
+		printf("names data capacity:  %zu\n", ctx.names.capacity);
+		printf("hash colissions:      %zu\n", ctx.hash_colissions);
+		printf("hash colission ratio: %lf\n", (double)ctx.hash_colissions/(double)ctx.name_set.size);
+	}
+
+	if (show_memory){
+		print_memory_report(stdout);
+	}
+
+	if (show_report){
+#ifdef YACK_STATS
+		print_compiler_stats(stdout, &ctx);
+#else
+		fprintf(stderr, "instrumentation is compiled out, build with -DYACK_STATS\n");
+		return 10;
+#endif
 	}
 
 	return 0;
 }
 
-void print_tokens(AstArray tokens){
+void print_tokens(const CompilerContext *ctx, AstArray tokens){
 	for (size_t i=1; i!=tokens.end-tokens.data;){
 		AstNode node = tokens.data[i];
 		Data data = tokens.data[i+1].data;
@@ -173,14 +263,14 @@ void print_tokens(AstArray tokens){
 		case Ast_Identifier:
 			printf(": \"");
 			for (size_t i=0; i!=node.count; i+=1){
-				putchar(global_names.data[data.name_id+i]);
+				putchar(ctx->names.data[data.name_id+i]);
 			}
 			printf("\"");
 			break;
 		case Ast_Variable:
 			printf(": \"");
 			for (size_t i=0; i!=node.count; i+=1){
-				putchar(global_names.data[data.name_id+i]);
+				putchar(ctx->names.data[data.name_id+i]);
 			}
 			printf("\" ");
 			if (node.flags & AstFlag_ClassSpec  ){ printf("ClassSpec ");   }
@@ -196,7 +286,7 @@ void print_tokens(AstArray tokens){
 		case Ast_String:{
 			printf(
 				": size = %u, repr = \"%s\"", data.bufinfo.size,
-				(const char *)(global_bc + data.bufinfo.index)
+				(const char *)(ctx->bc + data.bufinfo.index)
 			);
 			break;
 		}
@@ -218,7 +308,7 @@ void print_tokens(AstArray tokens){
 	}
 }
 
-void print_ast(AstArray ast){
+void print_ast(const CompilerContext *ctx, AstArray ast){
 	for (size_t i=1; i!=ast.end-ast.data;){
 		AstNode node = ast.data[i];
 		Data data = ast.data[i+1].data;
@@ -260,20 +350,23 @@ void print_ast(AstArray ast){
 		case Ast_Float64:
 			printf(": %lf", data.f64);
 			break;
+		case Ast_Bool:
+			printf(": %s", data.u64 ? "true" : "false");
+			break;
 		case Ast_Identifier:
 		case Ast_GetField:
 		case Ast_EnumLiteral:
 		case Ast_NamedInfered:
 			printf(": \"");
 			for (size_t i=0; i!=node.count; i+=1){
-				putchar(global_names.data[data.name_id+i]);
+				putchar(ctx->names.data[data.name_id+i]);
 			}
 			printf("\"");
 			break;
 		case Ast_Variable:
 			printf(": \"");
 			for (size_t i=0; i!=node.count; i+=1){
-				putchar(global_names.data[data.name_id+i]);
+				putchar(ctx->names.data[data.name_id+i]);
 			}
 			printf("\"");
 			if (node.flags & AstFlag_Global     ){ printf(" Global");   }
@@ -294,10 +387,16 @@ void print_ast(AstArray ast){
 			printf(": code = %u, repr = \"%s\"", data.code, repr);
 			break;
 		}
+		case Ast_Import:
+			printf(
+				": module = %u, path = \"%s\"", (unsigned)node.count,
+				(const char *)(ctx->bc + data.bufinfo.index)
+			);
+			break;
 		case Ast_String:{
 			printf(
 				": size = %u, repr = \"%s\"", data.bufinfo.size,
-				(const char *)(global_bc + data.bufinfo.index)
+				(const char *)(ctx->bc + data.bufinfo.index)
 			);
 			break;
 		}
@@ -340,3 +439,196 @@ size_t count_ast(AstArray ast){
 	}
 	return res;
 }
+
+
+
+// PARALLEL FRONT END
+// every file is lexed and parsed by one job with the compiler context of the
+// worker that runs it. files are sorted from the biggest and split in halves,
+// so the biggest files start first and thieves take the largest ranges left
+typedef struct{
+	const char *path;
+	StringView text;
+	size_t token_count;
+	size_t ast_count;
+	const char *error;
+	uint32_t error_pos;
+} ParallelFile;
+
+typedef struct{
+	Job job;
+	uint32_t begin;
+	uint32_t end;
+} ParallelRange;
+
+static struct{
+	JobScheduler scheduler;
+	CompilerContext *contexts;
+	ParallelFile *files;
+	size_t file_count;
+	ParallelRange *ranges; // one per file is enough for binary splitting
+	_Atomic uint32_t range_count;
+	uint64_t *busy_ns; // per worker
+	size_t total_tokens;
+	size_t total_nodes;
+	size_t failed;
+} parallel;
+
+static void parallel_parse_file(ParallelFile *f, CompilerContext *ctx){
+	AstArray tokens = make_tokens(ctx, f->text.data);
+	if (tokens.data == NULL){
+		f->error = tokens.error;
+		f->error_pos = tokens.position;
+		return;
+	}
+	f->token_count = count_tokens(tokens);
+	AstArray ast = parse_tokens(ctx, tokens);
+	if (ast.data == NULL){
+		f->error = ast.error;
+		f->error_pos = ast.position;
+		return;
+	}
+	f->ast_count = count_ast(ast);
+	ast_array_free(&ast);
+}
+
+static void parallel_range_job(Job *job, uint32_t worker){
+	ParallelRange *range = job->data;
+	uint32_t begin = range->begin;
+	uint32_t end = range->end;
+	while (end - begin > 1){
+		uint32_t middle = begin + (end - begin)/2;
+		uint32_t index = atomic_fetch_add_explicit(&parallel.range_count, 1, memory_order_relaxed);
+		ParallelRange *half = parallel.ranges + index;
+		half->begin = middle;
+		half->end = end;
+		job_init(&half->job, parallel_range_job, half, job);
+		job_submit(&parallel.scheduler, &half->job);
+		end = middle;
+	}
+	uint64_t start = trace_now_ns();
+	parallel_parse_file(parallel.files + begin, parallel.contexts + worker);
+	parallel.busy_ns[worker] += trace_now_ns() - start;
+}
+
+// continuation of the root range, runs once every file is parsed
+static void parallel_sum_job(Job *job, uint32_t worker){
+	parallel.total_tokens = 0;
+	parallel.total_nodes = 0;
+	parallel.failed = 0;
+	for (size_t i=0; i!=parallel.file_count; i+=1){
+		const ParallelFile *f = parallel.files + i;
+		parallel.total_tokens += f->token_count;
+		parallel.total_nodes += f->ast_count;
+		parallel.failed += f->error != NULL;
+	}
+}
+
+static int compare_files_by_size(const void *a, const void *b){
+	size_t size_a = ((const ParallelFile *)a)->text.size;
+	size_t size_b = ((const ParallelFile *)b)->text.size;
+	return (size_a < size_b) - (size_a > size_b);
+}
+
+int run_parallel(char **inputs, size_t input_count, size_t max_threads){
+	max_threads = util_clamp_usize(max_threads, 1, JOB_WORKER_MAX);
+	parallel.files = calloc(input_count, sizeof(ParallelFile));
+	parallel.file_count = input_count;
+	parallel.ranges = calloc(input_count, sizeof(ParallelRange));
+	parallel.contexts = calloc(max_threads, sizeof(CompilerContext));
+	parallel.busy_ns = calloc(max_threads, sizeof(uint64_t));
+	if (
+		parallel.files == NULL || parallel.ranges == NULL ||
+		parallel.contexts == NULL || parallel.busy_ns == NULL
+	){
+		fprintf(stderr, "allocation failrule\n");
+		return 1;
+	}
+
+	size_t total_size = 0;
+	for (size_t i=0; i!=input_count; i+=1){
+		ParallelFile *f = parallel.files + i;
+		f->path = inputs[i];
+		f->text = mmap_file(inputs[i]);
+		if (f->text.data == NULL){
+			fprintf(stderr, "error while reading the file: \"%s\"\n", inputs[i]);
+			return 21;
+		}
+		total_size += f->text.size;
+	}
+	qsort(parallel.files, input_count, sizeof(ParallelFile), compare_files_by_size);
+	init_compiler_shared();
+
+	printf(
+		"files: %zu, size: %.3lf [MB], biggest file: %.3lf [MB]\n\n",
+		input_count, (double)total_size*0.000001,
+		(double)parallel.files[0].text.size*0.000001
+	);
+	printf("threads    time [s]    speed [MB/s]   speed [nodes/s]   speedup   busy   steals\n");
+	double base_time_s = 0.0;
+	int status = 0;
+	for (size_t threads=1;; threads*=2){
+		threads = util_min_usize(threads, max_threads);
+		if (!job_scheduler_init(&parallel.scheduler, threads)){
+			fprintf(stderr, "cannot start the scheduler\n");
+			return 1;
+		}
+		threads = parallel.scheduler.worker_count;
+		for (size_t i=0; i!=threads; i+=1){
+			init_compiler_context(parallel.contexts + i);
+			parallel.busy_ns[i] = 0;
+		}
+		for (size_t i=0; i!=input_count; i+=1){
+			parallel.files[i].error = NULL;
+		}
+
+		uint64_t start = trace_now_ns();
+		Job all, sum;
+		job_init(&all, NULL, NULL, NULL);
+		ParallelRange *root = parallel.ranges;
+		atomic_store(&parallel.range_count, 1);
+		root->begin = 0;
+		root->end = input_count;
+		job_init(&root->job, parallel_range_job, root, &all);
+		job_init(&sum, parallel_sum_job, NULL, &all);
+		job_then(&root->job, &sum);
+		job_submit(&parallel.scheduler, &root->job);
+		job_wait_children(&parallel.scheduler, &all);
+		double time_s = (double)(trace_now_ns() - start)*1e-9;
+
+		uint64_t busy_ns = 0;
+		for (size_t i=0; i!=threads; i+=1) busy_ns += parallel.busy_ns[i];
+		job_scheduler_free(&parallel.scheduler);
+		size_t steals = parallel.scheduler.stolen;
+		for (size_t i=0; i!=threads; i+=1){
+			free_compiler_context(parallel.contexts + i);
+		}
+
+		if (threads == 1) base_time_s = time_s;
+		printf(
+			"%7zu%12.6lf%16.2lf%18.0lf%10.2lf%6.0lf%%%9zu\n",
+			threads, time_s, (double)total_size*0.000001/time_s,
+			(double)parallel.total_nodes/time_s, base_time_s/time_s,
+			100.0*(double)busy_ns*1e-9/(time_s*(double)threads), steals
+		);
+		if (parallel.failed != 0){
+			status = 1;
+			break;
+		}
+		if (threads == max_threads) break;
+	}
+
+	for (size_t i=0; i!=input_count; i+=1){
+		const ParallelFile *f = parallel.files + i;
+		if (f->error != NULL){
+			fprintf(stderr, "%s: error: \"%s\"", f->path, f->error);
+			print_codeline(f->text.data, f->error_pos);
+		}
+		unmap_file(f->text);
+	}
+	free(parallel.files);
+	free(parallel.ranges);
+	free(parallel.contexts);
+	free(parallel.busy_ns);
+	return status;
+}
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <time.h>
+
+#include "server.h"
+
+
+static bool send_request(const char *socket_path, const char *request, bool show_time);
+
+
+
+int main(int argc, char **argv){
+	const char *socket_path = SERVER_DEFAULT_SOCKET;
+	bool show_time = false;
+	bool sent_any = false;
+	for (int i=1; i!=argc; i+=1){
+		if (argv[i][0] == '-'){
+			if (argv[i][1]=='s' && argv[i][2]=='\0' && i+1 != argc){
+				i += 1;
+				socket_path = argv[i];
+			} else if (argv[i][1]=='t' && argv[i][2]=='\0'){
+				show_time = true;
+			} else if (argv[i][1]=='i' && argv[i][2]=='\0'){
+				if (!send_request(socket_path, "stats\n", show_time)) return 1;
+				sent_any = true;
+			} else if (argv[i][1]=='x' && argv[i][2]=='\0'){
+				if (!send_request(socket_path, "stop\n", show_time)) return 1;
+				sent_any = true;
+			} else if (argv[i][1]=='h' && argv[i][2]=='\0'){
+				printf(
+					"yackc <options> <filenames>\n  options:\n"
+					"  -h         print help\n"
+					"  -s <path>  socket path (default: " SERVER_DEFAULT_SOCKET ")\n"
+					"  -t         print round trip time of every request\n"
+					"  -i         print server statistics\n"
+					"  -x         stop the server\n"
+				);
+				return 0;
+			} else{
+				fprintf(stderr, "unknown option: %s\n", argv[i]);
+				return 10;
+			}
+			continue;
+		}
+
+		char path[PATH_MAX];
+		if (realpath(argv[i], path) == NULL){
+			fprintf(stderr, "cannot resolve path: \"%s\"\n", argv[i]);
+			return 21;
+		}
+		char request[SERVER_MESSAGE_CAPACITY];
+		if (snprintf(request, sizeof(request), "parse %s\n", path) >= (int)sizeof(request)){
+			fprintf(stderr, "path is too long: \"%s\"\n", path);
+			return 21;
+		}
+		if (!send_request(socket_path, request, show_time)) return 1;
+		sent_any = true;
+	}
+
+	if (!sent_any){
+		fprintf(stderr, "nothing to do, try -h\n");
+		return 10;
+	}
+	return 0;
+}
+
+
+
+static bool send_request(const char *socket_path, const char *request, bool show_time){
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	int fd = server_connect(socket_path);
+	if (fd == -1){
+		fprintf(stderr, "cannot connect to the server: \"%s\"\n", socket_path);
+		return false;
+	}
+	if (!server_write_all(fd, request, strlen(request))){
+		fprintf(stderr, "cannot send the request\n");
+		close(fd);
+		return false;
+	}
+	char reply[SERVER_MESSAGE_CAPACITY];
+	size_t reply_size = server_read_line(fd, reply, sizeof(reply));
+	close(fd);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (show_time){
+		double us = (end.tv_sec - start.tv_sec)*1e6 + (end.tv_nsec - start.tv_nsec)*1e-3;
+		printf("%9.1lf [us]  ", us);
+	}
+	fputs(reply, stdout);
+	if (reply_size == 0 || reply[reply_size-1] != '\n') putchar('\n');
+	return true;
+}
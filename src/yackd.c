@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <time.h>
+
+#include "server.h"
+
+
+static size_t handle_request(
+	CompilerContext *ctx, SourceCache *cache, char *request, char *reply, size_t capacity
+);
+
+static double elapsed_us(struct timespec start){
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start.tv_sec)*1e6 + (end.tv_nsec - start.tv_nsec)*1e-3;
+}
+
+
+
+int main(int argc, char **argv){
+	const char *socket_path = SERVER_DEFAULT_SOCKET;
+	bool verbose = false;
+	for (int i=1; i!=argc; i+=1){
+		if (argv[i][0]=='-' && argv[i][1]=='s' && argv[i][2]=='\0' && i+1 != argc){
+			i += 1;
+			socket_path = argv[i];
+		} else if (argv[i][0]=='-' && argv[i][1]=='v' && argv[i][2]=='\0'){
+			verbose = true;
+		} else if (argv[i][0]=='-' && argv[i][1]=='h' && argv[i][2]=='\0'){
+			printf(
+				"yackd <options>\n  options:\n"
+				"  -h         print help\n"
+				"  -s <path>  socket path (default: " SERVER_DEFAULT_SOCKET ")\n"
+				"  -v         log every request\n"
+			);
+			return 0;
+		} else{
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			return 10;
+		}
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	int listen_fd = server_listen(socket_path);
+	if (listen_fd == -1){
+		fprintf(stderr, "cannot listen on socket: \"%s\"\n", socket_path);
+		return 20;
+	}
+
+	// the context lives as long as the server, so interned names and classes
+	// are shared by all requests
+	init_compiler_shared();
+	CompilerContext ctx;
+	init_compiler_context(&ctx);
+
+	SourceCache cache;
+	source_cache_init(&cache);
+
+	char request[SERVER_MESSAGE_CAPACITY];
+	char reply[SERVER_MESSAGE_CAPACITY];
+	for (;;){
+		int fd = accept(listen_fd, NULL, NULL);
+		if (fd == -1) continue;
+		server_set_timeout(fd);
+
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		server_read_line(fd, request, sizeof(request));
+		size_t reply_size = handle_request(&ctx, &cache, request, reply, sizeof(reply));
+		server_write_all(fd, reply, reply_size);
+		close(fd);
+
+		if (verbose){
+			fprintf(stderr, "%9.1lf [us]  %s", elapsed_us(start), reply);
+		}
+		if (reply_size == 0) break;
+	}
+
+	close(listen_fd);
+	unlink(socket_path);
+	return 0;
+}
+
+
+
+// long paths don't fit, the reply is cut and still ends with a newline
+static size_t format_reply(char *reply, size_t capacity, const char *format, ...){
+	va_list args;
+	va_start(args, format);
+	int size = vsnprintf(reply, capacity, format, args);
+	va_end(args);
+	if (size < 0) size = snprintf(reply, capacity, "error: cannot format the reply\n");
+	if ((size_t)size >= capacity){
+		size = capacity - 1;
+		reply[size-1] = '\n';
+	}
+	return size;
+}
+
+// returns zero when the server should stop
+static size_t handle_request(
+	CompilerContext *ctx, SourceCache *cache, char *request, char *reply, size_t capacity
+){
+	size_t request_size = strlen(request);
+	if (request_size != 0 && request[request_size-1] == '\n'){
+		request[request_size-1] = '\0';
+	}
+
+	if (strcmp(request, "stop") == 0) return 0;
+
+	if (strcmp(request, "stats") == 0){
+		return format_reply(reply, capacity,
+			"files: %zu, hits: %zu, reparses: %zu, names: %zu, "
+			"array classes: %zu, tuple classes: %zu, bytecode size: %zu, "
+			"memory: %zu KB, peak memory: %zu KB, peak rss: %zu KB\n",
+			cache->size, cache->hits, cache->reparses, (size_t)ctx->name_set.size,
+			(size_t)ctx->array_set.size, (size_t)ctx->tuple_set.size, ctx->bc_size,
+			(size_t)atomic_load(&memory_stats.total) / 1024,
+			(size_t)atomic_load(&memory_stats.total_peak) / 1024,
+			memory_peak_rss() / 1024
+		);
+	}
+
+	if (strncmp(request, "parse ", 6) == 0){
+		const char *path = request + 6;
+		if (path[0] != '/'){
+			return format_reply(reply, capacity, "error %s: path must be absolute\n", path);
+		}
+		CachedSource *entry = source_cache_find(cache, path);
+		bool reparsed;
+		if (!source_cache_update(ctx, cache, entry, &reparsed)){
+			return format_reply(reply, capacity, "error %s: cannot read the file\n", path);
+		}
+		if (entry->error != NULL){
+			return format_reply(reply, capacity,
+				"error %s:%u:%u: %s\n",
+				path, entry->error_row+1, entry->error_col+1, entry->error
+			);
+		}
+		return format_reply(reply, capacity,
+			"ok %s: tokens = %zu, nodes = %zu%s\n",
+			path, entry->token_count, entry->node_count, reparsed ? "" : ", cached"
+		);
+	}
+
+	return format_reply(reply, capacity, "error: unknown request\n");
+}
@@ -0,0 +1,70 @@
+#include <stdio.h>
+
+#include "parser.h"
+#include "files.h"
+#include "snapshot.h"
+
+
+// builds a compiler snapshot, prelude files are lexed and parsed into the
+// context first, so their names and string data are part of the image
+int main(int argc, char **argv){
+	const char *output = NULL;
+	init_compiler_shared();
+	CompilerContext ctx;
+	init_compiler_context(&ctx);
+
+	for (int i=1; i!=argc; i+=1){
+		if (trace_parse_option(argv[i])) continue;
+		if (argv[i][0]=='-' && argv[i][1]=='o' && argv[i][2]=='\0' && i+1 != argc){
+			i += 1;
+			output = argv[i];
+			continue;
+		}
+		if (argv[i][0]=='-' && argv[i][1]=='h' && argv[i][2]=='\0'){
+			printf(
+				"yacksnap -o <image> <prelude files>\n  options:\n"
+				"  -h          print help\n"
+				"  -o <image>  output snapshot path\n"
+				"  --trace=<file.json>  write a chrome trace of compilation phases\n"
+			);
+			return 0;
+		}
+		if (argv[i][0] == '-'){
+			fprintf(stderr, "unknown option: %s\n", argv[i]);
+			return 10;
+		}
+
+		FILE *file = fopen(argv[i], "rb");
+		if (file == NULL){
+			fprintf(stderr, "error while reading the file: \"%s\"\n", argv[i]);
+			return 21;
+		}
+		TraceSpan read_span = trace_begin("read");
+		StringView text = read_file(file);
+		fclose(file);
+		trace_end(read_span);
+		if (text.data == NULL){
+			fprintf(stderr, "allocation failrule\n");
+			return 1;
+		}
+		AstArray tokens = make_tokens(&ctx, text.data);
+		if (tokens.data == NULL) raise_error(text.data, tokens.error, tokens.position);
+		AstArray ast = parse_tokens(&ctx, tokens);
+		if (ast.data == NULL) raise_error(text.data, ast.error, ast.position);
+		ast_array_free(&ast);
+		free_file(text);
+	}
+
+	if (output == NULL){
+		fprintf(stderr, "output path is not specified, try -h\n");
+		return 10;
+	}
+	TraceSpan save_span = trace_begin("save snapshot");
+	bool saved = save_compiler_snapshot(&ctx, output);
+	trace_end(save_span);
+	if (!saved){
+		fprintf(stderr, "cannot write the snapshot: \"%s\"\n", output);
+		return 30;
+	}
+	return 0;
+}